@@ -14,6 +14,10 @@ ChatWindow::ChatWindow(QWidget *parent) : QMainWindow(parent) {
     connect(socket, &QTcpSocket::connected, this, &ChatWindow::onConnect);
     connect(socket, &QTcpSocket::readyRead, this, &ChatWindow::onReadyRead);
     connect(socket, &QTcpSocket::disconnected, this, &ChatWindow::onDisconnect);
+    // A failed reconnect attempt does not emit disconnected()
+    connect(socket, &QAbstractSocket::errorOccurred, this, [this]() {
+        if (socket->state() == QAbstractSocket::UnconnectedState) scheduleReconnect();
+    });
 
     refreshTimer = new QTimer(this);
     connect(refreshTimer, &QTimer::timeout, this, &ChatWindow::sendRefreshRequests);
@@ -45,6 +49,7 @@ void ChatWindow::onDiscoveryResponse() {
         if (datagram.data().contains("SERVER_HERE")) {
             QHostAddress serverIp = datagram.senderAddress();
             statusBar()->showMessage("Found server at: " + serverIp.toString(), 2000);
+            serverAddress = serverIp;
 
             socket->connectToHost(serverIp, 9000);
 
@@ -102,6 +107,10 @@ void ChatWindow::setupUI() {
 
     QHBoxLayout *addFriendLayout = new QHBoxLayout();
     addFriendInput = new QLineEdit(); addFriendInput->setPlaceholderText("Username...");
+    userSuggestions = new QStringListModel(this);
+    QCompleter *userCompleter = new QCompleter(userSuggestions, this);
+    userCompleter->setCaseSensitivity(Qt::CaseSensitive);
+    addFriendInput->setCompleter(userCompleter);
     friendTypeSelector = new QComboBox();
     friendTypeSelector->addItem("Normal");
     friendTypeSelector->addItem("Close");
@@ -238,6 +247,13 @@ void ChatWindow::setupUI() {
     connect(chatInput, &QLineEdit::returnPressed, this, &ChatWindow::onSendMessageClicked);
 
     connect(addFriendBtn, &QPushButton::clicked, this, &ChatWindow::onAddFriendClicked);
+    connect(addFriendInput, &QLineEdit::textEdited, [this](const QString& text) {
+        // Ask as the user types; the completer pops up when the answer lands
+        QString prefix = text.trimmed();
+        if (binaryMode && !currentUsername.isEmpty() && prefix.size() >= 2) {
+            sendCommand(Protocol::OP_SUGGEST_USERS, {prefix, "8"});
+        }
+    });
     connect(friendRequestsList, &QListWidget::itemClicked, this, &ChatWindow::onAcceptRequestClicked);
     connect(createGroupBtn, &QPushButton::clicked, this, &ChatWindow::onCreateGroupClicked);
 
@@ -273,41 +289,77 @@ void ChatWindow::setupUI() {
 void ChatWindow::onConnect() {
     currentUserLabel->setText("Connected as Guest");
     statusBar()->showMessage("Connected to server.", 5000);
-    socket->write("FEED\n");
+
+    // Ask for framed, compressed mode; an older server answers with an
+    // error and the session simply stays on the text protocol.
+    inBuffer.clear();
+    pendingRequests.clear();
+    binaryMode = false;
+    inflater.reset();
+    helloPending = true;
+    socket->write("HELLO BINARY DEFLATE\n");
 }
 
 void ChatWindow::onDisconnect() {
     currentUserLabel->setText("Disconnected");
     refreshTimer->stop();
     authContainer->setVisible(true);
+    inBuffer.clear();
+    pendingRequests.clear();
+    binaryMode = false;
+    inflater.reset();
+    helloPending = false;
+
+    if (!sessionToken.isEmpty()) {
+        // The server keeps the session for a while: come back and RESUME
+        currentUserLabel->setText("Reconnecting...");
+        statusBar()->showMessage("Connection lost, reconnecting...", 0);
+        scheduleReconnect();
+        return;
+    }
     statusBar()->showMessage("Disconnected from server.", 0);
 }
 
+void ChatWindow::scheduleReconnect() {
+    if (sessionToken.isEmpty() || serverAddress.isNull()) return;
+    QTimer::singleShot(2000, this, [this]() {
+        if (socket->state() == QAbstractSocket::UnconnectedState) socket->connectToHost(serverAddress, 9000);
+    });
+}
+
 void ChatWindow::sendRefreshRequests() {
-    if(socket->state() == QAbstractSocket::ConnectedState) {
-        socket->write("FEED\n");
-        socket->write("VIEW_FRIENDS\n");
-        socket->write("VIEW_REQUESTS\n");
-        socket->write("VIEW_GROUPS\n");
+    if(socket->state() != QAbstractSocket::ConnectedState) return;
+
+    // One round trip; the server only sends sections that changed
+    if (binaryMode) {
+        sendCommand(Protocol::OP_SYNC, syncStamps);
+        return;
     }
+    sendCommand(Protocol::OP_FEED);
+    sendCommand(Protocol::OP_VIEW_FRIENDS);
+    sendCommand(Protocol::OP_VIEW_REQUESTS);
+    sendCommand(Protocol::OP_VIEW_GROUPS);
 }
 
 void ChatWindow::onLoginClicked() {
     QString u = usernameInput->text();
     QString p = passwordInput->text();
     if(u.isEmpty() || p.isEmpty()) return;
-    socket->write(("LOGIN " + u + " " + p + "\n").toUtf8());
+    sendCommand(Protocol::OP_LOGIN, {u, p});
     currentUsername = u;
 }
 
 void ChatWindow::onLogoutClicked() {
     if(socket->isOpen()) {
-        socket->write("LOGOUT\n");
+        sendCommand(Protocol::OP_LOGOUT);
     }
 
     currentUsername = "";
+    sessionToken.clear();
+    lastPushSeq = 0;
     cachedFriends.clear();
     cachedGroups.clear();
+    onlineFriends.clear();
     friendsList->clear();
     friendRequestsList->clear();
     chatList->clear();
@@ -320,21 +372,21 @@ void ChatWindow::onLogoutClicked() {
     addMemberBtn->setVisible(false);
     refreshTimer->stop();
 
-    socket->write("FEED\n");
+    sendCommand(Protocol::OP_FEED);
 }
 
 void ChatWindow::onRegisterClicked() {
     QString u = usernameInput->text();
     QString p = passwordInput->text();
     if(u.isEmpty() || p.isEmpty()) return;
-    socket->write(("REGISTER " + u + " " + p + " 0\n").toUtf8());
+    sendCommand(Protocol::OP_REGISTER, {u, p, "0"});
 }
 
 void ChatWindow::onAddFriendClicked() {
     QString targetUser = addFriendInput->text().trimmed();
     if (targetUser.isEmpty()) return;
     QString type = (friendTypeSelector->currentIndex() == 1) ? "close" : "normal";
-    socket->write(("ADD_FRIEND " + targetUser + " " + type + "\n").toUtf8());
+    sendCommand(Protocol::OP_ADD_FRIEND, {targetUser, type});
     addFriendInput->clear();
 }
 
@@ -344,7 +396,7 @@ void ChatWindow::onCreateGroupClicked() {
         statusBar()->showMessage("Please enter a group name.", 3000);
         return;
     }
-    socket->write(("CREATE_GROUP " + gName + "\n").toUtf8());
+    sendCommand(Protocol::OP_CREATE_GROUP, {gName});
     createGroupInput->clear();
     statusBar()->showMessage("Request to create group sent...", 2000);
 }
@@ -358,7 +410,7 @@ void ChatWindow::onAddMemberClicked() {
                                          "", &ok);
     if (ok && !newMember.isEmpty()) {
         // ADD_TO_GROUP <groupID> <username>
-        socket->write(("ADD_TO_GROUP " + currentChatTarget + " " + newMember.trimmed() + "\n").toUtf8());
+        sendCommand(Protocol::OP_ADD_TO_GROUP, {currentChatTarget, newMember.trimmed()});
         statusBar()->showMessage("Added " + newMember + " to group.", 3000);
     }
 }
@@ -367,7 +419,7 @@ void ChatWindow::onAcceptRequestClicked(QListWidgetItem* item) {
     if (!item) return;
     QString reqText = item->text();
     QString username = reqText.split(" ")[0];
-    socket->write(("ACCEPT_REQUEST " + username + "\n").toUtf8());
+    sendCommand(Protocol::OP_ACCEPT_REQUEST, {username});
     statusBar()->showMessage("Accepting request from " + username + "...", 2000);
 }
 
@@ -378,9 +430,9 @@ void ChatWindow::onSendPostClicked() {
     if(visibilityInput->currentIndex() == 1) vis = "friends";
     if(visibilityInput->currentIndex() == 2) vis = "close";
 
-    socket->write(("POST " + vis + " " + txt + "\n").toUtf8());
+    sendCommand(Protocol::OP_POST, {vis, txt});
     newPostInput->clear();
-    socket->write("FEED\n");
+    sendCommand(Protocol::OP_FEED);
 }
 
 void ChatWindow::onFriendClicked(QListWidgetItem* item) {
@@ -388,7 +440,7 @@ void ChatWindow::onFriendClicked(QListWidgetItem* item) {
     mainStack->setCurrentIndex(0);
     QString target = item->text();
     if(target.contains(" (")) target = target.split(" (")[0];
-    socket->write(("VIEW_POSTS " + target + "\n").toUtf8());
+    sendCommand(Protocol::OP_VIEW_POSTS, {target});
     statusBar()->showMessage("Viewing posts for " + target, 3000);
 }
 
@@ -433,22 +485,178 @@ void ChatWindow::onSendMessageClicked() {
     if(txt.isEmpty() || currentChatTarget.isEmpty()) return;
 
     if (isGroupChat) {
-        socket->write(("GROUP_MSG " + currentChatTarget + " " + txt + "\n").toUtf8());
+        sendCommand(Protocol::OP_GROUP_MSG, {currentChatTarget, txt});
         messagesList->addItem("Me (Group): " + txt);
     } else {
-        socket->write(("MSG " + currentChatTarget + " " + txt + "\n").toUtf8());
+        sendCommand(Protocol::OP_MSG, {currentChatTarget, txt});
         messagesList->addItem("Me: " + txt);
     }
     messagesList->scrollToBottom();
     chatInput->clear();
 }
 
+void ChatWindow::sendCommand(Protocol::Opcode op, const QStringList& args) {
+    if (!binaryMode) {
+        QString line = Protocol::verbFor(op);
+        if (!args.isEmpty()) line += " " + args.join(" ");
+        socket->write((line + "\n").toUtf8());
+        return;
+    }
+
+    Protocol::Frame frame;
+    frame.type = Protocol::FRAME_REQUEST;
+    frame.opcode = op;
+    frame.id = nextRequestId++;
+    pendingRequests.insert(frame.id, op);
+    if (op == Protocol::OP_FEED || op == Protocol::OP_VIEW_POSTS) postsRequest = frame.id;
+    for (const QString& arg : args) frame.fields.push_back(Protocol::Field::text(arg.toStdString()));
+    std::string bytes = Protocol::encode(frame);
+    socket->write(bytes.data(), static_cast<qint64>(bytes.size()));
+}
+
 void ChatWindow::onReadyRead() {
-    QByteArray data = socket->readAll();
-    QString msg = QString::fromUtf8(data);
+    inBuffer += socket->readAll();
+
+    // The first line is the answer to HELLO and decides the protocol
+    if (helloPending) {
+        int nl = inBuffer.indexOf('\n');
+        if (nl < 0) return;
+        QString reply = QString::fromUtf8(inBuffer.left(nl)).trimmed();
+        inBuffer.remove(0, nl + 1);
+        helloPending = false;
+        binaryMode = reply.startsWith("200 HELLO BINARY");
+        if (reply == "200 HELLO BINARY DEFLATE") inflater.reset(new Compression::Inflater());
+        if (binaryMode && !sessionToken.isEmpty()) {
+            sendCommand(Protocol::OP_RESUME, {sessionToken, QString::number(lastPushSeq)});
+        } else {
+            sessionToken.clear();
+            sendCommand(Protocol::OP_FEED);
+        }
+    }
+
+    if (binaryMode) {
+        Protocol::Frame frame;
+        while (true) {
+            long used = Protocol::decode(inBuffer.constData(), static_cast<size_t>(inBuffer.size()), frame);
+            if (used == 0) break;
+            if (used < 0) {
+                statusBar()->showMessage("Protocol error, disconnecting.", 0);
+                socket->abort();
+                return;
+            }
+            inBuffer.remove(0, static_cast<int>(used));
+
+            if (frame.flags & Protocol::FLAG_COMPRESSED) {
+                std::string fields;
+                if (!inflater || !inflater->decompress(frame.body, fields) ||
+                    !Protocol::decodeFields(reinterpret_cast<const unsigned char*>(fields.data()), fields.size(), frame.fields)) {
+                    statusBar()->showMessage("Protocol error, disconnecting.", 0);
+                    socket->abort();
+                    return;
+                }
+            }
+            handleFrame(frame);
+        }
+        return;
+    }
+
+    // Text mode: only hand over complete lines
+    int last = inBuffer.lastIndexOf('\n');
+    if (last < 0) return;
+    QString msg = QString::fromUtf8(inBuffer.left(last + 1));
+    inBuffer.remove(0, last + 1);
     processServerMessage(msg);
 }
 
+// Responses are matched to their request by id, so list replies no longer
+// depend on banner lines or on arriving in send order. Everything else
+// (pushes, status lines) carries the same text as the line protocol and
+// goes through processServerMessage.
+void ChatWindow::handleFrame(const Protocol::Frame& frame) {
+    QStringList lines;
+    for (const auto& field : frame.fields) lines.append(QString::fromStdString(field.asString()));
+
+    // Pushes are numbered within the session; RESUME asks for the ones after this
+    if (frame.type == Protocol::FRAME_PUSH && frame.id > lastPushSeq) lastPushSeq = frame.id;
+
+    if (frame.type == Protocol::FRAME_RESPONSE) {
+        Protocol::Opcode op = pendingRequests.take(frame.id);
+        // A slow FEED must not overwrite the profile requested after it
+        if ((op == Protocol::OP_FEED || op == Protocol::OP_VIEW_POSTS) && frame.id != postsRequest) return;
+        if (op == Protocol::OP_RESUME && frame.status != 200) {
+            // Grace period over: start a new session the normal way
+            sessionToken.clear();
+            lastPushSeq = 0;
+            if (!currentUsername.isEmpty() && !passwordInput->text().isEmpty()) {
+                sendCommand(Protocol::OP_LOGIN, {currentUsername, passwordInput->text()});
+            } else {
+                currentUserLabel->setText("Connected as Guest");
+                statusBar()->showMessage("Session expired, please log in again.", 5000);
+                sendCommand(Protocol::OP_FEED);
+            }
+            return;
+        }
+        if (frame.status == 200) {
+            if (op == Protocol::OP_SYNC) { applySync(lines); return; }
+            if (showSection(op, lines)) return;
+        }
+    }
+    processServerMessage(lines.join('\n'));
+}
+
+// Fills the widget a list command feeds; false if op is not a list command
+bool ChatWindow::showSection(Protocol::Opcode op, const QStringList& items) {
+    switch (op) {
+        case Protocol::OP_FEED:
+        case Protocol::OP_VIEW_POSTS:
+            postsList->clear();
+            for (const QString& line : items) addPostItem(line);
+            if (items.isEmpty()) postsList->addItem("No posts to show.");
+            return true;
+        case Protocol::OP_VIEW_FRIENDS:
+            cachedFriends = items;
+            friendsList->clear();
+            friendsList->addItems(items);
+            applyPresence();
+            if (chatSelector->currentIndex() == 0) onChatTypeChanged(0);
+            return true;
+        case Protocol::OP_VIEW_REQUESTS:
+            friendRequestsList->clear();
+            friendRequestsList->addItems(items);
+            return true;
+        case Protocol::OP_VIEW_GROUPS:
+            cachedGroups = items;
+            if (chatSelector->currentIndex() == 1) onChatTypeChanged(1);
+            return true;
+        case Protocol::OP_SUGGEST_USERS:
+            userSuggestions->setStringList(items);
+            if (addFriendInput->hasFocus()) addFriendInput->completer()->complete();
+            return true;
+        default:
+            return false;
+    }
+}
+
+// "200 SYNC <stamps x4>", then "<NAME> <count>" + items for each changed section
+void ChatWindow::applySync(const QStringList& lines) {
+    if (lines.isEmpty()) return;
+    QStringList stamps = lines[0].split(' ', Qt::SkipEmptyParts).mid(2);
+    if (stamps.size() == 4) syncStamps = stamps;
+
+    int i = 1;
+    while (i < lines.size()) {
+        QString name = lines[i].section(' ', 0, 0);
+        int count = lines[i].section(' ', 1, 1).toInt();
+        QStringList items = lines.mid(i + 1, count);
+        i += 1 + count;
+
+        if (name == "FEED") showSection(Protocol::OP_FEED, items);
+        else if (name == "FRIENDS") showSection(Protocol::OP_VIEW_FRIENDS, items);
+        else if (name == "REQUESTS") showSection(Protocol::OP_VIEW_REQUESTS, items);
+        else if (name == "GROUPS") showSection(Protocol::OP_VIEW_GROUPS, items);
+    }
+}
+
 void ChatWindow::processServerMessage(QString msg) {
     QStringList lines = msg.split('\n');
     ParseState currentState = STATE_NONE;
@@ -457,6 +665,41 @@ void ChatWindow::processServerMessage(QString msg) {
         QString cleanLine = line.trimmed();
         if (cleanLine.isEmpty()) continue;
 
+        // Resumable session issued on LOGIN (pushes are numbered in binary mode only)
+        if (cleanLine.startsWith("SESSION ")) {
+            if (binaryMode) {
+                sessionToken = cleanLine.mid(8).trimmed();
+                lastPushSeq = 0;
+            }
+            continue;
+        }
+
+        // Server heartbeat
+        if (cleanLine == "PING") { sendCommand(Protocol::OP_PONG); continue; }
+        if (cleanLine == "PONG") continue;
+
+        // PRESENCE alice:online bob:offline (digest, friends only)
+        if (cleanLine.startsWith("PRESENCE ")) {
+            const QStringList entries = cleanLine.mid(9).split(' ', Qt::SkipEmptyParts);
+            for (const QString& entry : entries) {
+                QString name = entry.section(':', 0, 0);
+                if (entry.endsWith(":online")) {
+                    onlineFriends.insert(name);
+                    statusBar()->showMessage(name + " is online", 3000);
+                } else {
+                    onlineFriends.remove(name);
+                }
+            }
+            applyPresence();
+            continue;
+        }
+        if (cleanLine.startsWith("200 ONLINE")) {
+            const QStringList names = cleanLine.mid(10).split(' ', Qt::SkipEmptyParts);
+            onlineFriends = QSet<QString>(names.begin(), names.end());
+            applyPresence();
+            continue;
+        }
+
         if (cleanLine.startsWith("[")) {
             if (cleanLine.contains("[Private") || cleanLine.contains("[Group")) {
                 if (mainStack->currentIndex() == 1) {
@@ -477,14 +720,7 @@ void ChatWindow::processServerMessage(QString msg) {
         switch (currentState) {
             case STATE_FEED: {
                 if (cleanLine.startsWith("---")) break;
-                QListWidgetItem* item = new QListWidgetItem();
-                if(cleanLine.contains("[Public]")) item->setForeground(QColor("#00e676")); // Verde deschis
-                else if(cleanLine.contains("[Friends]")) item->setForeground(QColor("#40c4ff")); // Albastru deschis
-                else if(cleanLine.contains("[Close]")) item->setForeground(QColor("#ff4081")); // Roz/Rosu deschis
-                else item->setForeground(Qt::white);
-
-                item->setText(cleanLine);
-                postsList->addItem(item);
+                addPostItem(cleanLine);
                 break;
             }
             case STATE_FRIENDS: {
@@ -504,15 +740,19 @@ void ChatWindow::processServerMessage(QString msg) {
                 break;
             }
             case STATE_NONE: {
-                if (cleanLine.contains("200 OK: Welcome")) {
+                bool resumed = cleanLine.startsWith("200 OK: Resumed");
+                if (cleanLine.contains("200 OK: Welcome") || resumed) {
                     currentUserLabel->setText("User: " + currentUsername);
                     authContainer->setVisible(false);
                     logoutBtn->setVisible(true);
                     refreshTimer->start(3000);
                     QMainWindow::setWindowTitle(currentUsername);
 
+                    // A resumed session keeps its stamps, SYNC only sends what changed
+                    if (!resumed) syncStamps = QStringList{"0", "0", "0", "0"};
                     sendRefreshRequests();
-                    statusBar()->showMessage("Login successful!", 5000);
+                    sendCommand(Protocol::OP_WHO_IS_ONLINE);
+                    statusBar()->showMessage(resumed ? "Reconnected." : "Login successful!", 5000);
                 }
                 else if (cleanLine.contains("200") || cleanLine.contains("201")) {
                      statusBar()->showMessage(cleanLine, 4000);
@@ -525,6 +765,8 @@ void ChatWindow::processServerMessage(QString msg) {
         }
     }
 
+    applyPresence();
+
     if (chatSelector->currentIndex() == 0 && !cachedFriends.isEmpty()) {
         chatList->clear();
         chatList->addItems(cachedFriends);
@@ -532,4 +774,23 @@ void ChatWindow::processServerMessage(QString msg) {
         chatList->clear();
         chatList->addItems(cachedGroups);
     }
+}
+
+void ChatWindow::addPostItem(const QString& line) {
+    QListWidgetItem* item = new QListWidgetItem();
+    if(line.contains("[Public]")) item->setForeground(QColor("#00e676")); // Verde deschis
+    else if(line.contains("[Friends]")) item->setForeground(QColor("#40c4ff")); // Albastru deschis
+    else if(line.contains("[Close]")) item->setForeground(QColor("#ff4081")); // Roz/Rosu deschis
+    else item->setForeground(Qt::white);
+
+    item->setText(line);
+    postsList->addItem(item);
+}
+
+void ChatWindow::applyPresence() {
+    for (int i = 0; i < friendsList->count(); i++) {
+        QListWidgetItem* item = friendsList->item(i);
+        QString name = item->text().section(" (", 0, 0);
+        item->setForeground(onlineFriends.contains(name) ? QColor("#00e676") : QColor("#9e9e9e"));
+    }
 }
\ No newline at end of file
@@ -16,8 +16,16 @@
 #include <QTimer>
 #include <QStatusBar>
 #include <QInputDialog>
+#include <QCompleter>
+#include <QStringListModel>
 #include <QUdpSocket>
 #include <QNetworkDatagram>
+#include <QSet>
+#include <QByteArray>
+#include <QHash>
+#include <memory>
+#include "Protocol.h"
+#include "Compression.h"
 
 class ChatWindow : public QMainWindow {
     Q_OBJECT
@@ -55,6 +63,13 @@ private:
     void setupUI();
     void processServerMessage(QString message);
     void startDiscovery();
+    void applyPresence();
+    void addPostItem(const QString& line);
+    void sendCommand(Protocol::Opcode op, const QStringList& args = {});
+    void handleFrame(const Protocol::Frame& frame);
+    bool showSection(Protocol::Opcode op, const QStringList& items);
+    void applySync(const QStringList& lines);
+    void scheduleReconnect();
 
     // --- UI Elements ---
     QLabel *currentUserLabel;
@@ -70,6 +85,7 @@ private:
     QLineEdit *addFriendInput;
     QComboBox *friendTypeSelector;
     QPushButton *addFriendBtn;
+    QStringListModel *userSuggestions;                  // SUGGEST_USERS answers behind addFriendInput
 
     QComboBox *chatSelector;
     QListWidget *chatList;
@@ -93,8 +109,22 @@ private:
     QString currentUsername;
     QTimer *refreshTimer;
 
+    QByteArray inBuffer;
+    bool binaryMode = false;
+    bool helloPending = false;
+    quint32 nextRequestId = 1;
+    QHash<quint32, Protocol::Opcode> pendingRequests;   // request id -> command, for routing responses
+    quint32 postsRequest = 0;                           // latest FEED / VIEW_POSTS, older answers are stale
+    QStringList syncStamps{"0", "0", "0", "0"};         // feed, friends, requests, groups as of the last SYNC
+    std::unique_ptr<Compression::Inflater> inflater;    // set when the server agreed to DEFLATE
+
+    QHostAddress serverAddress;
+    QString sessionToken;                               // from LOGIN, lets a reconnect RESUME
+    quint32 lastPushSeq = 0;                            // highest push number seen in this session
+
     QStringList cachedFriends;
     QStringList cachedGroups;
+    QSet<QString> onlineFriends;
 
     QString currentChatTarget;
     bool isGroupChat;
@@ -0,0 +1,105 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+// Per-connection response compression, negotiated with
+// "HELLO BINARY DEFLATE" (plain C++17 + zlib, shared by both apps).
+//
+// The server keeps one raw deflate stream per connection and flushes it
+// after every compressed frame (Z_SYNC_FLUSH), so each frame can be
+// inflated as soon as it arrives while later frames still reuse the
+// history of earlier ones. Both sides prime the stream with the same
+// dictionary of strings our responses are full of.
+//
+// Compressed frames have FLAG_COMPRESSED set and carry the deflated field
+// bytes as their body; they must be inflated in arrival order.
+
+#include <string>
+#include <zlib.h>
+
+namespace Compression {
+
+// Later strings are cheaper to reference, so the most common go last
+inline const std::string& dictionary() {
+    static const std::string dict =
+        "404 User not found.\n400 Bad Request: 403 Forbidden\n"
+        "200 OK: Welcome 200 OK: Sent.\n201 Created.\n"
+        "--- News Feed ---\n--- Friends List ---\n--- Friend Requests ---\n"
+        " (Close Friend Request) (Close)[Group ] : [Private from ]: "
+        "[OFFLINE Private | [OFFLINE Group  | @ 20"
+        "200 SYNC FEED FRIENDS REQUESTS GROUPS "
+        "[Close]: [Friends]: [Public]: ";
+    return dict;
+}
+
+class Deflater {
+private:
+    // 8 KiB window, small hash table: about 48 KiB per connection
+    static constexpr int WINDOW_BITS = 13;
+    static constexpr int MEM_LEVEL = 5;
+
+    z_stream zs{};
+    bool ready = false;
+
+public:
+    Deflater() {
+        if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -WINDOW_BITS, MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK) return;
+        const std::string& dict = dictionary();
+        deflateSetDictionary(&zs, reinterpret_cast<const Bytef*>(dict.data()), static_cast<uInt>(dict.size()));
+        ready = true;
+    }
+    ~Deflater() { if (ready) deflateEnd(&zs); }
+    Deflater(const Deflater&) = delete;
+    Deflater& operator=(const Deflater&) = delete;
+
+    // Appends the compressed form of in to out. A failure leaves the
+    // stream unusable, the caller then stops compressing.
+    bool compress(const std::string& in, std::string& out) {
+        if (!ready) return false;
+        zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+        zs.avail_in = static_cast<uInt>(in.size());
+        char chunk[16384];
+        do {
+            zs.next_out = reinterpret_cast<Bytef*>(chunk);
+            zs.avail_out = sizeof(chunk);
+            if (deflate(&zs, Z_SYNC_FLUSH) == Z_STREAM_ERROR) { ready = false; return false; }
+            out.append(chunk, sizeof(chunk) - zs.avail_out);
+        } while (zs.avail_out == 0);
+        return true;
+    }
+};
+
+class Inflater {
+private:
+    z_stream zs{};
+    bool ready = false;
+
+public:
+    Inflater() {
+        if (inflateInit2(&zs, -15) != Z_OK) return;
+        const std::string& dict = dictionary();
+        inflateSetDictionary(&zs, reinterpret_cast<const Bytef*>(dict.data()), static_cast<uInt>(dict.size()));
+        ready = true;
+    }
+    ~Inflater() { if (ready) inflateEnd(&zs); }
+    Inflater(const Inflater&) = delete;
+    Inflater& operator=(const Inflater&) = delete;
+
+    bool decompress(const std::string& in, std::string& out) {
+        if (!ready) return false;
+        zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+        zs.avail_in = static_cast<uInt>(in.size());
+        char chunk[16384];
+        do {
+            zs.next_out = reinterpret_cast<Bytef*>(chunk);
+            zs.avail_out = sizeof(chunk);
+            int rc = inflate(&zs, Z_SYNC_FLUSH);
+            if (rc != Z_OK && rc != Z_BUF_ERROR) { ready = false; return false; }
+            out.append(chunk, sizeof(chunk) - zs.avail_out);
+        } while (zs.avail_out == 0);
+        return true;
+    }
+};
+
+} // namespace Compression
+
+#endif
@@ -0,0 +1,275 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+// Binary framing shared by ServerApp and ClientApp (plain C++17, no Qt).
+//
+// A connection starts in the line-based text protocol. Sending
+// "HELLO BINARY" and getting "200 HELLO BINARY" back switches both
+// directions to frames:
+//
+//   u32 length   bytes that follow this field
+//   u8  type     REQUEST / RESPONSE / PUSH
+//   u8  flags
+//   u16 opcode   command (requests, responses) or push kind
+//   u32 id       request id, echoed in the response
+//   u16 status   responses only (200, 404, ...), 0 otherwise
+//   fields...    u8 tag, then STRING: u32 length + bytes, INT: i64
+//
+// All integers are big-endian. Every request gets at most one response
+// frame, so responses can be matched by id instead of by banner text.
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace Protocol {
+
+enum FrameType : uint8_t {
+    FRAME_REQUEST = 1,
+    FRAME_RESPONSE = 2,
+    FRAME_PUSH = 3
+};
+
+enum FrameFlags : uint8_t {
+    FLAG_COMPRESSED = 0x01   // body is deflated (see Compression.h), server -> client only
+};
+
+enum Opcode : uint16_t {
+    OP_UNKNOWN = 0,
+    OP_HELLO = 1,
+    OP_PING = 2,
+    OP_PONG = 3,
+    OP_REGISTER = 10,
+    OP_LOGIN = 11,
+    OP_LOGOUT = 12,
+    OP_RESUME = 13,
+    OP_VIEW_POSTS = 20,
+    OP_FEED = 21,
+    OP_POST = 22,
+    OP_DELETE_POST = 23,
+    OP_SYNC = 24,
+    OP_SEARCH = 25,
+    OP_ADD_FRIEND = 30,
+    OP_VIEW_REQUESTS = 31,
+    OP_ACCEPT_REQUEST = 32,
+    OP_VIEW_FRIENDS = 33,
+    OP_WHO_IS_ONLINE = 34,
+    OP_SUGGEST_USERS = 35,
+    OP_SUGGEST_FRIENDS = 36,
+    OP_MSG = 40,
+    OP_CREATE_GROUP = 41,
+    OP_ADD_TO_GROUP = 42,
+    OP_GROUP_MSG = 43,
+    OP_VIEW_GROUPS = 44,
+    OP_UPLOAD = 45,
+    OP_UPLOAD_CHUNK = 46,      // INT upload id, raw bytes
+    OP_UPLOAD_END = 47,
+    OP_DOWNLOAD = 48,          // response: one field, the file's bytes
+    OP_HISTORY = 49,
+    OP_DELETE_USER = 50,
+    OP_STATS = 51,
+    OP_PROMOTE = 52,
+    OP_BACKUP = 53,
+
+    // Push kinds (server -> client, outside any request)
+    OP_PUSH_NOTICE = 100,
+    OP_PUSH_CHAT = 101,
+    OP_PUSH_PRESENCE = 102,
+
+    // Node-to-node pushes on cluster links (see Server/Cluster.h)
+    OP_NODE_SYNC = 200,        // usernames logged in on the sending node
+    OP_NODE_PRESENCE = 201,    // username, INT online
+    OP_NODE_CHAT = 202,        // sender, content, INT group id (-1 private), recipients...
+    OP_NODE_USER = 203,        // INT id, username, INT exists
+    OP_NODE_FRIENDSHIP = 204,  // INT user id, INT user id
+    OP_NODE_TOUCH = 205,       // INT user id, INT SyncSection (Feed: that user's posts)
+    OP_NODE_CHAT_ACK = 206,    // back on the link, one per OP_NODE_CHAT in order
+
+    // Primary -> standby replication stream (see Server/Replication.h)
+    OP_REPL_CHANGE = 210,      // INT seq, INT ChangeKind, the record's fields
+    OP_REPL_HEARTBEAT = 211    // INT primary's last seq
+};
+
+static const size_t HEADER_SIZE = 14;               // including the length field
+static const uint32_t MAX_FRAME_SIZE = 16u << 20;
+// Largest string a frame with only that field can carry (DOWNLOAD)
+static const size_t MAX_SINGLE_FIELD = MAX_FRAME_SIZE - (HEADER_SIZE - 4) - 5;
+
+struct OpcodeName {
+    uint16_t opcode;
+    const char* verb;
+};
+
+inline const std::vector<OpcodeName>& opcodeTable() {
+    static const std::vector<OpcodeName> table = {
+        {OP_HELLO, "HELLO"}, {OP_PING, "PING"}, {OP_PONG, "PONG"},
+        {OP_REGISTER, "REGISTER"}, {OP_LOGIN, "LOGIN"}, {OP_LOGOUT, "LOGOUT"}, {OP_RESUME, "RESUME"},
+        {OP_VIEW_POSTS, "VIEW_POSTS"}, {OP_FEED, "FEED"}, {OP_POST, "POST"}, {OP_DELETE_POST, "DELETE_POST"},
+        {OP_SYNC, "SYNC"}, {OP_SEARCH, "SEARCH"},
+        {OP_ADD_FRIEND, "ADD_FRIEND"}, {OP_VIEW_REQUESTS, "VIEW_REQUESTS"}, {OP_ACCEPT_REQUEST, "ACCEPT_REQUEST"},
+        {OP_VIEW_FRIENDS, "VIEW_FRIENDS"}, {OP_WHO_IS_ONLINE, "WHO_IS_ONLINE"},
+        {OP_SUGGEST_USERS, "SUGGEST_USERS"}, {OP_SUGGEST_FRIENDS, "SUGGEST_FRIENDS"},
+        {OP_MSG, "MSG"}, {OP_CREATE_GROUP, "CREATE_GROUP"}, {OP_ADD_TO_GROUP, "ADD_TO_GROUP"},
+        {OP_GROUP_MSG, "GROUP_MSG"}, {OP_VIEW_GROUPS, "VIEW_GROUPS"},
+        {OP_UPLOAD, "UPLOAD"}, {OP_UPLOAD_CHUNK, "UPLOAD_CHUNK"}, {OP_UPLOAD_END, "UPLOAD_END"}, {OP_DOWNLOAD, "DOWNLOAD"},
+        {OP_HISTORY, "HISTORY"},
+        {OP_DELETE_USER, "DELETE_USER"},
+        {OP_STATS, "STATS"}, {OP_PROMOTE, "PROMOTE"}, {OP_BACKUP, "BACKUP"},
+    };
+    return table;
+}
+
+inline const char* verbFor(uint16_t opcode) {
+    for (const auto& entry : opcodeTable()) {
+        if (entry.opcode == opcode) return entry.verb;
+    }
+    return "";
+}
+
+inline uint16_t opcodeFor(const std::string& verb) {
+    for (const auto& entry : opcodeTable()) {
+        if (verb == entry.verb) return entry.opcode;
+    }
+    return OP_UNKNOWN;
+}
+
+struct Field {
+    enum Type : uint8_t { STRING = 1, INT = 2 };
+    Type type = STRING;
+    std::string str;
+    int64_t num = 0;
+
+    static Field text(std::string value) { Field f; f.type = STRING; f.str = std::move(value); return f; }
+    static Field integer(int64_t value) { Field f; f.type = INT; f.num = value; return f; }
+
+    std::string asString() const { return type == STRING ? str : std::to_string(num); }
+};
+
+struct Frame {
+    uint8_t type = FRAME_REQUEST;
+    uint8_t flags = 0;
+    uint16_t opcode = OP_UNKNOWN;
+    uint32_t id = 0;
+    uint16_t status = 0;
+    std::vector<Field> fields;
+    std::string body;          // raw body of a compressed frame, fields stay empty
+};
+
+inline void putU16(std::string& out, uint16_t v) {
+    out += static_cast<char>(v >> 8);
+    out += static_cast<char>(v & 0xFF);
+}
+
+inline void putU32(std::string& out, uint32_t v) {
+    for (int shift = 24; shift >= 0; shift -= 8) out += static_cast<char>((v >> shift) & 0xFF);
+}
+
+inline uint16_t getU16(const unsigned char* p) { return static_cast<uint16_t>((p[0] << 8) | p[1]); }
+
+inline uint32_t getU32(const unsigned char* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+inline void appendHeader(std::string& out, uint32_t bodySize, uint8_t type, uint8_t flags,
+                         uint16_t opcode, uint32_t id, uint16_t status) {
+    putU32(out, static_cast<uint32_t>(HEADER_SIZE - 4 + bodySize));
+    out += static_cast<char>(type);
+    out += static_cast<char>(flags);
+    putU16(out, opcode);
+    putU32(out, id);
+    putU16(out, status);
+}
+
+inline void appendField(std::string& out, const Field& f) {
+    out += static_cast<char>(f.type);
+    if (f.type == Field::STRING) {
+        putU32(out, static_cast<uint32_t>(f.str.size()));
+        out += f.str;
+    } else {
+        uint64_t v = static_cast<uint64_t>(f.num);
+        putU32(out, static_cast<uint32_t>(v >> 32));
+        putU32(out, static_cast<uint32_t>(v & 0xFFFFFFFFu));
+    }
+}
+
+inline std::string encodeFields(const std::vector<Field>& fields) {
+    std::string body;
+    for (const auto& f : fields) appendField(body, f);
+    return body;
+}
+
+inline std::string encode(const Frame& frame) {
+    std::string body = encodeFields(frame.fields);
+    std::string out;
+    out.reserve(HEADER_SIZE + body.size());
+    appendHeader(out, static_cast<uint32_t>(body.size()), frame.type, frame.flags, frame.opcode, frame.id, frame.status);
+    out += body;
+    return out;
+}
+
+// Rewrites the id of an already encoded frame or prefix
+inline void setFrameId(std::string& frame, uint32_t id) {
+    for (int i = 0; i < 4; i++) frame[8 + i] = static_cast<char>((id >> (24 - 8 * i)) & 0xFF);
+}
+
+// Header for a frame whose only field is a string of textSize bytes that
+// is written separately (vectored send of a shared payload).
+inline std::string singleFieldPrefix(uint8_t type, uint16_t opcode, uint32_t id, uint16_t status, size_t textSize) {
+    std::string out;
+    out.reserve(HEADER_SIZE + 5);
+    appendHeader(out, static_cast<uint32_t>(textSize + 5), type, 0, opcode, id, status);
+    out += static_cast<char>(Field::STRING);
+    putU32(out, static_cast<uint32_t>(textSize));
+    return out;
+}
+
+inline bool decodeFields(const unsigned char* p, size_t len, std::vector<Field>& fields) {
+    size_t pos = 0;
+    while (pos < len) {
+        uint8_t tag = p[pos++];
+        if (tag == Field::STRING) {
+            if (len - pos < 4) return false;
+            uint32_t n = getU32(p + pos);
+            pos += 4;
+            if (len - pos < n) return false;
+            fields.push_back(Field::text(std::string(reinterpret_cast<const char*>(p + pos), n)));
+            pos += n;
+        } else if (tag == Field::INT) {
+            if (len - pos < 8) return false;
+            uint64_t v = (uint64_t(getU32(p + pos)) << 32) | getU32(p + pos + 4);
+            fields.push_back(Field::integer(static_cast<int64_t>(v)));
+            pos += 8;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Returns the number of bytes consumed, 0 if more data is needed,
+// -1 if the input is not a valid frame.
+inline long decode(const char* data, size_t len, Frame& out) {
+    if (len < 4) return 0;
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    uint32_t frameLen = getU32(p);
+    if (frameLen < HEADER_SIZE - 4 || frameLen > MAX_FRAME_SIZE) return -1;
+    if (len < 4 + static_cast<size_t>(frameLen)) return 0;
+
+    out = Frame();
+    out.type = p[4];
+    out.flags = p[5];
+    out.opcode = getU16(p + 6);
+    out.id = getU32(p + 8);
+    out.status = getU16(p + 12);
+    if (out.flags & FLAG_COMPRESSED) {
+        out.body.assign(data + HEADER_SIZE, frameLen - (HEADER_SIZE - 4));
+    } else if (!decodeFields(p + HEADER_SIZE, frameLen - (HEADER_SIZE - 4), out.fields)) {
+        return -1;
+    }
+    return static_cast<long>(4 + frameLen);
+}
+
+} // namespace Protocol
+
+#endif
@@ -0,0 +1,233 @@
+#ifndef BLOB_STORE_H
+#define BLOB_STORE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Logger.h"
+#include "Sha256.h"
+
+// Attachments (--blob-dir): files on local disk named by the SHA-256 of
+// their content, <dir>/<first two hex digits>/<hash>, so the same upload
+// is only stored once. They never go through SQLite.
+//
+// A client uploads in chunks (UPLOAD, UPLOAD_CHUNK..., UPLOAD_END) into
+// <dir>/tmp, hashing as the bytes arrive; the finished file is renamed to
+// its hash, or dropped if that blob already exists. Posts and messages
+// refer to a blob as [attachment:<hash>], and DOWNLOAD sends the file with
+// sendfile (see FileSlice in OutboundQueue.h).
+class BlobStore {
+public:
+    static constexpr size_t MAX_CHUNK = 1 << 20;   // decoded bytes per UPLOAD_CHUNK
+    // Each open upload holds a file descriptor and may grow to maxBytes
+    static constexpr size_t MAX_UPLOADS_PER_OWNER = 4;
+    static constexpr size_t MAX_UPLOADS = 64;
+
+    // begin() failures
+    static constexpr int TOO_LARGE = -1;
+    static constexpr int TOO_MANY = -2;
+    static constexpr int FAILED = -3;
+    static constexpr const char* REFERENCE = "[attachment:";
+
+private:
+    struct Upload {
+        int owner;   // connection fd
+        int fd;
+        std::string path;
+        size_t size;
+        size_t received;
+        Sha256 hash;
+    };
+
+    std::string dir;
+    size_t maxBytes;
+    std::unordered_map<int, Upload> uploads;
+    int nextUpload = 1;
+    uint64_t storedCount = 0;
+    uint64_t duplicateCount = 0;
+    uint64_t storedBytes = 0;
+
+    void discard(std::unordered_map<int, Upload>::iterator it) {
+        close(it->second.fd);
+        std::remove(it->second.path.c_str());
+        uploads.erase(it);
+    }
+
+public:
+    BlobStore(const std::string& dir, size_t maxBytes) : dir(dir), maxBytes(maxBytes) {}
+
+    ~BlobStore() {
+        while (!uploads.empty()) discard(uploads.begin());
+    }
+
+    // Creates the directories and clears uploads a previous run left behind
+    bool open() {
+        mkdir(dir.c_str(), 0755);
+        std::string tmp = dir + "/tmp";
+        mkdir(tmp.c_str(), 0755);
+        DIR* d = opendir(tmp.c_str());
+        if (!d) {
+            Logger::error("blob_store_open_failed", {{"dir", dir}});
+            return false;
+        }
+        while (struct dirent* entry = readdir(d)) {
+            if (entry->d_name[0] != '.') std::remove((tmp + "/" + entry->d_name).c_str());
+        }
+        closedir(d);
+        return true;
+    }
+
+    static bool validHash(const std::string& hash) {
+        if (hash.size() != 64) return false;
+        for (char c : hash) {
+            if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) return false;
+        }
+        return true;
+    }
+
+    std::string pathOf(const std::string& hash) const { return dir + "/" + hash.substr(0, 2) + "/" + hash; }
+
+    // Size of a stored blob, -1 if there is none
+    long long sizeOf(const std::string& hash) const {
+        struct stat st;
+        if (!validHash(hash) || stat(pathOf(hash).c_str(), &st) != 0) return -1;
+        return static_cast<long long>(st.st_size);
+    }
+
+    // Hashes referenced as [attachment:<hash>] in a post or message
+    static std::vector<std::string> references(const std::string& content) {
+        std::vector<std::string> hashes;
+        size_t prefix = std::char_traits<char>::length(REFERENCE);
+        for (size_t pos = content.find(REFERENCE); pos != std::string::npos; pos = content.find(REFERENCE, pos + 1)) {
+            size_t end = content.find(']', pos);
+            if (end == std::string::npos) break;
+            hashes.push_back(content.substr(pos + prefix, end - pos - prefix));
+        }
+        return hashes;
+    }
+
+    // Text clients send chunks base64-encoded
+    static bool decodeBase64(const std::string& in, std::string& out) {
+        out.clear();
+        uint32_t bits = 0;
+        int count = 0;
+        for (char c : in) {
+            int v;
+            if (c >= 'A' && c <= 'Z') v = c - 'A';
+            else if (c >= 'a' && c <= 'z') v = c - 'a' + 26;
+            else if (c >= '0' && c <= '9') v = c - '0' + 52;
+            else if (c == '+') v = 62;
+            else if (c == '/') v = 63;
+            else if (c == '=') break;
+            else return false;
+            bits = (bits << 6) | static_cast<uint32_t>(v);
+            count += 6;
+            if (count >= 8) {
+                count -= 8;
+                out += static_cast<char>((bits >> count) & 0xFF);
+            }
+        }
+        return true;
+    }
+
+    // Upload id; TOO_LARGE, TOO_MANY (the owner's or the server's uploads
+    // are at the limit) or FAILED (the file can't be created)
+    int begin(int owner, size_t size) {
+        if (size == 0 || size > maxBytes) return TOO_LARGE;
+        size_t owned = 0;
+        for (const auto& entry : uploads) owned += entry.second.owner == owner ? 1 : 0;
+        if (owned >= MAX_UPLOADS_PER_OWNER || uploads.size() >= MAX_UPLOADS) return TOO_MANY;
+        int id = nextUpload++;
+        std::string path = dir + "/tmp/" + std::to_string(id);
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            Logger::error("blob_create_failed", {{"path", path}});
+            return FAILED;
+        }
+        uploads.emplace(id, Upload{owner, fd, path, size, 0, Sha256()});
+        return id;
+    }
+
+    // Bytes received so far, -1 for an unknown upload, one that is not the
+    // owner's, data past the announced size or a write error (the upload
+    // is then dropped)
+    long long append(int owner, int id, const std::string& data) {
+        auto it = uploads.find(id);
+        if (it == uploads.end() || it->second.owner != owner) return -1;
+        Upload& upload = it->second;
+        if (upload.received + data.size() > upload.size) {
+            discard(it);
+            return -1;
+        }
+        size_t done = 0;
+        while (done < data.size()) {
+            ssize_t n = ::write(upload.fd, data.data() + done, data.size() - done);
+            if (n <= 0) {
+                Logger::error("blob_write_failed", {{"path", upload.path}});
+                discard(it);
+                return -1;
+            }
+            done += static_cast<size_t>(n);
+        }
+        upload.hash.update(data.data(), data.size());
+        upload.received += data.size();
+        return static_cast<long long>(upload.received);
+    }
+
+    // Hash of the stored blob, "" if the upload is unknown, not the
+    // owner's or incomplete
+    std::string finish(int owner, int id) {
+        auto it = uploads.find(id);
+        if (it == uploads.end() || it->second.owner != owner) return "";
+        Upload& upload = it->second;
+        if (upload.received != upload.size) return "";
+
+        std::string hash = upload.hash.hex();
+        std::string target = pathOf(hash);
+        bool ok = fdatasync(upload.fd) == 0;
+        close(upload.fd);
+        upload.fd = -1;
+        struct stat st;
+        if (ok && stat(target.c_str(), &st) == 0) {
+            duplicateCount++;
+            std::remove(upload.path.c_str());
+        } else if (ok) {
+            mkdir((dir + "/" + hash.substr(0, 2)).c_str(), 0755);
+            ok = std::rename(upload.path.c_str(), target.c_str()) == 0;
+            if (ok) {
+                storedCount++;
+                storedBytes += upload.size;
+            }
+        }
+        if (!ok) {
+            Logger::error("blob_store_failed", {{"path", target}});
+            std::remove(upload.path.c_str());
+            hash.clear();
+        }
+        uploads.erase(it);
+        return hash;
+    }
+
+    // The connection is gone: its unfinished uploads go too
+    void abort(int owner) {
+        for (auto it = uploads.begin(); it != uploads.end();) {
+            auto next = std::next(it);
+            if (it->second.owner == owner) discard(it);
+            it = next;
+        }
+    }
+
+    uint64_t stored() const { return storedCount; }
+    uint64_t duplicates() const { return duplicateCount; }
+    uint64_t bytes() const { return storedBytes; }
+    uint64_t inProgress() const { return uploads.size(); }
+};
+
+#endif
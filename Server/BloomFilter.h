@@ -0,0 +1,69 @@
+#ifndef BLOOM_FILTER_H
+#define BLOOM_FILTER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Set membership with no false negatives: mightContain() is false only for
+// strings that were never added. About 10 bits per expected entry and 7
+// probes give roughly 1% false positives. Entries cannot be removed; the
+// owner rebuilds the filter once enough of them are stale.
+class BloomFilter {
+private:
+    static constexpr int PROBES = 7;
+    static constexpr size_t BITS_PER_ENTRY = 10;
+    static constexpr size_t MIN_BITS = 1 << 16;
+
+    std::vector<uint64_t> words;
+    uint64_t bitCount;
+    size_t capacity;   // entries it was sized for
+
+    // FNV-1a, then split into two halves for double hashing
+    static uint64_t hash(const std::string& s) {
+        uint64_t h = 1469598103934665603ULL;
+        for (unsigned char c : s) {
+            h ^= c;
+            h *= 1099511628211ULL;
+        }
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+public:
+    explicit BloomFilter(size_t expectedEntries = 0) { reset(expectedEntries); }
+
+    void reset(size_t expectedEntries) {
+        capacity = expectedEntries;
+        bitCount = expectedEntries * BITS_PER_ENTRY;
+        if (bitCount < MIN_BITS) bitCount = MIN_BITS;
+        bitCount = (bitCount + 63) & ~uint64_t(63);
+        words.assign(bitCount / 64, 0);
+        if (capacity < MIN_BITS / BITS_PER_ENTRY) capacity = MIN_BITS / BITS_PER_ENTRY;
+    }
+
+    void add(const std::string& s) {
+        uint64_t h = hash(s);
+        uint64_t step = (h >> 32) | 1;
+        for (int i = 0; i < PROBES; i++) {
+            uint64_t bit = (h + i * step) % bitCount;
+            words[bit / 64] |= uint64_t(1) << (bit % 64);
+        }
+    }
+
+    bool mightContain(const std::string& s) const {
+        uint64_t h = hash(s);
+        uint64_t step = (h >> 32) | 1;
+        for (int i = 0; i < PROBES; i++) {
+            uint64_t bit = (h + i * step) % bitCount;
+            if (!(words[bit / 64] & (uint64_t(1) << (bit % 64)))) return false;
+        }
+        return true;
+    }
+
+    size_t sizedFor() const { return capacity; }
+};
+
+#endif
@@ -2,15 +2,47 @@
 #define CLIENT_H
 
 #include <string>
+#include <cstdint>
+#include <memory>
 #include <netinet/in.h>
+#include "TimerWheel.h"
+#include "OutboundQueue.h"
+#include "Protocol.h"
+#include "Compression.h"
 
 class Client {
 public:
     int fd;
+    uint64_t serial = 0;           // tells a reused fd apart from the connection that owned it
     std::string username;
     bool isAuthenticated;
+    std::string sessionToken;      // resumable session, empty if none (see SessionStore)
+    int peerNode = 0;              // another cluster node's link to us (see Cluster), 0 for users
+    bool viaPeerPort = false;      // accepted on --peer-port: nothing but HELLO NODE is taken
     struct sockaddr_in address;
 
+    // Liveness tracking (see Server::checkIdle)
+    int64_t lastActivity = 0;
+    bool pingSent = false;
+    TimerWheel::TimerId idleTimer = TimerWheel::INVALID_TIMER;
+    TimerWheel::TimerId loginTimer = TimerWheel::INVALID_TIMER;
+
+    // Send queue and backpressure state (see Server::enqueue)
+    OutboundQueue out;
+    uint32_t epollEvents = 0;
+    bool readPaused = false;
+    bool closing = false;
+
+    // Input not yet parsed and the negotiated wire format
+    std::string inBuffer;
+    bool binary = false;
+    bool collecting = false;       // a binary or tagged request is being handled
+    Protocol::Frame response;      // its single response frame
+    std::string responseTag;       // text tag to echo, empty for binary
+    bool responseDeferred = false; // answered later by the query worker
+    bool compress = false;         // negotiated HELLO BINARY DEFLATE
+    std::unique_ptr<Compression::Deflater> deflater;  // created with the first big response
+
     Client(int socket_fd, struct sockaddr_in addr) : fd(socket_fd), username(""), isAuthenticated(false), address(addr) {}
 
     void setUsername(const std::string& name) {
@@ -0,0 +1,456 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "Config.h"
+#include "Logger.h"
+#include "OutboundQueue.h"
+#include "Protocol.h"
+#include "TimerWheel.h"
+
+// Cluster mode (--node-id=N --peers=id@host:port,...): several ServerApp
+// processes on one shared database, each user connected to any of them.
+//
+// Every node keeps one outbound link to each peer: a connection to the
+// peer's --peer-port that opens with "HELLO NODE <id>" and then carries
+// OP_NODE_* push frames one way. Frames are appended to the link buffer
+// and written once per event loop pass, so forwards are pipelined instead
+// of waiting for each other. The peer answers every OP_NODE_CHAT with an
+// OP_NODE_CHAT_ACK on the same connection once the message is queued for
+// its recipients or stored for them; anything else it sends back (its
+// HELLO answer, heartbeats) is ignored. Until its ack arrives a forwarded
+// message is kept, and if the link resets or the ack is overdue it is
+// handed back to be stored offline. A message can therefore arrive twice
+// (an ack lost with the link) but is not lost.
+//
+// The presence directory says which peers a user is logged in on. It is
+// built from what the peers send over their links to us: the full list of
+// their users when a link opens, then every first login and last logout.
+// A peer's entries are forgotten when its link to us closes.
+class Cluster {
+private:
+    static constexpr int64_t RETRY_MS = 1000;
+    static constexpr int64_t HEARTBEAT_MS = 10000;   // well under the peers' --idle-timeout
+    static constexpr size_t MAX_BACKLOG = 64 << 20;  // unsent bytes before a link is reset
+    static constexpr int64_t ACK_TIMEOUT_MS = 30000;  // oldest unacked forward before a link is reset
+
+    // A forwarded chat frame the peer has not acked yet
+    struct Forward {
+        int64_t queuedAt;
+        std::vector<OfflineCopy> copies;
+    };
+
+    struct Link {
+        PeerNode peer;
+        struct sockaddr_in address;
+        int fd = -1;
+        bool connected = false;
+        std::string out;
+        size_t sent = 0;              // bytes of out already written
+        uint32_t epollEvents = 0;
+        int64_t nextAttempt = 0;
+        int64_t lastWrite = 0;
+        std::string in;               // from the peer, not yet parsed
+        bool answered = false;        // its HELLO answer line is past
+        std::deque<Forward> inFlight;   // in the order the acks come back
+    };
+
+    int nodeId;
+    int epollFd = -1;
+    std::vector<Link> links;
+    std::function<std::vector<std::string>()> localUsers;
+    std::function<void(const OfflineCopy&)> undelivered;
+
+    // username -> peers it is logged in on; peer -> its inbound connection
+    std::unordered_map<std::string, std::vector<int>> directory;
+    std::unordered_map<int, int> inbound;
+
+    uint64_t forwards = 0;
+    uint64_t resets = 0;
+
+    Link* linkTo(int node) {
+        for (auto& link : links) {
+            if (link.peer.id == node) return &link;
+        }
+        return nullptr;
+    }
+
+    static bool resolve(const std::string& host, int port, struct sockaddr_in& address) {
+        struct addrinfo hints, *result = nullptr;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(host.c_str(), nullptr, &hints, &result) != 0 || !result) return false;
+        address = *reinterpret_cast<struct sockaddr_in*>(result->ai_addr);
+        address.sin_port = htons(port);
+        freeaddrinfo(result);
+        return true;
+    }
+
+    void watch(Link& link, uint32_t wanted) {
+        if (wanted == link.epollEvents) return;
+        struct epoll_event event;
+        event.events = wanted;
+        event.data.fd = link.fd;
+        epoll_ctl(epollFd, link.epollEvents == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, link.fd, &event);
+        link.epollEvents = wanted;
+    }
+
+    void connectLink(Link& link, int64_t now) {
+        link.nextAttempt = now + RETRY_MS;
+        link.fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (link.fd < 0) return;
+        fcntl(link.fd, F_SETFL, fcntl(link.fd, F_GETFL, 0) | O_NONBLOCK);
+        int one = 1;
+        setsockopt(link.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (connect(link.fd, reinterpret_cast<struct sockaddr*>(&link.address), sizeof(link.address)) < 0 &&
+            errno != EINPROGRESS) {
+            close(link.fd);
+            link.fd = -1;
+            return;
+        }
+        watch(link, EPOLLIN | EPOLLOUT);   // writable once the connect is done
+    }
+
+    void onConnected(Link& link, int64_t now) {
+        link.connected = true;
+        link.lastWrite = now;
+        link.out = "HELLO NODE " + std::to_string(nodeId) + "\n";
+        Protocol::Frame sync = frame(Protocol::OP_NODE_SYNC);
+        for (auto& name : localUsers()) sync.fields.push_back(Protocol::Field::text(std::move(name)));
+        link.out += Protocol::encode(sync);
+        link.in.clear();
+        link.answered = false;
+        Logger::info("cluster_link_up", {{"peer", std::to_string(link.peer.id)}});
+    }
+
+    void resetLink(Link& link, const char* reason) {
+        if (link.fd < 0) return;
+        if (link.connected) {
+            resets++;
+            Logger::warn("cluster_link_down", {{"peer", std::to_string(link.peer.id)}, {"reason", reason},
+                                               {"unsent_bytes", std::to_string(link.out.size() - link.sent)},
+                                               {"unacked_forwards", std::to_string(link.inFlight.size())}});
+        }
+        std::deque<Forward> lost;
+        lost.swap(link.inFlight);
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, link.fd, nullptr);
+        close(link.fd);
+        link.fd = -1;
+        link.connected = false;
+        link.out.clear();
+        link.sent = 0;
+        link.epollEvents = 0;
+        for (const Forward& forward : lost) {
+            for (const OfflineCopy& copy : forward.copies) undelivered(copy);
+        }
+    }
+
+    void writeLink(Link& link) {
+        while (link.sent < link.out.size()) {
+            ssize_t n = send(link.fd, link.out.data() + link.sent, link.out.size() - link.sent, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                resetLink(link, "write_error");
+                return;
+            }
+            link.sent += n;
+        }
+        if (link.sent == link.out.size()) {
+            link.out.clear();
+            link.sent = 0;
+        } else if (link.sent > (1 << 16)) {
+            link.out.erase(0, link.sent);
+            link.sent = 0;
+        }
+        watch(link, link.out.empty() ? EPOLLIN : EPOLLIN | EPOLLOUT);
+    }
+
+    static Protocol::Frame frame(uint16_t opcode) {
+        Protocol::Frame f;
+        f.type = Protocol::FRAME_PUSH;
+        f.opcode = opcode;
+        return f;
+    }
+
+    bool queue(Link& link, const Protocol::Frame& f) {
+        if (!link.connected) return false;
+        link.out += Protocol::encode(f);
+        if (link.out.size() - link.sent > MAX_BACKLOG) {
+            resetLink(link, "backlog");
+            return false;
+        }
+        return true;
+    }
+
+    // The peer's answers: the HELLO line, then frames. Returns false if
+    // the link was reset over a malformed frame.
+    bool readAnswers(Link& link) {
+        size_t pos = 0;
+        if (!link.answered) {
+            size_t eol = link.in.find('\n');
+            if (eol == std::string::npos) return true;
+            link.answered = true;
+            pos = eol + 1;
+        }
+        Protocol::Frame f;
+        long used;
+        while ((used = Protocol::decode(link.in.data() + pos, link.in.size() - pos, f)) > 0) {
+            pos += used;
+            if (f.opcode == Protocol::OP_NODE_CHAT_ACK && !link.inFlight.empty()) link.inFlight.pop_front();
+        }
+        if (used < 0) {
+            resetLink(link, "bad_frame");
+            return false;
+        }
+        link.in.erase(0, pos);
+        return true;
+    }
+
+    void sendAll(const Protocol::Frame& f) {
+        for (auto& link : links) queue(link, f);
+    }
+
+public:
+    explicit Cluster(const ServerConfig& config) : nodeId(config.nodeId) {
+        for (const auto& peer : config.peers) {
+            Link link;
+            link.peer = peer;
+            if (!resolve(peer.host, peer.port, link.address)) {
+                Logger::error("cluster_peer_unresolved", {{"peer", std::to_string(peer.id)}, {"host", peer.host}});
+                continue;
+            }
+            links.push_back(link);
+        }
+    }
+
+    ~Cluster() {
+        for (auto& link : links) {
+            if (link.fd >= 0) close(link.fd);
+        }
+    }
+
+    bool enabled() const { return nodeId > 0; }
+    int id() const { return nodeId; }
+    bool isPeer(int node) const {
+        for (const auto& link : links) {
+            if (link.peer.id == node) return true;
+        }
+        return false;
+    }
+
+    // users() lists the usernames logged in here, for new links; spill()
+    // stores a forwarded message the peer never got
+    void start(int epoll, std::function<std::vector<std::string>()> users, std::function<void(const OfflineCopy&)> spill) {
+        epollFd = epoll;
+        localUsers = std::move(users);
+        undelivered = std::move(spill);
+        int64_t now = TimerWheel::monotonicMs();
+        for (auto& link : links) connectLink(link, now);
+    }
+
+    bool owns(int fd) const {
+        for (const auto& link : links) {
+            if (link.fd == fd) return true;
+        }
+        return false;
+    }
+
+    void handleEvent(int fd, uint32_t events) {
+        Link* link = nullptr;
+        for (auto& l : links) {
+            if (l.fd == fd) link = &l;
+        }
+        if (!link) return;
+        int64_t now = TimerWheel::monotonicMs();
+
+        if (!link->connected) {
+            int error = 0;
+            socklen_t len = sizeof(error);
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len);
+            if (error != 0 || (events & (EPOLLERR | EPOLLHUP))) {
+                resetLink(*link, "connect_failed");
+                return;
+            }
+            onConnected(*link, now);
+        }
+        if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+            char buffer[4096];
+            ssize_t n;
+            while ((n = read(fd, buffer, sizeof(buffer))) > 0) link->in.append(buffer, n);
+            if (!readAnswers(*link)) return;
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                resetLink(*link, "closed");
+                return;
+            }
+        }
+        writeLink(*link);
+        if (link->fd >= 0) link->lastWrite = now;
+    }
+
+    // Once a second: reconnect broken links, keep idle ones alive, give up
+    // on a peer that stopped acking
+    void tick() {
+        int64_t now = TimerWheel::monotonicMs();
+        for (auto& link : links) {
+            if (link.connected && !link.inFlight.empty() && now - link.inFlight.front().queuedAt >= ACK_TIMEOUT_MS) {
+                resetLink(link, "ack_timeout");
+            }
+            if (link.fd < 0 && now >= link.nextAttempt) {
+                connectLink(link, now);
+            } else if (link.connected && link.out.empty() && now - link.lastWrite >= HEARTBEAT_MS) {
+                queue(link, frame(Protocol::OP_PING));
+            }
+        }
+    }
+
+    // Writes what the last event loop pass queued, one send per link
+    void flush() {
+        int64_t now = TimerWheel::monotonicMs();
+        for (auto& link : links) {
+            if (!link.connected || link.sent == link.out.size()) continue;
+            writeLink(link);
+            link.lastWrite = now;
+        }
+    }
+
+    // --- Outgoing ---
+
+    void announcePresence(const std::string& username, bool online) {
+        Protocol::Frame f = frame(Protocol::OP_NODE_PRESENCE);
+        f.fields.push_back(Protocol::Field::text(username));
+        f.fields.push_back(Protocol::Field::integer(online ? 1 : 0));
+        sendAll(f);
+    }
+
+    // A user registered (exists) or was deleted on this node
+    void announceUser(int userId, const std::string& username, bool exists) {
+        Protocol::Frame f = frame(Protocol::OP_NODE_USER);
+        f.fields.push_back(Protocol::Field::integer(userId));
+        f.fields.push_back(Protocol::Field::text(username));
+        f.fields.push_back(Protocol::Field::integer(exists ? 1 : 0));
+        sendAll(f);
+    }
+
+    void announceFriendship(int a, int b) {
+        Protocol::Frame f = frame(Protocol::OP_NODE_FRIENDSHIP);
+        f.fields.push_back(Protocol::Field::integer(a));
+        f.fields.push_back(Protocol::Field::integer(b));
+        sendAll(f);
+    }
+
+    // A SYNC section changed; the peers bump their stamps too
+    void announceTouch(int userId, int section) {
+        Protocol::Frame f = frame(Protocol::OP_NODE_TOUCH);
+        f.fields.push_back(Protocol::Field::integer(userId));
+        f.fields.push_back(Protocol::Field::integer(section));
+        sendAll(f);
+    }
+
+    // Hands a chat message to the node its recipients are logged in on;
+    // false if the link is down (the caller stores it offline instead).
+    // If the link goes down before the peer acks it, spill() gets it.
+    bool forwardChat(int node, const std::shared_ptr<const ChatOrigin>& origin, const std::vector<std::string>& recipients) {
+        Link* link = linkTo(node);
+        if (!link) return false;
+        Protocol::Frame f = frame(Protocol::OP_NODE_CHAT);
+        f.fields.push_back(Protocol::Field::text(origin->sender));
+        f.fields.push_back(Protocol::Field::text(origin->content));
+        f.fields.push_back(Protocol::Field::integer(origin->isGroup ? origin->groupId : -1));
+        for (const auto& name : recipients) f.fields.push_back(Protocol::Field::text(name));
+        if (!queue(*link, f)) return false;
+        Forward forward{TimerWheel::monotonicMs(), {}};
+        for (const auto& name : recipients) forward.copies.push_back(OfflineCopy{name, origin});
+        link->inFlight.push_back(std::move(forward));
+        forwards++;
+        return true;
+    }
+
+    // --- Presence directory ---
+
+    // Peer a user can be reached on, -1 if none is (or its link is down)
+    int nodeOf(const std::string& username) {
+        auto it = directory.find(username);
+        if (it == directory.end()) return -1;
+        for (int node : it->second) {
+            Link* link = linkTo(node);
+            if (link && link->connected) return node;
+        }
+        return -1;
+    }
+
+    bool isOnlineElsewhere(const std::string& username) const { return directory.count(username) > 0; }
+
+    // Returns true if the user was not known to be on any peer before
+    bool setOnline(int node, const std::string& username) {
+        std::vector<int>& nodes = directory[username];
+        for (int n : nodes) {
+            if (n == node) return false;
+        }
+        nodes.push_back(node);
+        return nodes.size() == 1;
+    }
+
+    // Returns true if the user is not on any peer any more
+    bool setOffline(int node, const std::string& username) {
+        auto it = directory.find(username);
+        if (it == directory.end()) return false;
+        std::vector<int>& nodes = it->second;
+        for (size_t i = 0; i < nodes.size(); i++) {
+            if (nodes[i] == node) { nodes.erase(nodes.begin() + i); break; }
+        }
+        if (!nodes.empty()) return false;
+        directory.erase(it);
+        return true;
+    }
+
+    // Drops everything known about a peer's users; returns the users no
+    // peer has any more
+    std::vector<std::string> forgetNode(int node) {
+        std::vector<std::string> names, gone;
+        for (const auto& entry : directory) names.push_back(entry.first);
+        for (const auto& name : names) {
+            if (setOffline(node, name)) gone.push_back(name);
+        }
+        return gone;
+    }
+
+    // A peer's link to us opened on fd; a newer one replaces an older one
+    void attachInbound(int node, int fd) { inbound[node] = fd; }
+
+    // The link closed. A stale connection closing late changes nothing.
+    std::vector<std::string> detachInbound(int node, int fd) {
+        auto it = inbound.find(node);
+        if (it == inbound.end() || it->second != fd) return {};
+        inbound.erase(it);
+        return forgetNode(node);
+    }
+
+    uint64_t forwarded() const { return forwards; }
+    uint64_t linkResets() const { return resets; }
+    uint64_t linksUp() const {
+        uint64_t up = 0;
+        for (const auto& link : links) up += link.connected ? 1 : 0;
+        return up;
+    }
+    uint64_t remoteUsers() const { return directory.size(); }
+};
+
+#endif
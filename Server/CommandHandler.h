@@ -1,34 +1,178 @@
 #ifndef COMMAND_HANDLER_H
 #define COMMAND_HANDLER_H
 
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
 #include <string>
-#include <sstream>
-#include <iostream>
 #include "Server.h"
+#include "Request.h"
+#include "Logger.h"
 
 class CommandHandler {
+private:
+    // SEARCH: results per page, and ranked matches looked at per request
+    static constexpr int SEARCH_PAGE = 20;
+    static constexpr int SEARCH_SCAN = 200;
+    static constexpr int POSTS_PAGE = 20;
+    static constexpr int HISTORY_PAGE = 50;
+    static constexpr int HISTORY_MAX = 200;
+    // SUGGEST_USERS: default / largest answer
+    static constexpr int SUGGEST_DEFAULT = 10;
+    static constexpr int SUGGEST_MAX = 50;
+
+    // Refused by a standby until it is promoted
+    static bool isWrite(const std::string& command) {
+        static const char* writes[] = {"REGISTER", "POST", "DELETE_POST", "ADD_FRIEND", "ACCEPT_REQUEST", "MSG",
+                                       "CREATE_GROUP", "ADD_TO_GROUP", "GROUP_MSG", "DELETE_USER",
+                                       "UPLOAD", "UPLOAD_CHUNK", "UPLOAD_END"};
+        for (const char* w : writes) {
+            if (command == w) return true;
+        }
+        return false;
+    }
+
+    // BACKUP takes a file name inside --backup-dir, never a path
+    static bool validBackupName(const std::string& name) {
+        if (name.empty() || name[0] == '.' || name.size() > 128) return false;
+        for (unsigned char c : name) {
+            if (!std::isalnum(c) && c != '.' && c != '-' && c != '_') return false;
+        }
+        return true;
+    }
+
+    // Usernames end up in text lines (presence, MSG <user>, logs), so
+    // no whitespace or control characters, whichever protocol sent them
+    static bool validUsername(const std::string& name) {
+        if (name.empty()) return false;
+        for (unsigned char c : name) {
+            if (c <= ' ' || c == 0x7f) return false;
+        }
+        return true;
+    }
+
+    // A binary field may hold line breaks; text clients would take each
+    // line for a message or response of its own
+    static std::string singleLine(std::string text) {
+        for (char& c : text) {
+            if (c == '\n' || c == '\r') c = ' ';
+        }
+        return text;
+    }
+
+    // Every [attachment:<hash>] in content has to name a stored blob;
+    // otherwise the client is told and the command goes no further
+    static bool checkAttachments(const std::string& content, Client& client, Server& server) {
+        BlobStore* blobs = server.getBlobs();
+        for (const std::string& hash : BlobStore::references(content)) {
+            if (!blobs || blobs->sizeOf(hash) < 0) {
+                server.sendMessage(client.fd, "404 Attachment not found: " + hash + "\n");
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Answered from the replicated tables, so subject to --max-staleness
+    static bool readsReplica(const std::string& command) {
+        static const char* reads[] = {"VIEW_POSTS", "FEED", "SEARCH", "SYNC", "VIEW_FRIENDS", "VIEW_REQUESTS", "VIEW_GROUPS",
+                                      "HISTORY"};
+        for (const char* r : reads) {
+            if (command == r) return true;
+        }
+        return false;
+    }
+
 public:
-    static void handleCommand(std::string raw_command, Client& client, Server& server) {
-        if (!raw_command.empty() && raw_command.back() == '\n') raw_command.pop_back();
-        if (!raw_command.empty() && raw_command.back() == '\r') raw_command.pop_back();
+    static void handleCommand(Request& req, Client& client, Server& server) {
+        const std::string& command = req.verb;
 
-        std::stringstream ss(raw_command);
-        std::string command;
-        ss >> command;
+        if (server.isStandby()) {
+            if (isWrite(command)) {
+                server.sendMessage(client.fd, "503 Read-only: this server is a standby.\n");
+                return;
+            }
+            if (readsReplica(command) && server.standbyTooStale()) {
+                server.sendMessage(client.fd, "503 Standby is behind the primary, try again later.\n");
+                return;
+            }
+        }
+
+        // The peer port only takes node links
+        if (client.viaPeerPort && client.peerNode == 0 && command != "HELLO") {
+            server.sendMessage(client.fd, "403 Forbidden: Peer port.\n");
+            return;
+        }
+
+        // protocol negotiation: HELLO BINARY [DEFLATE] | HELLO TEXT
+        if (command == "HELLO") {
+            std::string mode = req.word();
+            if (client.viaPeerPort != (mode == "NODE")) {
+                server.sendMessage(client.fd, "403 Forbidden: Node links use the peer port.\n");
+                return;
+            }
+            if (mode == "BINARY") {
+                bool deflate = req.word() == "DEFLATE" && server.getConfig().compressThreshold > 0;
+                server.sendMessage(client.fd, deflate ? "200 HELLO BINARY DEFLATE\n" : "200 HELLO BINARY\n");
+                client.binary = true;
+                client.compress = deflate;
+            } else if (mode == "NODE") {
+                // HELLO NODE <id>: another cluster node opening its link to us
+                int node = 0;
+                req.integer(node);
+                if (client.isAuthenticated || !server.getCluster().isPeer(node)) {
+                    server.sendMessage(client.fd, "403 Forbidden: Unknown node.\n");
+                    return;
+                }
+                server.sendMessage(client.fd, "200 HELLO NODE\n");
+                server.acceptPeer(client, node);
+            } else if (mode == "TEXT" || mode.empty()) {
+                server.sendMessage(client.fd, "200 HELLO TEXT\n");
+            } else {
+                server.sendMessage(client.fd, "400 Bad Request: Unsupported protocol.\n");
+            }
+        }
+
+        // heartbeat (activity is already recorded by the server)
+        else if (command == "PING") {
+            server.sendMessage(client.fd, "PONG\n");
+        }
+        else if (command == "PONG") {
+            return;
+        }
 
         // public commands
 
-        if (command == "REGISTER") {
+        else if (command == "REGISTER") {
             // REGISTER <username> <password> <role>
-            std::string username, password;
-            int role;
-            ss >> username >> password >> role; // role: 0=user, 1=admin
+            std::string username = req.word();
+            std::string password = req.word();
+            int role = 0;
+            req.integer(role); // role: 0=user, 1=admin
 
-            if (username.empty() || password.empty() || ss.fail()) {
+            if (username.empty() || password.empty() || req.fail()) {
                 server.sendMessage(client.fd, "400 Bad Request: Format is REGISTER <user> <pass> <role>\n");
                 return;
             }
-            if (server.getDB().registerUser(username, password, role)) {
+            if (!validUsername(username)) {
+                server.sendMessage(client.fd, "400 Bad Request: Username may not contain spaces or control characters.\n");
+                return;
+            }
+            // Admin accounts come from an admin, or are the very first account
+            if (role != 0) {
+                bool byAdmin = client.isAuthenticated && server.getDB().isAdmin(server.userId(client.username));
+                if (role != 1 || (!byAdmin && server.getUsernames().size() > 0)) {
+                    server.sendMessage(client.fd, "403 Forbidden: Only an admin can create admin accounts.\n");
+                    return;
+                }
+            }
+            // Taken names are known without trying the insert
+            if (server.userId(username) == -1 && server.getDB().registerUser(username, password, role)) {
+                int newId = server.getDB().lastInsertId();
+                server.getUsernames().add(username, newId);
+                server.getCluster().announceUser(newId, username, true);
                 server.sendMessage(client.fd, "201 Created: User registered.\n");
             } else {
                 server.sendMessage(client.fd, "409 Conflict: Username already exists.\n");
@@ -36,51 +180,157 @@ public:
         }
         else if (command == "LOGIN") {
             // LOGIN <username> <password>
-            std::string username, password;
-            ss >> username >> password;
+            std::string username = req.word();
+            std::string password = req.word();
 
             if (client.isAuthenticated) {
                 server.sendMessage(client.fd, "400 Bad Request: Already logged in.\n");
                 return;
             }
-            if (server.getDB().checkLogin(username, password)) {
-                client.setUsername(username);
-                server.sendMessage(client.fd, "200 OK: Welcome " + username + "!\n");
-            } else {
+            if (!server.getDB().checkLogin(username, password)) {
                 server.sendMessage(client.fd, "401 Unauthorized: Wrong user or pass.\n");
+                return;
             }
+            server.loginClient(client, username);
+            server.cancelTimer(client.loginTimer);
+            client.loginTimer = TimerWheel::INVALID_TIMER;
+            server.sendMessage(client.fd, "200 OK: Welcome " + username + "!\n");
+
+            std::string token = server.openSession(client);
+            if (!token.empty()) server.sendMessage(client.fd, "SESSION " + token + "\n");
 
-            int myId = server.getDB().getUserId(username);
+            // A standby leaves them for the primary to deliver
+            int myId = server.userId(username);
+            if (server.isStandby()) return;
             std::vector<std::string> pendingMsgs = server.getDB().retrieveOfflineMessages(myId);
             if (!pendingMsgs.empty()) {
-                server.sendMessage(client.fd, "\n--- You received messages while offline ---\n");
-                for (const auto& msg : pendingMsgs) {
-                    server.sendMessage(client.fd, msg);
-                }
-                server.sendMessage(client.fd, "-------------------------------------------\n");
+                server.sendSection(client, "\n--- You received messages while offline ---\n", pendingMsgs,
+                                   "-------------------------------------------\n");
+            }
+        }
+        else if (command == "RESUME") {
+            // RESUME <token> <last_seq>
+            // Re-attaches a session dropped less than --resume-grace seconds
+            // ago and replays the pushes numbered after last_seq
+            std::string token = req.word();
+            uint64_t lastSeq = std::strtoull(req.word().c_str(), nullptr, 10);
+
+            if (client.isAuthenticated) {
+                server.sendMessage(client.fd, "400 Bad Request: Already logged in.\n");
+                return;
+            }
+            if (token.empty() || !server.resumeSession(client, token, lastSeq)) {
+                server.sendMessage(client.fd, "401 Unauthorized: Session expired.\n");
+                return;
+            }
+            server.sendMessage(client.fd, "200 OK: Resumed " + client.username + ".\n");
+
+            // Chat that did not fit in the session buffer was stored meanwhile;
+            // a standby leaves it for the primary to deliver, as on LOGIN
+            if (server.isStandby()) return;
+            int myId = server.userId(client.username);
+            std::vector<std::string> pendingMsgs = server.getDB().retrieveOfflineMessages(myId);
+            if (!pendingMsgs.empty()) {
+                server.sendSection(client, "\n--- You received messages while offline ---\n", pendingMsgs,
+                                   "-------------------------------------------\n");
             }
         }
         else if (command == "VIEW_POSTS") {
-            // VIEW_POSTS <username>
-            std::string targetUser;
-            ss >> targetUser;
+            // VIEW_POSTS <username> [@<before>]
+            // Without a cursor: the recent posts; if older ones are archived
+            // a hint line gives the cursor to read on. With one: first line
+            // is "200 POSTS <next>" (as for SEARCH), then the posts before it.
+            std::string targetUser = req.word();
+            std::string cursorArg = req.word();
 
-            int targetId = server.getDB().getUserId(targetUser);
-            int myId = client.isAuthenticated ? server.getDB().getUserId(client.username) : -1;
+            int targetId = server.userId(targetUser);
+            int myId = client.isAuthenticated ? server.userId(client.username) : -1;
 
             if (targetId == -1) {
                 server.sendMessage(client.fd, "404 User not found.\n");
                 return;
             }
 
-            std::string posts = server.getDB().getPostsForProfile(myId, targetId);
-            server.sendMessage(client.fd, "--- Posts for " + targetUser + " ---\n" + posts + "----------------------\n");
+            int tier = server.getDB().getProfileTier(myId, targetId);
+            if (!cursorArg.empty()) {
+                char* end = nullptr;
+                long before = std::strtol(cursorArg.c_str() + (cursorArg[0] == '@' ? 1 : 0), &end, 10);
+                if (*end != '\0' || before <= 0) { server.sendMessage(client.fd, "400 Bad Request: Invalid cursor.\n"); return; }
+                server.querySection(client, "", [targetId, tier, before](Storage& db) {
+                    int next = -1;
+                    std::vector<std::string> lines = db.getPostsBefore(targetId, tier, static_cast<int>(before), POSTS_PAGE, next);
+                    lines.insert(lines.begin(), "200 POSTS " + (next < 0 ? std::string("-") : "@" + std::to_string(next)));
+                    return lines;
+                });
+                return;
+            }
+
+            // Rendered once per (owner, tier) until the owner's posts change
+            std::string header = "--- Posts for " + targetUser + " ---\n";
+            std::string footer = "----------------------\n";
+            if (const PostArchive* archive = server.getArchive()) {
+                if (int newest = archive->newestOf(targetId)) {
+                    footer = "Older posts: VIEW_POSTS " + targetUser + " @" + std::to_string(newest + 1) + "\n" + footer;
+                }
+            }
+            ProfileCache& cache = server.getProfileCache();
+            if (ProfileCache::Items cached = cache.get(targetId, tier)) {
+                server.sendSection(client, header, *cached, footer);
+                return;
+            }
+            uint64_t generation = cache.generation(targetId);
+            server.querySection(client, header, [&cache, targetId, tier, generation](Storage& db) {
+                std::vector<std::string> posts = db.getPostsForTier(targetId, tier);
+                cache.put(targetId, tier, generation, posts);
+                return posts;
+            }, footer);
         }
         else if (command == "FEED") {
             // FEED
-            int myId = server.getDB().getUserId(client.username);
-            std::string feed = server.getDB().getNewsFeed(myId);
-            server.sendMessage(client.fd, feed);
+            int myId = server.userId(client.username);
+            server.querySection(client, "--- News Feed ---\n",
+                                [myId](Storage& db) { return db.getNewsFeed(myId); },
+                                "", "No posts yet. Add friends or post something!\n");
+        }
+        else if (command == "SEARCH") {
+            // SEARCH <words> [@cursor]
+            // First line is "200 SEARCH <next>": pass <next> back to get the
+            // following page, "-" means there is nothing more. Archived posts
+            // are not indexed; when there are any the line ends with
+            // "archived=<id>": posts up to that id were not searched.
+            if (!client.isAuthenticated) { server.sendMessage(client.fd, "403 Forbidden\n"); return; }
+
+            std::string text = req.rest();
+            std::string cursorArg = req.isBinary() ? req.word() : "";
+            if (!req.isBinary()) {
+                size_t last = text.find_last_of(' ');
+                std::string tail = text.substr(last == std::string::npos ? 0 : last + 1);
+                if (!tail.empty() && tail[0] == '@') {
+                    cursorArg = tail;
+                    text.erase(last == std::string::npos ? 0 : last);
+                }
+            }
+            SearchCursor cursor;
+            if (!cursorArg.empty() && !SearchCursor::parse(cursorArg.substr(cursorArg[0] == '@' ? 1 : 0), cursor)) {
+                server.sendMessage(client.fd, "400 Bad Request: Invalid cursor.\n");
+                return;
+            }
+            if (Storage::searchTerms(text).empty()) {
+                server.sendMessage(client.fd, "400 Bad Request: Nothing to search for.\n");
+                return;
+            }
+
+            int myId = server.userId(client.username);
+            const PostArchive* archive = server.getArchive();
+            int archived = archive ? archive->maxPostId() : 0;
+            server.querySection(client, "", [myId, text, cursor, archived](Storage& db) {
+                SearchCursor next;
+                std::vector<std::string> lines = db.searchPosts(myId, text, cursor, SEARCH_PAGE, SEARCH_SCAN, next);
+                std::string status = "200 SEARCH " + (next.id == 0 ? std::string("-") : "@" + next.str());
+                if (archived > 0) status += " archived=" + std::to_string(archived);
+                lines.insert(lines.begin(), status);
+                return lines;
+            });
         }
 
         // user commands
@@ -88,18 +338,18 @@ public:
             // LOGOUT
             if (!client.isAuthenticated) { server.sendMessage(client.fd, "403 Forbidden: Login required.\n"); return; }
 
-            server.broadcastMessage(client.username + " has disconnected.\n", client.fd);
-            client.logout();
+            server.closeSession(client);
+            server.logoutClient(client);
             server.sendMessage(client.fd, "200 OK: Logged out.\n");
         }
         else if (command == "ADD_FRIEND") {
             // ADD_FRIEND <username> <type>
             if (!client.isAuthenticated) { server.sendMessage(client.fd, "403 Forbidden: Login required.\n"); return; }
 
-            std::string targetUser, typeStr;
-            ss >> targetUser >> typeStr;
-            int targetId = server.getDB().getUserId(targetUser);
-            int myId = server.getDB().getUserId(client.username);
+            std::string targetUser = req.word();
+            std::string typeStr = req.word();
+            int targetId = server.userId(targetUser);
+            int myId = server.userId(client.username);
 
             if (targetId == -1) {
                 server.sendMessage(client.fd, "404 Not Found.\n");
@@ -107,6 +357,7 @@ public:
             }
             int type = (typeStr == "close") ? 1 : 0;
             if (server.getDB().sendFriendRequest(myId, targetId, type)) {
+                server.touchSync(targetId, SyncSection::Requests);
                 server.sendMessage(client.fd, "200 OK: Friend request sent.\n");
             } else {
                 server.sendMessage(client.fd, "400 Error: Request failed (already friends/pending?).\n");
@@ -116,20 +367,24 @@ public:
             // VIEW_REQUESTS
             if (!client.isAuthenticated) { server.sendMessage(client.fd, "403 Forbidden: Login required.\n"); return; }
 
-            int myId = server.getDB().getUserId(client.username);
-            std::string reqs = server.getDB().getPendingRequests(myId);
-            server.sendMessage(client.fd, "--- Friend Requests ---\n" + reqs);
+            int myId = server.userId(client.username);
+            std::vector<std::string> reqs = server.getDB().getPendingRequests(myId);
+            server.sendSection(client, "--- Friend Requests ---\n", reqs);
         }
         else if (command == "ACCEPT_REQUEST") {
             // ACCEPT_REQUEST <username>
             if (!client.isAuthenticated) { server.sendMessage(client.fd, "403 Forbidden: Login required.\n"); return; }
 
-            std::string requesterUser;
-            ss >> requesterUser;
-            int requesterId = server.getDB().getUserId(requesterUser);
-            int myId = server.getDB().getUserId(client.username);
+            std::string requesterUser = req.word();
+            int requesterId = server.userId(requesterUser);
+            int myId = server.userId(client.username);
 
             if (server.getDB().acceptFriendRequest(myId, requesterId)) {
+                server.getSocialGraph().addFriendship(myId, requesterId);
+                server.getCluster().announceFriendship(myId, requesterId);
+                server.touchSync(myId, SyncSection::Requests);
+                server.touchSync(myId, SyncSection::Friends);
+                server.touchSync(requesterId, SyncSection::Friends);
                 server.sendMessage(client.fd, "200 OK: Request accepted.\n");
             } else {
                 server.sendMessage(client.fd, "400 Error: No pending request found.\n");
@@ -139,49 +394,154 @@ public:
             // POST <visibility> <content...>
             if (!client.isAuthenticated) { server.sendMessage(client.fd, "403 Forbidden: Login required.\n"); return; }
 
-            std::string visibilityStr, content;
-            ss >> visibilityStr;
-            std::getline(ss, content);
-            if (!content.empty() && content[0] == ' ') content.erase(0, 1);
+            std::string visibilityStr = req.word();
+            std::string content = singleLine(req.rest());
 
             if (content.empty()) {
                 server.sendMessage(client.fd, "400 Empty post.\n");
                 return;
             }
+            if (!checkAttachments(content, client, server)) return;
 
             int visibility = 0;
             if (visibilityStr == "friends") visibility = 1;
             else if (visibilityStr == "close") visibility = 2;
 
-            int myId = server.getDB().getUserId(client.username);
+            int myId = server.userId(client.username);
 
-            // DEBUG: Afișează în consola serverului
-            std::cout << "User " << client.username << " is posting: " << content << " (Vis: " << visibility << ")" << std::endl;
+            Logger::info("post_created", {{"user", client.username}, {"visibility", std::to_string(visibility)},
+                                          {"bytes", std::to_string(content.size())}});
+            if (Logger::enabled(LogLevel::Debug)) {
+                Logger::debug("post_content", {{"user", client.username}, {"content", content}});
+            }
 
             if(server.getDB().createPost(myId, content, visibility)) {
+                server.touchPosts(myId);
                 server.sendMessage(client.fd, "201 Created.\n");
             } else {
                 server.sendMessage(client.fd, "500 Server Error: Could not save post.\n");
             }
         }
+        else if (command == "UPLOAD") {
+            // UPLOAD <size>: answers "200 UPLOAD <id>"; then UPLOAD_CHUNK <id>
+            // <data> (base64 in text mode) until size bytes are in, and
+            // UPLOAD_END <id>, which answers "200 BLOB <hash> <size>"
+            if (!client.isAuthenticated) { server.sendMessage(client.fd, "403 Forbidden: Login required.\n"); return; }
+            BlobStore* blobs = server.getBlobs();
+            if (!blobs) { server.sendMessage(client.fd, "400 Bad Request: Attachments are disabled.\n"); return; }
+
+            int size = 0;
+            if (!req.integer(size) || size <= 0) {
+                server.sendMessage(client.fd, "400 Bad Request: Format is UPLOAD <size>\n");
+                return;
+            }
+            int id = blobs->begin(client.fd, static_cast<size_t>(size));
+            if (id == BlobStore::TOO_LARGE) {
+                server.sendMessage(client.fd, "413 Too large: at most " + std::to_string(server.getConfig().maxAttachment) + " bytes.\n");
+                return;
+            }
+            if (id == BlobStore::TOO_MANY) {
+                server.sendMessage(client.fd, "429 Too many uploads in progress: finish one first.\n");
+                return;
+            }
+            if (id < 0) {
+                server.sendMessage(client.fd, "500 Server Error: Could not start the upload.\n");
+                return;
+            }
+            server.sendMessage(client.fd, "200 UPLOAD " + std::to_string(id) + "\n");
+        }
+        else if (command == "UPLOAD_CHUNK") {
+            // UPLOAD_CHUNK <id> <data>
+            if (!client.isAuthenticated) { server.sendMessage(client.fd, "403 Forbidden: Login required.\n"); return; }
+            BlobStore* blobs = server.getBlobs();
+            if (!blobs) { server.sendMessage(client.fd, "400 Bad Request: Attachments are disabled.\n"); return; }
+
+            int id = 0;
+            req.integer(id);
+            std::string data = req.word();
+            if (!req.isBinary()) {
+                std::string encoded;
+                encoded.swap(data);
+                if (!BlobStore::decodeBase64(encoded, data)) {
+                    server.sendMessage(client.fd, "400 Bad Request: Chunk is not base64.\n");
+                    return;
+                }
+            }
+            if (data.empty() || data.size() > BlobStore::MAX_CHUNK) {
+                server.sendMessage(client.fd, "400 Bad Request: Chunks are 1 to " + std::to_string(BlobStore::MAX_CHUNK) + " bytes.\n");
+                return;
+            }
+            long long received = blobs->append(client.fd, id, data);
+            if (received < 0) {
+                server.sendMessage(client.fd, "404 Not Found: No such upload (or more data than announced).\n");
+                return;
+            }
+            server.sendMessage(client.fd, "200 OK: " + std::to_string(received) + " bytes received.\n");
+        }
+        else if (command == "UPLOAD_END") {
+            // UPLOAD_END <id>
+            if (!client.isAuthenticated) { server.sendMessage(client.fd, "403 Forbidden: Login required.\n"); return; }
+            BlobStore* blobs = server.getBlobs();
+            if (!blobs) { server.sendMessage(client.fd, "400 Bad Request: Attachments are disabled.\n"); return; }
+
+            int id = 0;
+            req.integer(id);
+            std::string hash = blobs->finish(client.fd, id);
+            if (hash.empty()) {
+                server.sendMessage(client.fd, "409 Conflict: Upload unknown or incomplete.\n");
+                return;
+            }
+            server.sendMessage(client.fd, "200 BLOB " + hash + " " + std::to_string(blobs->sizeOf(hash)) + "\n");
+        }
+        else if (command == "DOWNLOAD") {
+            // DOWNLOAD <hash>: "200 BLOB <hash> <size>" and then exactly
+            // size bytes of the file (binary: one field holding them)
+            if (!client.isAuthenticated) { server.sendMessage(client.fd, "403 Forbidden: Login required.\n"); return; }
+            BlobStore* blobs = server.getBlobs();
+            if (!blobs) { server.sendMessage(client.fd, "400 Bad Request: Attachments are disabled.\n"); return; }
+
+            std::string hash = req.word();
+            long long size = blobs->sizeOf(hash);
+            // Stored under a larger --max-attachment than one frame can carry
+            if (size > static_cast<long long>(Protocol::MAX_SINGLE_FIELD) && client.collecting && client.responseTag.empty()) {
+                server.sendMessage(client.fd, "413 Too large: the attachment does not fit in one frame.\n");
+                return;
+            }
+            if (size < 0 || !server.sendFile(client, blobs->pathOf(hash), "200 BLOB " + hash + " " + std::to_string(size) + "\n")) {
+                server.sendMessage(client.fd, "404 Attachment not found.\n");
+            }
+        }
         else if (command == "MSG") {
             // MSG <username> <msg...>
             if (!client.isAuthenticated) { server.sendMessage(client.fd, "403 Forbidden: Login required.\n"); return; }
 
-            std::string destUser, msgContent;
-            ss >> destUser;
-            std::getline(ss, msgContent);
-            if (!msgContent.empty() && msgContent[0] == ' ') msgContent.erase(0, 1);
+            std::string destUser = req.word();
+            std::string msgContent = singleLine(req.rest());
+            if (!checkAttachments(msgContent, client, server)) return;
+
+            // Kept in the conversation's history however it is delivered
+            int targetId = server.userId(destUser);
+            if (targetId != -1) {
+                server.getDB().appendHistory(Storage::privateConversation(server.userId(client.username), targetId),
+                                             client.username, msgContent);
+            }
+
+            SharedBuffer formattedMsg = makeSharedBuffer("[Private from " + client.username + "]: " + msgContent + "\n");
+            auto origin = std::make_shared<const ChatOrigin>(ChatOrigin{client.username, msgContent, false, -1});
 
             Client* destClient = server.getClientByUsername(destUser);
             if (destClient) {
                 // ONLINE
-                std::string formattedMsg = "[Private from " + client.username + "]: " + msgContent + "\n";
-                server.sendMessage(destClient->fd, formattedMsg);
+                server.deliverChat(*destClient, formattedMsg, OfflineCopy{destUser, origin});
+                server.sendMessage(client.fd, "200 OK: Sent.\n");
+            } else if (server.getCluster().forwardChat(server.getCluster().nodeOf(destUser), origin, {destUser})) {
+                // ONLINE on another node
+                server.sendMessage(client.fd, "200 OK: Sent.\n");
+            } else if (server.holdForDetached(destUser, formattedMsg, OfflineCopy{destUser, origin})) {
+                // Reconnecting, delivered on RESUME
                 server.sendMessage(client.fd, "200 OK: Sent.\n");
             } else {
                 // OFFLINE
-                int targetId = server.getDB().getUserId(destUser);
                 if (targetId != -1) {
                     server.getDB().storeOfflineMessage(targetId, client.username, msgContent, false, -1);
                     server.sendMessage(client.fd, "200 OK: User offline. Message saved.\n");
@@ -194,20 +554,19 @@ public:
             // CREATE_GROUP <nume_grup>
             if (!client.isAuthenticated) { server.sendMessage(client.fd, "403 Forbidden\n"); return; }
 
-            std::string groupName;
-            std::getline(ss, groupName);
-            if (!groupName.empty() && groupName[0] == ' ') groupName.erase(0, 1);
+            std::string groupName = req.rest();
 
             if (groupName.empty()) {
                 server.sendMessage(client.fd, "400 Name required.\n");
                 return;
             }
 
-            int myId = server.getDB().getUserId(client.username);
+            int myId = server.userId(client.username);
             int groupId = server.getDB().createGroup(groupName, myId);
 
             if (groupId != -1) {
                 server.getDB().addToGroup(groupId, myId);
+                server.touchSync(myId, SyncSection::Groups);
                 server.sendMessage(client.fd, "200 OK: Group '" + groupName + "' created with ID " + std::to_string(groupId) + ".\n");
             } else {
                 server.sendMessage(client.fd, "500 Server Error.\n");
@@ -218,29 +577,30 @@ public:
             // ADD_TO_GROUP <group_id> <username_de_adaugat>
             if (!client.isAuthenticated) { server.sendMessage(client.fd, "403 Forbidden\n"); return; }
 
-            int groupId;
-            std::string newMemberUser;
-            ss >> groupId >> newMemberUser;
+            int groupId = -1;
+            req.integer(groupId);
+            std::string newMemberUser = req.word();
 
-            int myId = server.getDB().getUserId(client.username);
+            int myId = server.userId(client.username);
 
             if (!server.getDB().isUserInGroup(myId, groupId)) {
                 server.sendMessage(client.fd, "403 You are not in this group.\n");
                 return;
             }
 
-            int newMemberId = server.getDB().getUserId(newMemberUser);
+            int newMemberId = server.userId(newMemberUser);
             if (newMemberId == -1) {
                 server.sendMessage(client.fd, "404 User not found.\n");
                 return;
             }
 
             if (server.getDB().addToGroup(groupId, newMemberId)) {
+                server.touchSync(newMemberId, SyncSection::Groups);
                 server.sendMessage(client.fd, "200 OK: User added.\n");
 
                 Client* destClient = server.getClientByUsername(newMemberUser);
                 if (destClient) {
-                    server.sendMessage(destClient->fd, "Info: You were added to group ID " + std::to_string(groupId) + " by " + client.username + ".\n");
+                    server.notify(*destClient, "Info: You were added to group ID " + std::to_string(groupId) + " by " + client.username + ".\n");
                 }
             } else {
                 server.sendMessage(client.fd, "400 Error (maybe already inside?).\n");
@@ -251,56 +611,247 @@ public:
             // GROUP_MSG <group_id> <mesaj...>
             if (!client.isAuthenticated) { server.sendMessage(client.fd, "403 Forbidden\n"); return; }
 
-            int groupId;
-            ss >> groupId;
-
-            std::string msgContent;
-            std::getline(ss, msgContent);
-            if (!msgContent.empty() && msgContent[0] == ' ') msgContent.erase(0, 1);
+            int groupId = -1;
+            req.integer(groupId);
+            std::string msgContent = singleLine(req.rest());
 
-            int myId = server.getDB().getUserId(client.username);
+            int myId = server.userId(client.username);
 
             if (!server.getDB().isUserInGroup(myId, groupId)) {
                 server.sendMessage(client.fd, "403 You are not in this group.\n");
                 return;
             }
+            if (!checkAttachments(msgContent, client, server)) return;
 
             std::vector<std::string> members = server.getDB().getGroupMembers(groupId);
+            server.getDB().appendHistory(Storage::groupConversation(groupId), client.username, msgContent);
 
-            std::string formattedMsg = "[Group " + std::to_string(groupId) + "] " + client.username + ": " + msgContent + "\n";
+            // Rendered once, every online member's queue shares the buffer
+            SharedBuffer formattedMsg = makeSharedBuffer("[Group " + std::to_string(groupId) + "] " + client.username + ": " + msgContent + "\n");
+            auto origin = std::make_shared<const ChatOrigin>(ChatOrigin{client.username, msgContent, true, groupId});
+            // Members on other nodes, one forward per node
+            std::map<int, std::vector<std::string>> remote;
 
             for (const auto& memberName : members) {
                 if (memberName == client.username) continue;
 
                 Client* destClient = server.getClientByUsername(memberName);
+                int node = destClient ? -1 : server.getCluster().nodeOf(memberName);
                 if (destClient) {
                     // ONLINE
-                    server.sendMessage(destClient->fd, formattedMsg);
+                    server.deliverChat(*destClient, formattedMsg, OfflineCopy{memberName, origin});
+                } else if (node != -1) {
+                    remote[node].push_back(memberName);
+                } else if (server.holdForDetached(memberName, formattedMsg, OfflineCopy{memberName, origin})) {
+                    // Reconnecting, delivered on RESUME
                 } else {
                     // OFFLINE
-                    int targetId = server.getDB().getUserId(memberName);
+                    int targetId = server.userId(memberName);
                     if (targetId != -1) {
                         server.getDB().storeOfflineMessage(targetId, client.username, msgContent, true, groupId);
                     }
                 }
             }
+            for (const auto& entry : remote) {
+                if (server.getCluster().forwardChat(entry.first, origin, entry.second)) continue;
+                for (const auto& memberName : entry.second) {
+                    server.getDB().storeOfflineMessage(server.userId(memberName), client.username, msgContent, true, groupId);
+                }
+            }
             server.sendMessage(client.fd, "200 OK: Sent to group (stored for offline members).\n");
         }
+        else if (command == "HISTORY") {
+            // HISTORY <peer|group id> <before|-> [n]
+            // Up to n messages of the conversation numbered below <before>
+            // ("-": the newest), oldest first. First line is
+            // "200 HISTORY <next>", <next> being the <before> for the page
+            // above it, "-" at the start of the conversation.
+            if (!client.isAuthenticated) { server.sendMessage(client.fd, "403 Forbidden: Login required.\n"); return; }
+
+            std::string target = req.word();
+            std::string beforeArg = req.word();
+            int limit = HISTORY_PAGE;
+            if (!req.integer(limit)) limit = HISTORY_PAGE;
+            limit = std::max(1, std::min(limit, HISTORY_MAX));
+
+            int64_t before = INT64_MAX;
+            if (beforeArg != "-") {
+                char* end = nullptr;
+                before = std::strtoll(beforeArg.c_str(), &end, 10);
+                if (beforeArg.empty() || *end != '\0' || before <= 0) {
+                    server.sendMessage(client.fd, "400 Bad Request: Format is HISTORY <user|group id> <before|-> [n]\n");
+                    return;
+                }
+            }
+
+            // A number names a group, anything else a user
+            int myId = server.userId(client.username);
+            int64_t conversation;
+            if (!target.empty() && target.find_first_not_of("0123456789") == std::string::npos) {
+                int groupId = std::atoi(target.c_str());
+                if (!server.getDB().isUserInGroup(myId, groupId)) {
+                    server.sendMessage(client.fd, "403 You are not in this group.\n");
+                    return;
+                }
+                conversation = Storage::groupConversation(groupId);
+            } else {
+                int peerId = server.userId(target);
+                if (peerId == -1) { server.sendMessage(client.fd, "404 User not found.\n"); return; }
+                conversation = Storage::privateConversation(myId, peerId);
+            }
+
+            server.querySection(client, "", [conversation, before, limit](Storage& db) {
+                int64_t next = -1;
+                std::vector<std::string> lines = db.getHistory(conversation, before, limit, next);
+                lines.insert(lines.begin(), "200 HISTORY " + (next < 0 ? std::string("-") : std::to_string(next)));
+                return lines;
+            });
+        }
         else if (command == "VIEW_FRIENDS") {
             if (!client.isAuthenticated) { server.sendMessage(client.fd, "403 Forbidden\n"); return; }
 
-            int myId = server.getDB().getUserId(client.username);
-            std::string friends = server.getDB().getFriendsList(myId);
+            int myId = server.userId(client.username);
+            std::vector<std::string> friends = server.getDB().getFriendsList(myId);
+
+            server.sendSection(client, "--- Friends List ---\n", friends);
+        }
+        else if (command == "SUGGEST_USERS") {
+            // SUGGEST_USERS <prefix> [n]
+            // Usernames starting with prefix for the add friend / add member
+            // inputs; friends of my friends first (most mutual friends
+            // first), then alphabetical.
+            if (!client.isAuthenticated) { server.sendMessage(client.fd, "403 Forbidden\n"); return; }
+
+            std::string prefix = req.word();
+            int limit = SUGGEST_DEFAULT;
+            if (!req.integer(limit)) limit = SUGGEST_DEFAULT;
+            limit = std::max(1, std::min(limit, SUGGEST_MAX));
+            if (prefix.empty()) { server.sendMessage(client.fd, "400 Bad Request: Prefix required.\n"); return; }
+
+            int myId = server.userId(client.username);
+            const SocialGraph& graph = server.getSocialGraph();
+            auto range = server.getUsernames().withPrefix(prefix);
+
+            // Friends of friends matching the prefix, most mutual friends
+            // first: taken from whichever is smaller, my two-hop candidates
+            // or the names in the prefix range
+            const UsernameIndex& names = server.getUsernames();
+            const std::unordered_map<int, int>& candidates = graph.sharingFriendsWith(myId);
+            std::vector<std::pair<int, std::string>> ranked;   // (mutual friends, name)
+            if (candidates.size() < static_cast<size_t>(range.second - range.first)) {
+                for (const auto& entry : candidates) {
+                    if (graph.areFriends(myId, entry.first)) continue;
+                    const std::string& name = names.nameOf(entry.first);
+                    if (name.compare(0, prefix.size(), prefix) == 0) ranked.emplace_back(entry.second, name);
+                }
+            } else {
+                for (auto it = range.first; it != range.second; ++it) {
+                    if (it->id == myId || graph.areFriends(myId, it->id)) continue;
+                    if (int mutual = graph.mutualFriends(myId, it->id)) ranked.emplace_back(mutual, it->name);
+                }
+            }
+            size_t kept = std::min(ranked.size(), static_cast<size_t>(limit));
+            std::partial_sort(ranked.begin(), ranked.begin() + kept, ranked.end(),
+                              [](const std::pair<int, std::string>& a, const std::pair<int, std::string>& b) {
+                                  return a.first != b.first ? a.first > b.first : a.second < b.second;
+                              });
+            std::vector<std::string> close;
+            for (size_t i = 0; i < kept; i++) close.push_back(std::move(ranked[i].second));
+
+            // Then the rest in alphabetical order
+            for (auto it = range.first; it != range.second && (int)close.size() < limit; ++it) {
+                if (it->id == myId) continue;
+                if (!graph.areFriends(myId, it->id) && graph.mutualFriends(myId, it->id) > 0) continue;
+                close.push_back(it->name);
+            }
 
-            server.sendMessage(client.fd, "--- Friends List ---\n" + friends);
+            server.sendSection(client, "200 USERS " + std::to_string(close.size()) + "\n", close);
+        }
+        else if (command == "SUGGEST_FRIENDS") {
+            // SUGGEST_FRIENDS [n]
+            // People I am not friends with, most mutual friends first: "<name> <mutual>"
+            if (!client.isAuthenticated) { server.sendMessage(client.fd, "403 Forbidden\n"); return; }
+
+            int limit = SUGGEST_DEFAULT;
+            if (!req.integer(limit)) limit = SUGGEST_DEFAULT;
+            limit = std::max(1, limit);
+
+            int myId = server.userId(client.username);
+            std::vector<std::string> lines;
+            for (const auto& s : server.getSocialGraph().suggestionsFor(myId)) {
+                if ((int)lines.size() == limit) break;
+                const std::string& name = server.getUsernames().nameOf(s.id);
+                if (!name.empty()) lines.push_back(name + " " + std::to_string(s.mutualFriends));
+            }
+            server.sendSection(client, "200 SUGGESTIONS " + std::to_string(lines.size()) + "\n", lines);
+        }
+        else if (command == "WHO_IS_ONLINE") {
+            // WHO_IS_ONLINE [username...] (default: my friends)
+            // Only friends' presence is reported; other names are left out
+            if (!client.isAuthenticated) { server.sendMessage(client.fd, "403 Forbidden\n"); return; }
+
+            int myId = server.userId(client.username);
+            const SocialGraph& graph = server.getSocialGraph();
+            std::vector<std::string> names;
+            bool asked = false;
+            for (std::string name = req.word(); !name.empty(); name = req.word()) {
+                asked = true;
+                int id = server.userId(name);
+                if (id != -1 && (id == myId || graph.areFriends(myId, id))) names.push_back(name);
+            }
+            if (!asked) {
+                for (int id : graph.friendsOf(myId)) names.push_back(server.getUsernames().nameOf(id));
+            }
+
+            std::string online = "200 ONLINE";
+            for (const auto& n : names) {
+                if (server.isOnline(n)) online += " " + n;
+            }
+            server.sendMessage(client.fd, online + "\n");
+        }
+        else if (command == "SYNC") {
+            // SYNC <feed> <friends> <requests> <groups>
+            // Stamps from the previous answer (0 = nothing yet). Only sections
+            // whose stamp changed are sent, each as "<NAME> <count>" + items.
+            if (!client.isAuthenticated) { server.sendMessage(client.fd, "403 Forbidden\n"); return; }
+
+            static const char* sectionNames[] = {"FEED", "FRIENDS", "REQUESTS", "GROUPS"};
+            int myId = server.userId(client.username);
+            std::string header = "200 SYNC";
+            std::vector<std::string> lines(1);
+
+            for (int i = 0; i < 4; i++) {
+                SyncSection section = static_cast<SyncSection>(i);
+                uint64_t known = std::strtoull(req.word().c_str(), nullptr, 10);
+                uint64_t current = server.getSync().stamp(myId, section);
+                header += " " + std::to_string(current);
+                if (known == current) continue;
+
+                std::vector<std::string> items;
+                switch (section) {
+                    case SyncSection::Feed: items = server.getDB().getNewsFeed(myId); break;
+                    case SyncSection::Friends: items = server.getDB().getFriendsList(myId); break;
+                    case SyncSection::Requests: items = server.getDB().getPendingRequests(myId); break;
+                    case SyncSection::Groups: items = server.getDB().getUserGroups(myId); break;
+                }
+                lines.push_back(std::string(sectionNames[i]) + " " + std::to_string(items.size()));
+                lines.insert(lines.end(), items.begin(), items.end());
+            }
+
+            if (lines.size() == 1) {
+                server.sendMessage(client.fd, "304 Not Modified\n");
+                return;
+            }
+            lines[0] = header;
+            server.sendSection(client, "", lines);
         }
         else if (command == "VIEW_GROUPS") {
             if (!client.isAuthenticated) { server.sendMessage(client.fd, "403 Forbidden\n"); return; }
 
-            int myId = server.getDB().getUserId(client.username);
-            std::string groups = server.getDB().getUserGroups(myId);
+            int myId = server.userId(client.username);
+            std::vector<std::string> groups = server.getDB().getUserGroups(myId);
 
-            server.sendMessage(client.fd, "--- Groups List ---\n" + groups);
+            server.sendSection(client, "--- Groups List ---\n", groups);
         }
 
         // admin commands
@@ -308,42 +859,99 @@ public:
             // DELETE_USER <username>
             if (!client.isAuthenticated) { server.sendMessage(client.fd, "403 Forbidden: Login required.\n"); return; }
 
-            int myId = server.getDB().getUserId(client.username);
+            int myId = server.userId(client.username);
             if (!server.getDB().isAdmin(myId)) {
                 server.sendMessage(client.fd, "403 Forbidden: Admin access required.\n");
                 return;
             }
 
-            std::string targetUser;
-            ss >> targetUser;
+            std::string targetUser = req.word();
+            int targetId = server.userId(targetUser);
 
             if (server.getDB().deleteUser(targetUser)) {
+                server.getSync().touchAll();
+                server.getProfileCache().invalidate(targetId);
+                server.getUsernames().remove(targetUser);
+                server.getSocialGraph().removeUser(targetId);
+                server.getCluster().announceUser(targetId, targetUser, false);
+                server.closeSessionsOf(targetUser);
                 server.sendMessage(client.fd, "200 OK: User " + targetUser + " deleted.\n");
 
                 Client* targetClient = server.getClientByUsername(targetUser);
                 if (targetClient) {
                      server.sendMessage(targetClient->fd, "You have been banned/deleted by admin.\n");
-                     targetClient->logout();
+                     server.logoutClient(*targetClient);
                 }
             } else {
                 server.sendMessage(client.fd, "404 User not found or error deleting.\n");
             }
         }
+        else if (command == "STATS") {
+            // STATS (counters and gauges, "name value" per line)
+            if (!client.isAuthenticated) { server.sendMessage(client.fd, "403 Forbidden: Login required.\n"); return; }
+
+            int myId = server.userId(client.username);
+            if (!server.getDB().isAdmin(myId)) {
+                server.sendMessage(client.fd, "403 Forbidden: Admin access required.\n");
+                return;
+            }
+            server.sendSection(client, "--- Stats ---\n", server.getMetrics().snapshot());
+        }
+        else if (command == "PROMOTE") {
+            // PROMOTE: a standby stops replicating and becomes a primary
+            if (!client.isAuthenticated) { server.sendMessage(client.fd, "403 Forbidden: Login required.\n"); return; }
+
+            int myId = server.userId(client.username);
+            if (!server.getDB().isAdmin(myId)) {
+                server.sendMessage(client.fd, "403 Forbidden: Admin access required.\n");
+                return;
+            }
+            if (!server.isStandby()) {
+                server.sendMessage(client.fd, "400 Bad Request: Not a standby.\n");
+                return;
+            }
+            uint64_t seq = server.promote();
+            server.sendMessage(client.fd, "200 OK: Promoted, accepting writes (applied up to change " + std::to_string(seq) + ").\n");
+        }
+        else if (command == "BACKUP") {
+            // BACKUP <name>: copy of the database into --backup-dir, written in the background
+            if (!client.isAuthenticated) { server.sendMessage(client.fd, "403 Forbidden: Login required.\n"); return; }
+
+            int myId = server.userId(client.username);
+            if (!server.getDB().isAdmin(myId)) {
+                server.sendMessage(client.fd, "403 Forbidden: Admin access required.\n");
+                return;
+            }
+            std::string name = req.rest();
+            if (!validBackupName(name)) {
+                server.sendMessage(client.fd, "400 Bad Request: Format is BACKUP <file name> (letters, digits, '.', '-', '_').\n");
+                return;
+            }
+            if (!server.canBackup()) {
+                server.sendMessage(client.fd, "400 Bad Request: Backups need --storage=sqlite and --backup-dir.\n");
+                return;
+            }
+            std::string path = server.getConfig().backupDir + "/" + name;
+            if (!server.startBackup(path)) {
+                server.sendMessage(client.fd, "409 Conflict: A backup is already running.\n");
+                return;
+            }
+            server.sendMessage(client.fd, "202 Accepted: Backing up to " + path + ", see backup.* in STATS.\n");
+        }
         else if (command == "DELETE_POST") {
             // DELETE_POST <id>
             if (!client.isAuthenticated) { server.sendMessage(client.fd, "403 Forbidden: Login required.\n"); return; }
 
-            int postId;
-            ss >> postId;
-
-            if (ss.fail()) {
+            int postId = -1;
+            if (!req.integer(postId)) {
                 server.sendMessage(client.fd, "400 Bad Request: Invalid ID format.\n");
                 return;
             }
 
-            int myId = server.getDB().getUserId(client.username);
+            int myId = server.userId(client.username);
 
             if (server.getDB().deletePost(postId, myId)) {
+                server.touchPosts(myId);
                 server.sendMessage(client.fd, "200 OK: Post " + std::to_string(postId) + " deleted.\n");
             } else {
                 server.sendMessage(client.fd, "403 Forbidden or Not Found: You can only delete your own posts.\n");
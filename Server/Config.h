@@ -0,0 +1,240 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <iostream>
+#include "Protocol.h"
+
+// Another ServerApp of the same cluster (--peers)
+struct PeerNode {
+    int id;
+    std::string host;
+    int port;   // its --peer-port
+};
+
+// Server settings, read from the command line (--key=value)
+struct ServerConfig {
+    int port = 9000;
+    std::string dbPath = "virtualsoc.db";
+    // sqlite (dbPath), sharded (dbPath + shards files) or memory; memory
+    // state is kept in snapshotPath, if set, rewritten every
+    // snapshotInterval seconds
+    std::string storage = "sqlite";
+    int shards = 4;
+    std::string snapshotPath;
+    int snapshotInterval = 60;
+    // Change log of every database write (sqlite storage), "" for none;
+    // segment files of this size, the newest changelogSegments kept
+    std::string changelogDir;
+    size_t changelogSegmentBytes = 16 << 20;
+    int changelogSegments = 8;
+    // Primary: Unix socket standbys replicate from (needs changelogDir).
+    // Standby: the primary's socket; reads are refused once the copy is
+    // more than maxStaleness ms behind, writes always (until PROMOTE).
+    std::string replicationSocket;
+    std::string standbyOf;
+    int maxStaleness = 5000;
+    // Online backups (sqlite storage): every backupInterval seconds into
+    // backupDir (0 = only on BACKUP, which also writes there), copied
+    // backupPages pages at a time with backupPauseMs between steps
+    std::string backupDir;
+    int backupInterval = 0;
+    int backupPages = 64;
+    int backupPauseMs = 10;
+    // Background clean-up (sqlite storage) every maintenanceInterval
+    // seconds, 0 for none: see Database/Maintenance.h
+    int maintenanceInterval = 300;
+    int offlineRetentionDays = 0;   // 0 keeps offline messages until delivered
+    int maintenanceBatch = 500;     // rows per write transaction
+    int maintenancePauseMs = 20;    // between transactions
+    int vacuumPages = 64;           // pages per incremental vacuum step
+    // Cold tier for posts (needs maintenance), "" for none: posts older
+    // than archiveAfterDays move there archiveBatch at a time
+    std::string archiveDir;
+    int archiveAfterDays = 30;
+    int archiveBatch = 10000;
+    // Attachments: content-addressed files in blobDir, "" to disable;
+    // uploads up to maxAttachment bytes, which binary DOWNLOAD sends as one
+    // frame (so at most Protocol::MAX_SINGLE_FIELD)
+    std::string blobDir;
+    size_t maxAttachment = Protocol::MAX_SINGLE_FIELD;
+    std::string logLevel = "info";
+    int logRateLimit = 20; // records / second for the same event
+
+    // Seconds; 0 disables the check
+    int idleTimeout = 90;        // close connections silent for this long
+    int heartbeatInterval = 30;  // send PING after this much silence
+    int loginTimeout = 0;        // close connections that never log in
+
+    // Outbound buffering (bytes)
+    size_t outBudget = 1 << 20;          // per connection, slow-consumer policies kick in above it
+    size_t outHardLimit = 8 << 20;       // per connection, "disconnect" policy threshold
+    size_t memoryHighWater = 256 << 20;  // all connections together, load shedding above it
+    // Any of: pause (stop reading the client), drop (presence pushes),
+    // spill (chat to offline_messages), disconnect
+    std::string slowPolicy = "pause,drop,spill,disconnect";
+
+    int presenceInterval = 500;  // ms between presence digests
+
+    // Binary responses at least this big are deflated for clients that
+    // asked for it (HELLO BINARY DEFLATE); 0 disables compression
+    size_t compressThreshold = 512;
+
+    size_t profileCacheBytes = 16 << 20;  // rendered VIEW_POSTS results kept in memory
+
+    // Seconds a dropped session stays resumable (RESUME); 0 disables tokens.
+    // Replay windows of all sessions together are kept within replayBudget
+    // bytes, apart from the outbound buffering limits above.
+    int resumeGrace = 60;
+    size_t replayBudget = 64 << 20;
+
+    // Cluster mode: this node's id and the other nodes, "id@host:port,...",
+    // port being each node's peer port. All nodes must use the same SQLite
+    // file. Node links are only taken on the peer port and are not
+    // authenticated, so keep it on a trusted network (clients never need it).
+    int nodeId = 0;
+    std::vector<PeerNode> peers;
+    int peerPort = 0;
+
+    static bool parsePeers(const std::string& list, std::vector<PeerNode>& out) {
+        size_t start = 0;
+        while (start < list.size()) {
+            size_t end = list.find(',', start);
+            if (end == std::string::npos) end = list.size();
+            std::string item = list.substr(start, end - start);
+            start = end + 1;
+            size_t at = item.find('@'), colon = item.rfind(':');
+            if (at == std::string::npos || colon == std::string::npos || colon < at) return false;
+            PeerNode peer{std::atoi(item.substr(0, at).c_str()), item.substr(at + 1, colon - at - 1),
+                          std::atoi(item.substr(colon + 1).c_str())};
+            if (peer.id <= 0 || peer.host.empty() || peer.port <= 0) return false;
+            out.push_back(peer);
+        }
+        return true;
+    }
+
+    bool hasSlowPolicy(const std::string& name) const {
+        return ("," + slowPolicy + ",").find("," + name + ",") != std::string::npos;
+    }
+
+    // Returns false on an unknown argument
+    bool parseArgs(int argc, char* argv[]) {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg.rfind("--", 0) != 0) {
+                std::cerr << "Unknown argument: " << arg << std::endl;
+                return false;
+            }
+            std::string key = arg.substr(2), value;
+            size_t eq = key.find('=');
+            if (eq != std::string::npos) {
+                value = key.substr(eq + 1);
+                key = key.substr(0, eq);
+            }
+
+            if (key == "port") port = std::atoi(value.c_str());
+            else if (key == "db") dbPath = value;
+            else if (key == "storage") storage = value;
+            else if (key == "shards") shards = std::atoi(value.c_str());
+            else if (key == "snapshot") snapshotPath = value;
+            else if (key == "snapshot-interval") snapshotInterval = std::atoi(value.c_str());
+            else if (key == "changelog") changelogDir = value;
+            else if (key == "changelog-segment-bytes") changelogSegmentBytes = std::strtoull(value.c_str(), nullptr, 10);
+            else if (key == "changelog-segments") changelogSegments = std::atoi(value.c_str());
+            else if (key == "replication-socket") replicationSocket = value;
+            else if (key == "standby-of") standbyOf = value;
+            else if (key == "max-staleness") maxStaleness = std::atoi(value.c_str());
+            else if (key == "backup-dir") backupDir = value;
+            else if (key == "backup-interval") backupInterval = std::atoi(value.c_str());
+            else if (key == "backup-pages") backupPages = std::atoi(value.c_str());
+            else if (key == "backup-pause-ms") backupPauseMs = std::atoi(value.c_str());
+            else if (key == "maintenance-interval") maintenanceInterval = std::atoi(value.c_str());
+            else if (key == "offline-retention-days") offlineRetentionDays = std::atoi(value.c_str());
+            else if (key == "maintenance-batch") maintenanceBatch = std::atoi(value.c_str());
+            else if (key == "maintenance-pause-ms") maintenancePauseMs = std::atoi(value.c_str());
+            else if (key == "vacuum-pages") vacuumPages = std::atoi(value.c_str());
+            else if (key == "archive-dir") archiveDir = value;
+            else if (key == "archive-after-days") archiveAfterDays = std::atoi(value.c_str());
+            else if (key == "archive-batch") archiveBatch = std::atoi(value.c_str());
+            else if (key == "blob-dir") blobDir = value;
+            else if (key == "max-attachment") maxAttachment = std::strtoull(value.c_str(), nullptr, 10);
+            else if (key == "log-level") logLevel = value;
+            else if (key == "log-rate-limit") logRateLimit = std::atoi(value.c_str());
+            else if (key == "idle-timeout") idleTimeout = std::atoi(value.c_str());
+            else if (key == "heartbeat-interval") heartbeatInterval = std::atoi(value.c_str());
+            else if (key == "login-timeout") loginTimeout = std::atoi(value.c_str());
+            else if (key == "out-budget") outBudget = std::strtoull(value.c_str(), nullptr, 10);
+            else if (key == "out-hard-limit") outHardLimit = std::strtoull(value.c_str(), nullptr, 10);
+            else if (key == "memory-high-water") memoryHighWater = std::strtoull(value.c_str(), nullptr, 10);
+            else if (key == "slow-policy") slowPolicy = value;
+            else if (key == "presence-interval") presenceInterval = std::atoi(value.c_str());
+            else if (key == "profile-cache-bytes") profileCacheBytes = std::strtoull(value.c_str(), nullptr, 10);
+            else if (key == "resume-grace") resumeGrace = std::atoi(value.c_str());
+            else if (key == "replay-budget") replayBudget = std::strtoull(value.c_str(), nullptr, 10);
+            else if (key == "node-id") nodeId = std::atoi(value.c_str());
+            else if (key == "peer-port") peerPort = std::atoi(value.c_str());
+            else if (key == "peers") {
+                if (!parsePeers(value, peers)) {
+                    std::cerr << "Bad --peers: " << value << " (id@host:port,...)" << std::endl;
+                    return false;
+                }
+            }
+            else if (key == "compress-threshold") compressThreshold = std::strtoull(value.c_str(), nullptr, 10);
+            else {
+                std::cerr << "Unknown option: --" << key << std::endl;
+                return false;
+            }
+        }
+        if (storage != "sqlite" && storage != "sharded" && storage != "memory") {
+            std::cerr << "Unknown storage: " << storage << " (sqlite, sharded or memory)" << std::endl;
+            return false;
+        }
+        if (!changelogDir.empty() && storage != "sqlite") {
+            std::cerr << "--changelog needs --storage=sqlite" << std::endl;
+            return false;
+        }
+        if (!replicationSocket.empty() && changelogDir.empty()) {
+            std::cerr << "--replication-socket needs --changelog" << std::endl;
+            return false;
+        }
+        if (!backupDir.empty() && storage != "sqlite") {
+            std::cerr << "--backup-dir needs --storage=sqlite" << std::endl;
+            return false;
+        }
+        if (backupInterval > 0 && backupDir.empty()) {
+            std::cerr << "--backup-interval needs --backup-dir" << std::endl;
+            return false;
+        }
+        if (!archiveDir.empty() && (storage != "sqlite" || maintenanceInterval <= 0)) {
+            std::cerr << "--archive-dir needs --storage=sqlite and --maintenance-interval" << std::endl;
+            return false;
+        }
+        if (maxAttachment > Protocol::MAX_SINGLE_FIELD) {
+            std::cerr << "--max-attachment can be at most " << Protocol::MAX_SINGLE_FIELD << " (one protocol frame)" << std::endl;
+            return false;
+        }
+        if (!standbyOf.empty() && (storage != "sqlite" || !peers.empty())) {
+            std::cerr << "--standby-of needs --storage=sqlite and no --peers" << std::endl;
+            return false;
+        }
+        if (!peers.empty()) {
+            if (nodeId <= 0) {
+                std::cerr << "--peers needs --node-id (a positive number)" << std::endl;
+                return false;
+            }
+            if (peerPort <= 0 || peerPort == port) {
+                std::cerr << "--peers needs --peer-port (not the client port)" << std::endl;
+                return false;
+            }
+            if (storage != "sqlite") {
+                std::cerr << "Cluster mode needs --storage=sqlite (one file shared by all nodes)" << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+#endif
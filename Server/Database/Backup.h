@@ -0,0 +1,112 @@
+#ifndef BACKUP_H
+#define BACKUP_H
+
+#include <sqlite3.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include "Logger.h"
+
+// Online backup of the SQLite database into --backup-dir (BACKUP <name>,
+// --backup-interval).
+//
+// A background thread opens its own connection and copies the file with
+// sqlite3_backup_step, a few pages at a time with a pause in between, so
+// the event loop's writes only ever wait for one short step. The copy is
+// taken inside one read transaction: with WAL that pins a consistent
+// snapshot, and writes made meanwhile neither block it nor make it start
+// over. It is written to <path>.tmp and renamed when complete.
+class BackupJob {
+private:
+    std::string dbPath;
+    int pagesPerStep;
+    int pauseMs;
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::atomic<bool> stopping{false};
+
+    std::atomic<uint64_t> pagesDone{0};
+    std::atomic<uint64_t> pagesTotal{0};
+    std::atomic<uint64_t> lastDurationMs{0};
+    std::atomic<uint64_t> completed{0};
+    std::atomic<uint64_t> failed{0};
+
+    bool copy(const std::string& target) {
+        sqlite3* src = nullptr;
+        sqlite3* dest = nullptr;
+        bool ok = sqlite3_open_v2(dbPath.c_str(), &src, SQLITE_OPEN_READWRITE, nullptr) == SQLITE_OK &&
+                  sqlite3_open(target.c_str(), &dest) == SQLITE_OK;
+        if (ok) {
+            sqlite3_busy_timeout(src, 5000);
+            ok = sqlite3_exec(src, "BEGIN; SELECT COUNT(*) FROM sqlite_master;", nullptr, nullptr, nullptr) == SQLITE_OK;
+        }
+        sqlite3_backup* backup = ok ? sqlite3_backup_init(dest, "main", src, "main") : nullptr;
+        int rc = SQLITE_ERROR;
+        if (backup) {
+            while (!stopping) {
+                rc = sqlite3_backup_step(backup, pagesPerStep);
+                pagesTotal = static_cast<uint64_t>(sqlite3_backup_pagecount(backup));
+                pagesDone = pagesTotal - static_cast<uint64_t>(sqlite3_backup_remaining(backup));
+                if (rc != SQLITE_OK && rc != SQLITE_BUSY && rc != SQLITE_LOCKED) break;
+                std::this_thread::sleep_for(std::chrono::milliseconds(pauseMs));
+            }
+            sqlite3_backup_finish(backup);
+        }
+        if (rc != SQLITE_DONE) {
+            Logger::error("backup_failed", {{"path", target}, {"error", sqlite3_errmsg(backup ? dest : src)}});
+        }
+        if (src) sqlite3_exec(src, "COMMIT;", nullptr, nullptr, nullptr);
+        sqlite3_close(src);
+        sqlite3_close(dest);
+        return rc == SQLITE_DONE;
+    }
+
+    void run(std::string path) {
+        auto start = std::chrono::steady_clock::now();
+        std::string tmp = path + ".tmp";
+        std::remove(tmp.c_str());
+        bool ok = copy(tmp) && std::rename(tmp.c_str(), path.c_str()) == 0;
+        if (!ok) std::remove(tmp.c_str());
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        lastDurationMs = static_cast<uint64_t>(elapsed.count());
+        (ok ? completed : failed)++;
+        if (ok) {
+            Logger::info("backup_done", {{"path", path}, {"pages", std::to_string(pagesTotal.load())},
+                                         {"ms", std::to_string(lastDurationMs.load())}});
+        }
+        running = false;
+    }
+
+public:
+    BackupJob(const std::string& path, int pagesPerStep, int pauseMs)
+        : dbPath(path), pagesPerStep(pagesPerStep > 0 ? pagesPerStep : 1), pauseMs(pauseMs >= 0 ? pauseMs : 0) {}
+
+    ~BackupJob() {
+        stopping = true;
+        if (thread.joinable()) thread.join();
+    }
+
+    // False if a backup is still running
+    bool start(const std::string& path) {
+        if (running) return false;
+        if (thread.joinable()) thread.join();
+        running = true;
+        pagesDone = 0;
+        pagesTotal = 0;
+        Logger::info("backup_started", {{"path", path}});
+        thread = std::thread(&BackupJob::run, this, path);
+        return true;
+    }
+
+    bool isRunning() const { return running; }
+    uint64_t progressPages() const { return pagesDone; }
+    uint64_t totalPages() const { return pagesTotal; }
+    uint64_t durationMs() const { return lastDurationMs; }
+    uint64_t succeeded() const { return completed; }
+    uint64_t failures() const { return failed; }
+};
+
+#endif
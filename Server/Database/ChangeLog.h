@@ -0,0 +1,343 @@
+#ifndef CHANGE_LOG_H
+#define CHANGE_LOG_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Logger.h"
+#include "Protocol.h"
+
+// What a change log record describes; its fields, in order, follow
+enum class ChangeKind : uint16_t {
+    UserRegistered = 1,      // INT id, username, password, INT role
+    UserDeleted = 2,         // username
+    FriendRequested = 3,     // INT from, INT to, INT type
+    FriendAccepted = 4,      // INT accepting user, INT requester
+    GroupCreated = 5,        // INT id, name, INT creator
+    GroupMemberAdded = 6,    // INT group, INT user
+    PostCreated = 7,         // INT id, INT author, INT visibility, content
+    PostDeleted = 8,         // INT id, INT author
+    OfflineStored = 9,       // INT target, sender, content, INT is group, INT group id
+    OfflineDelivered = 10,   // INT target (its offline messages were read and removed)
+    HistoryAppended = 11,    // INT conversation, INT seq, sender, content, sent at
+    RowsDeleted = 12,        // table, INT key columns (k), then k INTs per row removed by maintenance
+    PostsArchived = 13       // INT post ids moved from posts to the archive (they still exist)
+};
+
+// One record as it sits in the mapped segment; data points into the
+// mapping and stays valid as long as the reader that returned it
+struct ChangeRecord {
+    uint64_t seq = 0;
+    ChangeKind kind = ChangeKind::UserRegistered;
+    const unsigned char* data = nullptr;   // fields, encoded as in Protocol.h
+    size_t size = 0;
+
+    bool fields(std::vector<Protocol::Field>& out) const { return Protocol::decodeFields(data, size, out); }
+};
+
+// Append-only log of every write made through DatabaseManager
+// (--changelog=<dir>), for consumers that should not poll the tables:
+// search indexers, analytics, cache warmers, replicas.
+//
+// The log is a series of segment files, changes-<first seq>.log, each
+// created at its full size and mapped shared. A record is
+//
+//   u32 size      payload bytes; 0 = not written yet, END = go to the next segment
+//   u16 kind      ChangeKind
+//   u16 reserved
+//   u64 seq       1, 2, 3, ... across segments
+//   payload       padded to 8 bytes
+//
+// in host byte order: the log is for processes on the same machine. The
+// size is stored last, with release ordering, so a reader that sees it
+// also sees the rest of the record. Readers map the same files and parse
+// records in place (ChangeLogReader), without a copy and without talking
+// to the server.
+//
+// Records reach the page cache, not the disk: they survive the server
+// crashing but not the machine. Only the newest maxSegments files are
+// kept; a reader that falls further behind than that skips ahead.
+class ChangeLog {
+public:
+    static constexpr uint32_t END = 0xFFFFFFFFu;
+    static constexpr size_t HEADER_BYTES = 16;   // magic, first seq
+    static constexpr size_t RECORD_HEADER = 16;
+    static constexpr const char* MAGIC = "VSOCCDC1";
+
+    static size_t recordBytes(uint32_t payload) { return RECORD_HEADER + ((size_t(payload) + 7) & ~size_t(7)); }
+
+    static std::string segmentPath(const std::string& dir, uint64_t firstSeq) {
+        char name[48];
+        std::snprintf(name, sizeof(name), "changes-%020llu.log", static_cast<unsigned long long>(firstSeq));
+        return dir + "/" + name;
+    }
+
+    // First seqs of the segments in dir, oldest first
+    static std::vector<uint64_t> listSegments(const std::string& dir) {
+        std::vector<uint64_t> seqs;
+        DIR* d = opendir(dir.c_str());
+        if (!d) return seqs;
+        while (struct dirent* entry = readdir(d)) {
+            unsigned long long seq;
+            char tail[8];
+            if (std::sscanf(entry->d_name, "changes-%20llu.%4s", &seq, tail) == 2 && std::strcmp(tail, "log") == 0) {
+                seqs.push_back(seq);
+            }
+        }
+        closedir(d);
+        std::sort(seqs.begin(), seqs.end());
+        return seqs;
+    }
+
+private:
+    std::string dir;
+    size_t segmentBytes;
+    size_t maxSegments;
+    std::mutex mutex;   // sharded storage appends from several threads
+
+    unsigned char* map = nullptr;
+    size_t mapSize = 0;
+    size_t offset = 0;
+    uint64_t segmentFirst = 0;
+    uint64_t nextSeq = 1;
+    uint64_t segmentCount = 0;
+    std::atomic<bool> broken{false};
+
+    void unmap() {
+        if (map) munmap(map, mapSize);
+        map = nullptr;
+    }
+
+    bool openSegment(uint64_t firstSeq, size_t size, bool create) {
+        unmap();
+        std::string path = segmentPath(dir, firstSeq);
+        int fd = open(path.c_str(), create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0644);
+        if (fd < 0) return false;
+        struct stat st;
+        if (create ? ftruncate(fd, static_cast<off_t>(size)) != 0 : fstat(fd, &st) != 0) {
+            close(fd);
+            return false;
+        }
+        if (!create) size = static_cast<size_t>(st.st_size);
+        void* p = size >= HEADER_BYTES ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        close(fd);
+        if (p == MAP_FAILED) return false;
+        map = static_cast<unsigned char*>(p);
+        mapSize = size;
+        segmentFirst = firstSeq;
+        offset = HEADER_BYTES;
+        if (create) {
+            std::memcpy(map, MAGIC, 8);
+            std::memcpy(map + 8, &firstSeq, 8);
+        }
+        return true;
+    }
+
+    // Finds the end of the newest segment after a restart. A record whose
+    // size was never stored is simply written over.
+    bool recover(uint64_t firstSeq) {
+        if (!openSegment(firstSeq, 0, false) || std::memcmp(map, MAGIC, 8) != 0) return false;
+        nextSeq = firstSeq;
+        while (offset + RECORD_HEADER <= mapSize) {
+            uint32_t size = __atomic_load_n(reinterpret_cast<uint32_t*>(map + offset), __ATOMIC_ACQUIRE);
+            if (size == 0) return true;
+            if (size == END) return rotate(0);
+            std::memcpy(&nextSeq, map + offset + 8, 8);
+            nextSeq++;
+            offset += recordBytes(size);
+        }
+        return rotate(0);
+    }
+
+    // Closes the current segment and starts one with room for at least need bytes
+    bool rotate(size_t need) {
+        if (map && offset + 4 <= mapSize) __atomic_store_n(reinterpret_cast<uint32_t*>(map + offset), END, __ATOMIC_RELEASE);
+        if (!openSegment(nextSeq, std::max(segmentBytes, HEADER_BYTES + need + 4), true)) {
+            Logger::error("changelog_segment_failed", {{"path", segmentPath(dir, nextSeq)}});
+            return false;
+        }
+        segmentCount++;
+        std::vector<uint64_t> segments = listSegments(dir);
+        for (size_t i = 0; i + maxSegments < segments.size(); i++) {
+            // Readers that still map it keep their copy
+            unlink(segmentPath(dir, segments[i]).c_str());
+        }
+        return true;
+    }
+
+public:
+    ChangeLog(const std::string& directory, size_t segmentSize, size_t keepSegments)
+        : dir(directory), segmentBytes(std::max(segmentSize, size_t(4096))), maxSegments(std::max(keepSegments, size_t(1))) {
+        mkdir(dir.c_str(), 0755);
+        std::vector<uint64_t> segments = listSegments(dir);
+        bool ok = segments.empty() ? rotate(0) : recover(segments.back());
+        if (!ok) {
+            Logger::error("changelog_open_failed", {{"dir", dir}});
+            unmap();
+            return;
+        }
+        Logger::info("changelog_opened", {{"dir", dir}, {"next_seq", std::to_string(nextSeq)}});
+    }
+
+    ~ChangeLog() { unmap(); }
+
+    bool isOpen() const { return map != nullptr; }
+
+    // Returns the record's seq, 0 if it could not be written
+    uint64_t append(ChangeKind kind, const std::vector<Protocol::Field>& fields) {
+        std::string payload = Protocol::encodeFields(fields);
+        size_t bytes = recordBytes(static_cast<uint32_t>(payload.size()));
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!map) return 0;
+        // Keep 4 bytes for the END marker
+        if (offset + bytes + 4 > mapSize && !rotate(bytes)) return 0;
+
+        unsigned char* record = map + offset;
+        uint16_t k = static_cast<uint16_t>(kind);
+        std::memcpy(record + 4, &k, 2);
+        std::memset(record + 6, 0, 2);
+        std::memcpy(record + 8, &nextSeq, 8);
+        std::memcpy(record + RECORD_HEADER, payload.data(), payload.size());
+        __atomic_store_n(reinterpret_cast<uint32_t*>(record), static_cast<uint32_t>(payload.size()), __ATOMIC_RELEASE);
+        offset += bytes;
+        return nextSeq++;
+    }
+
+    // A record was written for a change that then failed to commit: the
+    // log no longer matches the database, so replication stops (standbys
+    // need a fresh copy). Other consumers keep reading.
+    void markBroken(const char* reason) {
+        if (!broken.exchange(true)) Logger::error("changelog_broken", {{"reason", reason}, {"seq", std::to_string(lastSeq())}});
+    }
+    bool isBroken() const { return broken; }
+
+    // Seq of the newest record, 0 if there is none
+    uint64_t lastSeq() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return nextSeq - 1;
+    }
+
+    uint64_t segmentsCreated() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return segmentCount;
+    }
+
+    const std::string& directory() const { return dir; }
+};
+
+// Tails a change log from another thread or process. next() returns the
+// records in seq order and false once it has caught up; call it again
+// later for more. Records point into the reader's own read-only mappings.
+class ChangeLogReader {
+private:
+    std::string dir;
+    const unsigned char* map = nullptr;
+    size_t mapSize = 0;
+    size_t offset = 0;
+    uint64_t segmentFirst = 0;
+    uint64_t expected;    // seq the caller asked for next
+    uint64_t skipped = 0;
+    bool corrupt = false;   // logged for the current segment
+
+    void unmap() {
+        if (map) munmap(const_cast<unsigned char*>(map), mapSize);
+        map = nullptr;
+    }
+
+    bool openSegment(uint64_t firstSeq) {
+        int fd = open(ChangeLog::segmentPath(dir, firstSeq).c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        void* p = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= ChangeLog::HEADER_BYTES) {
+            p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (p == MAP_FAILED) return false;
+        unmap();
+        map = static_cast<const unsigned char*>(p);
+        mapSize = static_cast<size_t>(st.st_size);
+        offset = ChangeLog::HEADER_BYTES;
+        segmentFirst = firstSeq;
+        corrupt = false;
+        return true;
+    }
+
+    bool nextSegment() {
+        std::vector<uint64_t> segments = ChangeLog::listSegments(dir);
+        auto later = std::upper_bound(segments.begin(), segments.end(), segmentFirst);
+        return later != segments.end() && openSegment(*later);
+    }
+
+    // The segment holding seq, or the oldest one left if seq was deleted
+    bool seek(uint64_t seq) {
+        std::vector<uint64_t> segments = ChangeLog::listSegments(dir);
+        if (segments.empty()) return false;
+        size_t i = 0;
+        while (i + 1 < segments.size() && segments[i + 1] <= seq) i++;
+        return openSegment(segments[i]);
+    }
+
+public:
+    // fromSeq: first record wanted (1 = everything still kept)
+    ChangeLogReader(const std::string& directory, uint64_t fromSeq) : dir(directory), expected(std::max<uint64_t>(fromSeq, 1)) {}
+    ~ChangeLogReader() { unmap(); }
+    ChangeLogReader(const ChangeLogReader&) = delete;
+    ChangeLogReader& operator=(const ChangeLogReader&) = delete;
+
+    bool next(ChangeRecord& out) {
+        if (!map && !seek(expected)) return false;
+        while (true) {
+            if (offset + ChangeLog::RECORD_HEADER > mapSize) return false;
+            uint32_t size = __atomic_load_n(reinterpret_cast<const uint32_t*>(map + offset), __ATOMIC_ACQUIRE);
+            if (size == 0) return false;
+            if (size == ChangeLog::END) {
+                if (!nextSegment()) return false;
+                continue;
+            }
+            // A record running past the end of the file means the segment
+            // is damaged: the rest of it is lost (counted in missed())
+            if (offset + ChangeLog::recordBytes(size) > mapSize) {
+                if (!corrupt) {
+                    Logger::error("changelog_corrupt", {{"path", ChangeLog::segmentPath(dir, segmentFirst)},
+                                                        {"offset", std::to_string(offset)}});
+                }
+                corrupt = true;
+                if (!nextSegment()) return false;
+                continue;
+            }
+            const unsigned char* record = map + offset;
+            offset += ChangeLog::recordBytes(size);
+            uint64_t seq;
+            std::memcpy(&seq, record + 8, 8);
+            if (seq < expected) continue;
+            if (seq > expected) skipped += seq - expected;   // deleted before we got to it
+            uint16_t kind;
+            std::memcpy(&kind, record + 4, 2);
+            out.seq = seq;
+            out.kind = static_cast<ChangeKind>(kind);
+            out.data = record + ChangeLog::RECORD_HEADER;
+            out.size = size;
+            expected = seq + 1;
+            return true;
+        }
+    }
+
+    uint64_t nextSeq() const { return expected; }
+    // Records lost because their segment was deleted first
+    uint64_t missed() const { return skipped; }
+};
+
+#endif
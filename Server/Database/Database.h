@@ -2,19 +2,98 @@
 #define DATABASE_H
 
 #include <sqlite3.h>
+#include <algorithm>
 #include <string>
 #include <vector>
-#include <iostream>
-
-class DatabaseManager {
+#include <unordered_map>
+#include <utility>
+#include "Logger.h"
+#include "Storage.h"
+#include "ChangeLog.h"
+#include "PostArchive.h"
+
+// SQLite engine behind Storage
+class DatabaseManager : public Storage {
 private:
     sqlite3* db;
+    ChangeLog* changeLog = nullptr;
+    PostArchive* archive = nullptr;
+    bool changeOpen = false;   // beginChange() started the current transaction
+    bool changeLogged = false; // and a record was appended in it
+
+    // With a change log, a write runs in a transaction of its own and its
+    // record is appended before COMMIT: a change whose record cannot be
+    // written is rolled back, so the log never misses a committed change.
+    // If COMMIT then fails, the log holds a change that did not happen and
+    // is marked broken. Inside a caller's transaction nothing is started.
+    bool beginChange() {
+        if (!changeLog || !sqlite3_get_autocommit(db)) return true;
+        changeOpen = executeQuery("BEGIN IMMEDIATE;");
+        changeLogged = false;
+        return changeOpen;
+    }
+
+    // Between the statement and endChange(); false if the record was not written
+    bool logChange(ChangeKind kind, const std::vector<Protocol::Field>& fields) {
+        if (!changeLog) return true;
+        if (changeLog->append(kind, fields) == 0) {
+            Logger::error("changelog_append_failed", {{"kind", std::to_string(static_cast<int>(kind))}});
+            return false;
+        }
+        changeLogged = true;
+        return true;
+    }
+
+    // Commits (ok) or rolls back the change; returns whether it took effect
+    bool endChange(bool ok) {
+        if (!changeOpen) return ok;
+        changeOpen = false;
+        if (ok && executeQuery("COMMIT;")) return true;
+        if (!sqlite3_get_autocommit(db)) executeQuery("ROLLBACK;");
+        if (ok && changeLogged) changeLog->markBroken("commit_failed");
+        return false;
+    }
+
+    bool tableExists(const std::string& name) {
+        sqlite3_stmt* stmt;
+        bool found = false;
+        if (sqlite3_prepare_v2(db, "SELECT 1 FROM sqlite_master WHERE name = ?;", -1, &stmt, 0) == SQLITE_OK) {
+            sqlite3_bind_text(stmt, 1, name.c_str(), -1, SQLITE_TRANSIENT);
+            found = (sqlite3_step(stmt) == SQLITE_ROW);
+        }
+        sqlite3_finalize(stmt);
+        return found;
+    }
+
+    bool columnExists(const std::string& table, const std::string& column) {
+        sqlite3_stmt* stmt;
+        bool found = false;
+        std::string sql = "SELECT 1 FROM pragma_table_info('" + table + "') WHERE name = ?;";
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
+            sqlite3_bind_text(stmt, 1, column.c_str(), -1, SQLITE_TRANSIENT);
+            found = (sqlite3_step(stmt) == SQLITE_ROW);
+        }
+        sqlite3_finalize(stmt);
+        return found;
+    }
+
+    // Archived posts are immutable; deleting one leaves a row here
+    bool isArchivedDeletion(int postId) {
+        sqlite3_stmt* stmt;
+        bool found = false;
+        if (sqlite3_prepare_v2(db, "SELECT 1 FROM archived_deletions WHERE post_id = ?;", -1, &stmt, 0) == SQLITE_OK) {
+            sqlite3_bind_int(stmt, 1, postId);
+            found = (sqlite3_step(stmt) == SQLITE_ROW);
+        }
+        sqlite3_finalize(stmt);
+        return found;
+    }
 
     // Helper pentru execuții simple
     bool executeQuery(const std::string& query) {
         char* errMsg = 0;
         if (sqlite3_exec(db, query.c_str(), 0, 0, &errMsg) != SQLITE_OK) {
-            std::cerr << "SQL Error: " << errMsg << " | Query: " << query << std::endl;
+            Logger::error("sql_error", {{"error", errMsg}, {"query", query}});
             sqlite3_free(errMsg);
             return false;
         }
@@ -24,10 +103,17 @@ private:
 public:
     DatabaseManager(const std::string& dbName) {
         if (sqlite3_open(dbName.c_str(), &db) != SQLITE_OK) {
-            std::cerr << "Can't open database: " << sqlite3_errmsg(db) << std::endl;
+            Logger::error("db_open_failed", {{"path", dbName}, {"error", sqlite3_errmsg(db)}});
             return;
         }
 
+        // WAL lets the query worker's connection read while this one writes
+        sqlite3_busy_timeout(db, 5000);
+        // Lets maintenance give freed pages back a few at a time; only takes
+        // effect on a database that has no tables yet
+        executeQuery("PRAGMA auto_vacuum=INCREMENTAL;");
+        executeQuery("PRAGMA journal_mode=WAL;");
+
         // 1. Tabel USERS
         executeQuery("CREATE TABLE IF NOT EXISTS users ("
                      "id INTEGER PRIMARY KEY AUTOINCREMENT, "
@@ -51,7 +137,30 @@ public:
                      "id INTEGER PRIMARY KEY AUTOINCREMENT, "
                      "user_id INTEGER, "
                      "content TEXT, "
-                     "visibility INTEGER DEFAULT 0);");
+                     "visibility INTEGER DEFAULT 0, "
+                     "created_at INTEGER);");   // unix seconds, for --archive-after-days
+        if (!columnExists("posts", "created_at")) {
+            // Database from before the column: its posts count as written now
+            executeQuery("ALTER TABLE posts ADD COLUMN created_at INTEGER;");
+            executeQuery("UPDATE posts SET created_at = CAST(strftime('%s', 'now') AS INTEGER);");
+        }
+        executeQuery("CREATE TABLE IF NOT EXISTS archived_deletions (post_id INTEGER PRIMARY KEY);");
+
+        // 3b. Index FTS5 peste posts (external content, tinut la zi de triggere)
+        bool ftsExisted = tableExists("posts_fts");
+        executeQuery("CREATE VIRTUAL TABLE IF NOT EXISTS posts_fts USING fts5("
+                     "content, content='posts', content_rowid='id');");
+        executeQuery("CREATE TRIGGER IF NOT EXISTS posts_fts_insert AFTER INSERT ON posts BEGIN "
+                     "INSERT INTO posts_fts(rowid, content) VALUES (new.id, new.content); END;");
+        executeQuery("CREATE TRIGGER IF NOT EXISTS posts_fts_delete AFTER DELETE ON posts BEGIN "
+                     "INSERT INTO posts_fts(posts_fts, rowid, content) VALUES ('delete', old.id, old.content); END;");
+        executeQuery("CREATE TRIGGER IF NOT EXISTS posts_fts_update AFTER UPDATE OF content ON posts BEGIN "
+                     "INSERT INTO posts_fts(posts_fts, rowid, content) VALUES ('delete', old.id, old.content); "
+                     "INSERT INTO posts_fts(rowid, content) VALUES (new.id, new.content); END;");
+        if (!ftsExisted) {
+            // Database from before the index: add the posts it already has
+            executeQuery("INSERT INTO posts_fts(posts_fts) VALUES ('rebuild');");
+        }
 
         // 4. Tabel GROUPS
         executeQuery("CREATE TABLE IF NOT EXISTS groups ("
@@ -76,29 +185,66 @@ public:
                      "timestamp DATETIME DEFAULT CURRENT_TIMESTAMP, "
                      "is_group_msg INTEGER DEFAULT 0, "
                      "source_group_id INTEGER DEFAULT -1);");
+
+        // 7. Tabel MESSAGE HISTORY
+        // Clustered by (conversation, seq): a page of one conversation is a
+        // run of adjacent rows
+        executeQuery("CREATE TABLE IF NOT EXISTS message_history ("
+                     "conversation INTEGER NOT NULL, "
+                     "seq INTEGER NOT NULL, "
+                     "sender_name TEXT NOT NULL, "
+                     "content TEXT NOT NULL, "
+                     "sent_at TEXT NOT NULL, "
+                     "PRIMARY KEY (conversation, seq)) WITHOUT ROWID;");
     }
 
     ~DatabaseManager() {
         sqlite3_close(db);
     }
 
+    // Every write made through this connection is appended to log from now on
+    void setChangeLog(ChangeLog* log) { changeLog = log; }
+    // Posts up to archive->maxPostId() are read from the archive from now on
+    void setArchive(PostArchive* postArchive) { archive = postArchive; }
+
     // --- USER MANAGEMENT ---
 
-    bool registerUser(const std::string& username, const std::string& password, int role) {
+    bool registerUser(const std::string& username, const std::string& password, int role) override {
         std::string sql = "INSERT INTO users (username, password, role) VALUES (?, ?, ?);";
         sqlite3_stmt* stmt;
-        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) return false;
+        if (!beginChange()) return false;
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) return endChange(false);
 
         sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_STATIC);
         sqlite3_bind_text(stmt, 2, password.c_str(), -1, SQLITE_STATIC);
         sqlite3_bind_int(stmt, 3, role);
 
+        bool success = (sqlite3_step(stmt) == SQLITE_DONE);
+        sqlite3_finalize(stmt);
+        if (success) {
+            success = logChange(ChangeKind::UserRegistered, {Protocol::Field::integer(sqlite3_last_insert_rowid(db)), Protocol::Field::text(username),
+                                                             Protocol::Field::text(password), Protocol::Field::integer(role)});
+        }
+        return endChange(success);
+    }
+
+    // Copy of a user row made elsewhere (sharded storage keeps one per shard)
+    bool insertUser(int id, const std::string& username, const std::string& password, int role) {
+        std::string sql = "INSERT OR REPLACE INTO users (id, username, password, role) VALUES (?, ?, ?, ?);";
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) return false;
+
+        sqlite3_bind_int(stmt, 1, id);
+        sqlite3_bind_text(stmt, 2, username.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 3, password.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 4, role);
+
         bool success = (sqlite3_step(stmt) == SQLITE_DONE);
         sqlite3_finalize(stmt);
         return success;
     }
 
-    bool checkLogin(const std::string& username, const std::string& password) {
+    bool checkLogin(const std::string& username, const std::string& password) override {
         std::string sql = "SELECT id FROM users WHERE username = ? AND password = ?;";
         sqlite3_stmt* stmt;
         if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) return false;
@@ -111,7 +257,10 @@ public:
         return success;
     }
 
-    int getUserId(const std::string& username) {
+    // Id of the row the last successful INSERT created on this connection
+    int lastInsertId() override { return static_cast<int>(sqlite3_last_insert_rowid(db)); }
+
+    int getUserId(const std::string& username) override {
         std::string sql = "SELECT id FROM users WHERE username = ?;";
         sqlite3_stmt* stmt;
         int id = -1;
@@ -125,7 +274,7 @@ public:
         return id;
     }
 
-    bool isAdmin(int userId) {
+    bool isAdmin(int userId) override {
         std::string sql = "SELECT role FROM users WHERE id = ?;";
         sqlite3_stmt* stmt;
         bool admin = false;
@@ -139,23 +288,58 @@ public:
         return admin;
     }
 
-    bool deleteUser(const std::string& username) {
+    bool deleteUser(const std::string& username) override {
         std::string sql = "DELETE FROM users WHERE username = ?;";
         sqlite3_stmt* stmt;
-        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) return false;
+        if (!beginChange()) return false;
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) return endChange(false);
         sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_STATIC);
         bool success = (sqlite3_step(stmt) == SQLITE_DONE);
         sqlite3_finalize(stmt);
-        return success;
+        if (success) success = logChange(ChangeKind::UserDeleted, {Protocol::Field::text(username)});
+        return endChange(success);
+    }
+
+    // (id, username) of every user, for the in-memory username index
+    std::vector<std::pair<int, std::string>> getAllUsers() override {
+        std::vector<std::pair<int, std::string>> result;
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, "SELECT id, username FROM users;", -1, &stmt, 0) == SQLITE_OK) {
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                result.emplace_back(sqlite3_column_int(stmt, 0),
+                                    reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)));
+            }
+        }
+        sqlite3_finalize(stmt);
+        return result;
     }
 
     // --- FRIENDSHIPS (Acum folosim tabela 'friendships') ---
 
-    bool sendFriendRequest(int fromId, int toId, int type) {
+    // Accepted friendships between users that still exist, for the social graph
+    std::vector<std::pair<int, int>> getAcceptedFriendships() override {
+        std::vector<std::pair<int, int>> result;
+        std::string sql =
+            "SELECT f.user_id1, f.user_id2 FROM friendships f "
+            "JOIN users a ON a.id = f.user_id1 "
+            "JOIN users b ON b.id = f.user_id2 "
+            "WHERE f.status = 1;";
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                result.emplace_back(sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1));
+            }
+        }
+        sqlite3_finalize(stmt);
+        return result;
+    }
+
+    bool sendFriendRequest(int fromId, int toId, int type) override {
         // type: 0=Normal, 1=Close
         std::string sql = "INSERT INTO friendships (user_id1, user_id2, status, type) VALUES (?, ?, 0, ?);";
         sqlite3_stmt* stmt;
-        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) return false;
+        if (!beginChange()) return false;
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) return endChange(false);
 
         sqlite3_bind_int(stmt, 1, fromId);
         sqlite3_bind_int(stmt, 2, toId);
@@ -163,11 +347,14 @@ public:
 
         bool success = (sqlite3_step(stmt) == SQLITE_DONE);
         sqlite3_finalize(stmt);
-        return success;
+        if (success) {
+            success = logChange(ChangeKind::FriendRequested, {Protocol::Field::integer(fromId), Protocol::Field::integer(toId), Protocol::Field::integer(type)});
+        }
+        return endChange(success);
     }
 
-    std::string getPendingRequests(int userId) {
-        std::string result = "";
+    std::vector<std::string> getPendingRequests(int userId) override {
+        std::vector<std::string> result;
         std::string sql =
             "SELECT u.username, f.type FROM users u "
             "JOIN friendships f ON u.id = f.user_id1 "
@@ -179,19 +366,19 @@ public:
             while (sqlite3_step(stmt) == SQLITE_ROW) {
                 std::string name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
                 int type = sqlite3_column_int(stmt, 1);
-                result += name;
-                if (type == 1) result += " (Close Friend Request)";
-                result += "\n";
+                if (type == 1) name += " (Close Friend Request)";
+                result.push_back(name);
             }
         }
         sqlite3_finalize(stmt);
         return result;
     }
 
-    bool acceptFriendRequest(int myId, int requesterId) {
+    bool acceptFriendRequest(int myId, int requesterId) override {
         std::string sql = "UPDATE friendships SET status = 1 WHERE user_id1 = ? AND user_id2 = ? AND status = 0;";
         sqlite3_stmt* stmt;
-        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) return false;
+        if (!beginChange()) return false;
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) return endChange(false);
 
         sqlite3_bind_int(stmt, 1, requesterId);
         sqlite3_bind_int(stmt, 2, myId);
@@ -199,11 +386,12 @@ public:
         bool success = (sqlite3_step(stmt) == SQLITE_DONE);
         if (sqlite3_changes(db) == 0) success = false;
         sqlite3_finalize(stmt);
-        return success;
+        if (success) success = logChange(ChangeKind::FriendAccepted, {Protocol::Field::integer(myId), Protocol::Field::integer(requesterId)});
+        return endChange(success);
     }
 
-    std::string getFriendsList(int userId) {
-        std::string result = "";
+    std::vector<std::string> getFriendsList(int userId) override {
+        std::vector<std::string> result;
         std::string sql =
             "SELECT u.username, f.type FROM users u "
             "JOIN friendships f ON (u.id = f.user_id1 OR u.id = f.user_id2) "
@@ -221,21 +409,44 @@ public:
                 std::string name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
                 int type = sqlite3_column_int(stmt, 1);
 
-                result += name;
-                if (type == 1) result += " (Close)";
-                result += "\n";
+                if (type == 1) name += " (Close)";
+                result.push_back(name);
             }
         }
         sqlite3_finalize(stmt);
         return result;
     }
 
+    // Accepted friends only, for presence fan-out
+    std::vector<std::string> getFriendUsernames(int userId) override {
+        std::vector<std::string> friends;
+        std::string sql =
+            "SELECT u.username FROM friendships f "
+            "JOIN users u ON u.id = CASE WHEN f.user_id1 = ? THEN f.user_id2 ELSE f.user_id1 END "
+            "WHERE (f.user_id1 = ? OR f.user_id2 = ?) AND f.status = 1;";
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
+            sqlite3_bind_int(stmt, 1, userId);
+            sqlite3_bind_int(stmt, 2, userId);
+            sqlite3_bind_int(stmt, 3, userId);
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                friends.push_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
+            }
+        }
+        sqlite3_finalize(stmt);
+        return friends;
+    }
+
     // --- GROUPS ---
 
-    int createGroup(const std::string& name, int creatorId) {
+    int createGroup(const std::string& name, int creatorId) override {
         std::string sql = "INSERT INTO groups (name, created_by) VALUES (?, ?);";
         sqlite3_stmt* stmt;
-        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) return -1;
+        if (!beginChange()) return -1;
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
+            endChange(false);
+            return -1;
+        }
 
         sqlite3_bind_text(stmt, 1, name.c_str(), -1, SQLITE_STATIC);
         sqlite3_bind_int(stmt, 2, creatorId);
@@ -245,21 +456,39 @@ public:
             groupId = sqlite3_last_insert_rowid(db);
         }
         sqlite3_finalize(stmt);
-        return groupId;
+        bool success = groupId != -1 &&
+                       logChange(ChangeKind::GroupCreated, {Protocol::Field::integer(groupId), Protocol::Field::text(name), Protocol::Field::integer(creatorId)});
+        return endChange(success) ? groupId : -1;
     }
 
-    bool addToGroup(int groupId, int userId) {
-        std::string sql = "INSERT OR IGNORE INTO group_members (group_id, user_id) VALUES (?, ?);";
+    // Group row made elsewhere (a standby replaying the primary's change log)
+    bool insertGroup(int id, const std::string& name, int creatorId) {
+        std::string sql = "INSERT OR REPLACE INTO groups (id, name, created_by) VALUES (?, ?, ?);";
         sqlite3_stmt* stmt;
         if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) return false;
+        sqlite3_bind_int(stmt, 1, id);
+        sqlite3_bind_text(stmt, 2, name.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 3, creatorId);
+        bool success = (sqlite3_step(stmt) == SQLITE_DONE);
+        sqlite3_finalize(stmt);
+        return success;
+    }
+
+    bool addToGroup(int groupId, int userId) override {
+        std::string sql = "INSERT OR IGNORE INTO group_members (group_id, user_id) VALUES (?, ?);";
+        sqlite3_stmt* stmt;
+        if (!beginChange()) return false;
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) return endChange(false);
         sqlite3_bind_int(stmt, 1, groupId);
         sqlite3_bind_int(stmt, 2, userId);
         bool success = (sqlite3_step(stmt) == SQLITE_DONE);
+        bool added = success && sqlite3_changes(db) > 0;
         sqlite3_finalize(stmt);
-        return success;
+        if (added) success = logChange(ChangeKind::GroupMemberAdded, {Protocol::Field::integer(groupId), Protocol::Field::integer(userId)});
+        return endChange(success);
     }
 
-    bool isUserInGroup(int userId, int groupId) {
+    bool isUserInGroup(int userId, int groupId) override {
         std::string sql = "SELECT 1 FROM group_members WHERE group_id = ? AND user_id = ?;";
         sqlite3_stmt* stmt;
         sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0);
@@ -270,7 +499,7 @@ public:
         return exists;
     }
 
-    std::vector<std::string> getGroupMembers(int groupId) {
+    std::vector<std::string> getGroupMembers(int groupId) override {
         std::vector<std::string> members;
         std::string sql = "SELECT u.username FROM users u "
                           "JOIN group_members gm ON u.id = gm.user_id "
@@ -286,8 +515,8 @@ public:
         return members;
     }
 
-    std::string getUserGroups(int userId) {
-        std::string result = "";
+    std::vector<std::string> getUserGroups(int userId) override {
+        std::vector<std::string> result;
         std::string sql =
             "SELECT g.id, g.name FROM groups g "
             "JOIN group_members gm ON g.id = gm.group_id "
@@ -298,7 +527,7 @@ public:
             while (sqlite3_step(stmt) == SQLITE_ROW) {
                 int gid = sqlite3_column_int(stmt, 0);
                 std::string gname = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-                result += std::to_string(gid) + ": " + gname + "\n";
+                result.push_back(std::to_string(gid) + ": " + gname);
             }
         }
         sqlite3_finalize(stmt);
@@ -307,69 +536,98 @@ public:
 
     // --- POSTS & FEED ---
 
-    bool createPost(int userId, const std::string& content, int visibility) {
-        std::string sql = "INSERT INTO posts (user_id, content, visibility) VALUES (?, ?, ?);";
+    bool createPost(int userId, const std::string& content, int visibility) override {
+        return insertPost(0, userId, content, visibility);
+    }
+
+    // id <= 0 lets SQLite pick one; sharded storage hands out its own
+    bool insertPost(int id, int userId, const std::string& content, int visibility) {
+        std::string sql = "INSERT INTO posts (id, user_id, content, visibility, created_at) "
+                          "VALUES (?, ?, ?, ?, CAST(strftime('%s', 'now') AS INTEGER));";
         sqlite3_stmt* stmt;
-        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) return false;
+        if (!beginChange()) return false;
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) return endChange(false);
 
-        sqlite3_bind_int(stmt, 1, userId);
-        sqlite3_bind_text(stmt, 2, content.c_str(), -1, SQLITE_STATIC);
-        sqlite3_bind_int(stmt, 3, visibility);
+        if (id > 0) sqlite3_bind_int(stmt, 1, id);
+        else sqlite3_bind_null(stmt, 1);
+        sqlite3_bind_int(stmt, 2, userId);
+        sqlite3_bind_text(stmt, 3, content.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 4, visibility);
 
         bool success = (sqlite3_step(stmt) == SQLITE_DONE);
         sqlite3_finalize(stmt);
-        return success;
+        if (success) {
+            success = logChange(ChangeKind::PostCreated, {Protocol::Field::integer(sqlite3_last_insert_rowid(db)), Protocol::Field::integer(userId),
+                                                          Protocol::Field::integer(visibility), Protocol::Field::text(content)});
+        }
+        return endChange(success);
     }
 
-    bool deletePost(int postId, int userId) {
-        std::string sql = "DELETE FROM posts WHERE id = ? AND user_id = ?;";
+    int maxPostId() {
         sqlite3_stmt* stmt;
-        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) return false;
+        int id = 0;
+        if (sqlite3_prepare_v2(db, "SELECT COALESCE(MAX(id), 0) FROM posts;", -1, &stmt, 0) == SQLITE_OK &&
+            sqlite3_step(stmt) == SQLITE_ROW) {
+            id = sqlite3_column_int(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+        return id;
+    }
+
+    bool deletePost(int postId, int userId) override {
+        bool archived = archive && postId <= archive->maxPostId();
+        if (archived && !archive->contains(userId, postId)) return false;
+        std::string sql = archived ? "INSERT OR IGNORE INTO archived_deletions (post_id) VALUES (?);"
+                                   : "DELETE FROM posts WHERE id = ? AND user_id = ?;";
+        sqlite3_stmt* stmt;
+        if (!beginChange()) return false;
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) return endChange(false);
 
         sqlite3_bind_int(stmt, 1, postId);
-        sqlite3_bind_int(stmt, 2, userId);
+        if (!archived) sqlite3_bind_int(stmt, 2, userId);
 
         sqlite3_step(stmt);
         int rowsAffected = sqlite3_changes(db);
         sqlite3_finalize(stmt);
-        return rowsAffected > 0;
+        bool success = rowsAffected > 0 &&
+                       logChange(ChangeKind::PostDeleted, {Protocol::Field::integer(postId), Protocol::Field::integer(userId)});
+        return endChange(success);
     }
 
-    std::string getPostsForProfile(int myId, int targetId) {
+    // What myId may see of targetId's posts: 0=Public, 1=Friends, 2=Close (or own profile)
+    int getProfileTier(int myId, int targetId) override {
+        if (myId == targetId) return 2;
+
         int relationType = -1; // -1=Nimic, 0=Friends, 1=Close
-        if (myId == targetId) {
-            relationType = 2;
-        } else {
-            std::string relSql = "SELECT type FROM friendships WHERE ((user_id1=? AND user_id2=?) OR (user_id1=? AND user_id2=?)) AND status=1;";
-            sqlite3_stmt* stmt;
-            if (sqlite3_prepare_v2(db, relSql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
-                sqlite3_bind_int(stmt, 1, myId); sqlite3_bind_int(stmt, 2, targetId);
-                sqlite3_bind_int(stmt, 3, targetId); sqlite3_bind_int(stmt, 4, myId);
-                if (sqlite3_step(stmt) == SQLITE_ROW) {
-                    relationType = sqlite3_column_int(stmt, 0);
-                }
+        std::string relSql = "SELECT type FROM friendships WHERE ((user_id1=? AND user_id2=?) OR (user_id1=? AND user_id2=?)) AND status=1;";
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, relSql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
+            sqlite3_bind_int(stmt, 1, myId); sqlite3_bind_int(stmt, 2, targetId);
+            sqlite3_bind_int(stmt, 3, targetId); sqlite3_bind_int(stmt, 4, myId);
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                relationType = sqlite3_column_int(stmt, 0);
             }
-            sqlite3_finalize(stmt);
         }
+        sqlite3_finalize(stmt);
+        return relationType + 1;
+    }
 
-        std::string sql = "SELECT content, visibility FROM posts WHERE user_id = ? ORDER BY id DESC;";
-        std::string result = "";
+    // Profile lines as seen from a tier; the same for every viewer in it
+    std::vector<std::string> getPostsForTier(int targetId, int tier) override {
+        std::string sql = "SELECT content, visibility FROM posts WHERE user_id = ? AND id > ? ORDER BY id DESC;";
+        std::vector<std::string> result;
         sqlite3_stmt* stmt;
         if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
             sqlite3_bind_int(stmt, 1, targetId);
+            sqlite3_bind_int(stmt, 2, archive ? archive->maxPostId() : 0);
             while (sqlite3_step(stmt) == SQLITE_ROW) {
                 std::string content = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
                 int vis = sqlite3_column_int(stmt, 1);
 
-                // Filtrare
-                bool canSee = false;
-                if (vis == 0) canSee = true; // Public
-                if (vis == 1 && relationType >= 0) canSee = true; // Friends
-                if (vis == 2 && relationType >= 1) canSee = true; // Close (sau eu)
-
-                if (canSee) {
+                // Filtrare: Public (0) < Friends (1) < Close (2)
+                if (vis <= tier) {
                     std::string v = (vis==0)?"[Public]": (vis==1)?"[Friends]":"[Close]";
-                    result += v + ": " + content + "\n";
+                    result.push_back(v + ": " + content);
                 }
             }
         }
@@ -377,11 +635,61 @@ public:
         return result;
     }
 
-    std::string getNewsFeed(int myUserId) {
-        std::string feedData = "--- News Feed ---\n";
+    // The posts table first, then the archive below what it holds
+    std::vector<std::string> getPostsBefore(int targetId, int tier, int beforeId, int limit, int& nextCursor) override {
+        std::vector<std::pair<int, std::string>> rows;
+        int archived = archive ? archive->maxPostId() : 0;
+        std::string sql = "SELECT id, content, visibility FROM posts "
+                          "WHERE user_id = ? AND id > ? AND id < ? AND visibility <= ? ORDER BY id DESC LIMIT ?;";
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
+            sqlite3_bind_int(stmt, 1, targetId);
+            sqlite3_bind_int(stmt, 2, archived);
+            sqlite3_bind_int(stmt, 3, beforeId);
+            sqlite3_bind_int(stmt, 4, tier);
+            sqlite3_bind_int(stmt, 5, limit + 1);
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                std::string content = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+                rows.emplace_back(sqlite3_column_int(stmt, 0),
+                                  std::string(visibilityLabel(sqlite3_column_int(stmt, 2))) + ": " + content);
+            }
+        }
+        sqlite3_finalize(stmt);
+
+        // One more than asked for tells whether there is a next page
+        int before = std::min(beforeId, archived + 1);
+        while (archive && static_cast<int>(rows.size()) <= limit) {
+            auto older = archive->read(targetId, tier, before, limit + 1 - static_cast<int>(rows.size()));
+            if (older.empty()) break;
+            before = older.back().first;
+            for (auto& row : older) {
+                if (!isArchivedDeletion(row.first)) rows.push_back(std::move(row));
+            }
+        }
+
+        nextCursor = -1;
+        if (static_cast<int>(rows.size()) > limit) {
+            rows.resize(limit);
+            nextCursor = rows.back().first;
+        }
+        std::vector<std::string> result;
+        for (auto& row : rows) result.push_back(std::move(row.second));
+        return result;
+    }
+
+    // Feed lines only; the caller adds the banner / empty-feed note
+    std::vector<std::string> getNewsFeed(int myUserId) override {
+        std::vector<std::string> feedData;
+        for (auto& row : getNewsFeedRows(myUserId, 50)) feedData.push_back(std::move(row.second));
+        return feedData;
+    }
+
+    // (post id, feed line), newest first
+    std::vector<std::pair<int, std::string>> getNewsFeedRows(int myUserId, int limit) {
+        std::vector<std::pair<int, std::string>> feedData;
 
         std::string sql =
-            "SELECT u.username, p.content, p.visibility "
+            "SELECT u.username, p.content, p.visibility, p.id "
             "FROM posts p "
             "JOIN users u ON p.user_id = u.id "
             "WHERE "
@@ -403,7 +711,7 @@ public:
             "           OR (f.user_id2 = ? AND f.user_id1 = p.user_id)) "
             "       AND f.status = 1 AND f.type = 1 "
             "   )) "
-            "ORDER BY p.id DESC LIMIT 50;";
+            "ORDER BY p.id DESC LIMIT ?;";
 
         sqlite3_stmt* stmt;
         if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
@@ -412,10 +720,9 @@ public:
             sqlite3_bind_int(stmt, 3, myUserId);
             sqlite3_bind_int(stmt, 4, myUserId);
             sqlite3_bind_int(stmt, 5, myUserId);
+            sqlite3_bind_int(stmt, 6, limit);
 
-            bool found = false;
             while (sqlite3_step(stmt) == SQLITE_ROW) {
-                found = true;
                 std::string author = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
                 std::string content = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
                 int visibility = sqlite3_column_int(stmt, 2);
@@ -424,23 +731,129 @@ public:
                 if (visibility == 1) visLabel = "[Friends]";
                 if (visibility == 2) visLabel = "[Close]";
 
-                feedData += author + " " + visLabel + ": " + content + "\n";
+                feedData.emplace_back(sqlite3_column_int(stmt, 3), author + " " + visLabel + ": " + content);
             }
-            if (!found) feedData += "No posts yet. Add friends or post something!\n";
         } else {
-             std::cerr << "SQL Error in getNewsFeed: " << sqlite3_errmsg(db) << std::endl;
+             Logger::error("sql_error", {{"where", "getNewsFeed"}, {"error", sqlite3_errmsg(db)}});
         }
 
         sqlite3_finalize(stmt);
         return feedData;
     }
 
+    // --- SEARCH ---
+
+    // Every word must match; quoting each one keeps FTS5 operators and
+    // punctuation in user input from being parsed
+    static std::string toFtsQuery(const std::string& text) {
+        std::string query;
+        for (const std::string& term : searchTerms(text)) query += (query.empty() ? "\"" : " \"") + term + "\"";
+        return query;
+    }
+
+    // One page of posts matching text, best BM25 score first, limited to
+    // what myUserId may see (same rules as getNewsFeed). Only matches after
+    // cursor are looked at, at most scanLimit per call, so a query matching
+    // mostly invisible posts stays cheap. nextCursor.id is 0 once the
+    // matches are exhausted.
+    std::vector<std::string> searchPosts(int myUserId, const std::string& text, const SearchCursor& cursor,
+                                         int pageSize, int scanLimit, SearchCursor& nextCursor) override {
+        std::vector<std::string> results;
+        nextCursor = SearchCursor{};
+        int examined = 0;
+        SearchCursor last;
+        for (auto& match : searchRanked(myUserId, text, cursor, scanLimit)) {
+            if ((int)results.size() == pageSize) break;
+            examined++;
+            last = SearchCursor{match.rank, match.id};
+            if (match.visible) results.push_back(std::move(match.line));
+        }
+        // Stopped early (page full or scan budget used up): there may be more
+        if ((int)results.size() == pageSize || examined == scanLimit) nextCursor = last;
+        return results;
+    }
+
+    struct RankedPost {
+        double rank;        // FTS5 rank: lower is better
+        int id;
+        bool visible;       // to the searching user
+        std::string line;   // feed line, only when visible
+    };
+
+    // Up to limit matches after cursor in (rank, id) order, visible or not
+    std::vector<RankedPost> searchRanked(int myUserId, const std::string& text, const SearchCursor& cursor, int limit) {
+        std::vector<RankedPost> matches;
+        std::string query = toFtsQuery(text);
+        if (query.empty()) return matches;
+
+        // Friends and close friends decide what is visible
+        std::unordered_map<int, int> friendTypes;
+        sqlite3_stmt* stmt;
+        std::string friendsSql = "SELECT CASE WHEN user_id1 = ? THEN user_id2 ELSE user_id1 END, type "
+                                 "FROM friendships WHERE (user_id1 = ? OR user_id2 = ?) AND status = 1;";
+        if (sqlite3_prepare_v2(db, friendsSql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
+            sqlite3_bind_int(stmt, 1, myUserId);
+            sqlite3_bind_int(stmt, 2, myUserId);
+            sqlite3_bind_int(stmt, 3, myUserId);
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                friendTypes[sqlite3_column_int(stmt, 0)] = sqlite3_column_int(stmt, 1);
+            }
+        }
+        sqlite3_finalize(stmt);
+
+        std::string sql =
+            "SELECT p.user_id, u.username, p.content, p.visibility, f.rank, p.id "
+            "FROM posts_fts f "
+            "JOIN posts p ON p.id = f.rowid "
+            "JOIN users u ON u.id = p.user_id "
+            "WHERE posts_fts MATCH ? AND (? = 0 OR (f.rank, p.id) > (?, ?)) "
+            "ORDER BY f.rank, p.id LIMIT ?;";
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
+            Logger::error("sql_error", {{"where", "searchPosts"}, {"error", sqlite3_errmsg(db)}});
+            sqlite3_finalize(stmt);
+            return matches;
+        }
+        sqlite3_bind_text(stmt, 1, query.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(stmt, 2, cursor.id);
+        sqlite3_bind_double(stmt, 3, cursor.rank);
+        sqlite3_bind_int(stmt, 4, cursor.id);
+        sqlite3_bind_int(stmt, 5, limit);
+
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            int author = sqlite3_column_int(stmt, 0);
+            int visibility = sqlite3_column_int(stmt, 3);
+
+            bool canSee = visibility == 0 || author == myUserId;
+            auto rel = friendTypes.find(author);
+            if (rel != friendTypes.end()) {
+                if (visibility == 1) canSee = true;
+                if (visibility == 2 && rel->second == 1) canSee = true;
+            }
+
+            RankedPost match{sqlite3_column_double(stmt, 4), sqlite3_column_int(stmt, 5), canSee, ""};
+            if (canSee) {
+                std::string visLabel = "[Public]";
+                if (visibility == 1) visLabel = "[Friends]";
+                if (visibility == 2) visLabel = "[Close]";
+                match.line = std::string(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1))) + " " +
+                             visLabel + ": " + reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+            }
+            matches.push_back(std::move(match));
+        }
+        sqlite3_finalize(stmt);
+        return matches;
+    }
+
     // --- OFFLINE MESSAGES ---
 
-    void storeOfflineMessage(int targetUserId, const std::string& senderName, const std::string& content, bool isGroup, int groupId) {
+    void storeOfflineMessage(int targetUserId, const std::string& senderName, const std::string& content, bool isGroup, int groupId) override {
         std::string sql = "INSERT INTO offline_messages (target_user_id, sender_name, message_content, is_group_msg, source_group_id) VALUES (?, ?, ?, ?, ?);";
         sqlite3_stmt* stmt;
-        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) return;
+        if (!beginChange()) return;
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
+            endChange(false);
+            return;
+        }
 
         sqlite3_bind_int(stmt, 1, targetUserId);
         sqlite3_bind_text(stmt, 2, senderName.c_str(), -1, SQLITE_STATIC);
@@ -448,15 +861,29 @@ public:
         sqlite3_bind_int(stmt, 4, isGroup ? 1 : 0);
         sqlite3_bind_int(stmt, 5, groupId);
 
+        bool success = (sqlite3_step(stmt) == SQLITE_DONE);
+        sqlite3_finalize(stmt);
+        if (success) {
+            success = logChange(ChangeKind::OfflineStored, {Protocol::Field::integer(targetUserId), Protocol::Field::text(senderName), Protocol::Field::text(content),
+                                                            Protocol::Field::integer(isGroup ? 1 : 0), Protocol::Field::integer(groupId)});
+        }
+        if (!endChange(success)) Logger::error("offline_store_failed", {{"target", std::to_string(targetUserId)}, {"sender", senderName}});
+    }
+
+    void clearOfflineMessages(int userId) {
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, "DELETE FROM offline_messages WHERE target_user_id = ?;", -1, &stmt, 0) != SQLITE_OK) return;
+        sqlite3_bind_int(stmt, 1, userId);
         sqlite3_step(stmt);
         sqlite3_finalize(stmt);
     }
 
-    std::vector<std::string> retrieveOfflineMessages(int userId) {
+    std::vector<std::string> retrieveOfflineMessages(int userId) override {
         std::vector<std::string> messages;
         std::string sql = "SELECT sender_name, message_content, is_group_msg, source_group_id, timestamp FROM offline_messages WHERE target_user_id = ? ORDER BY id ASC;";
         sqlite3_stmt* stmt;
 
+        if (!beginChange()) return messages;
         if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
             sqlite3_bind_int(stmt, 1, userId);
             while (sqlite3_step(stmt) == SQLITE_ROW) {
@@ -468,24 +895,156 @@ public:
 
                 std::string formatted;
                 if (isGroup) {
-                    formatted = "[OFFLINE Group " + std::to_string(grpId) + " | " + sender + " @ " + time + "]: " + content + "\n";
+                    formatted = "[OFFLINE Group " + std::to_string(grpId) + " | " + sender + " @ " + time + "]: " + content;
                 } else {
-                    formatted = "[OFFLINE Private | " + sender + " @ " + time + "]: " + content + "\n";
+                    formatted = "[OFFLINE Private | " + sender + " @ " + time + "]: " + content;
                 }
                 messages.push_back(formatted);
             }
         }
         sqlite3_finalize(stmt);
 
+        bool success = true;
         if (!messages.empty()) {
             std::string delSql = "DELETE FROM offline_messages WHERE target_user_id = ?;";
             sqlite3_prepare_v2(db, delSql.c_str(), -1, &stmt, 0);
             sqlite3_bind_int(stmt, 1, userId);
-            sqlite3_step(stmt);
+            success = sqlite3_step(stmt) == SQLITE_DONE;
             sqlite3_finalize(stmt);
+            success = success && logChange(ChangeKind::OfflineDelivered, {Protocol::Field::integer(userId)});
         }
+        // Not deleted: they stay for the next login rather than being shown twice
+        if (!endChange(success)) messages.clear();
         return messages;
     }
+
+    // --- MESSAGE HISTORY ---
+
+    // Also how the standby applies a logged append, seq and time included
+    bool insertHistory(int64_t conversation, int64_t seq, const std::string& senderName, const std::string& content,
+                       const std::string& sentAt) {
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, "INSERT INTO message_history (conversation, seq, sender_name, content, sent_at) VALUES (?, ?, ?, ?, ?);",
+                               -1, &stmt, 0) != SQLITE_OK) {
+            return false;
+        }
+        sqlite3_bind_int64(stmt, 1, conversation);
+        sqlite3_bind_int64(stmt, 2, seq);
+        sqlite3_bind_text(stmt, 3, senderName.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 4, content.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 5, sentAt.c_str(), -1, SQLITE_STATIC);
+        bool success = (sqlite3_step(stmt) == SQLITE_DONE);
+        sqlite3_finalize(stmt);
+        return success;
+    }
+
+    void appendHistory(int64_t conversation, const std::string& senderName, const std::string& content) override {
+        // Reading the next seq and inserting it hold the write lock
+        // together, so another connection to the file (a cluster peer)
+        // cannot take the same seq in between
+        bool ok = executeQuery("BEGIN IMMEDIATE;");
+        sqlite3_stmt* stmt = nullptr;
+        int64_t seq = -1;
+        std::string sentAt;
+        if (ok && sqlite3_prepare_v2(db, "SELECT COALESCE(MAX(seq), 0) + 1, datetime('now') FROM message_history WHERE conversation = ?;",
+                                     -1, &stmt, 0) == SQLITE_OK) {
+            sqlite3_bind_int64(stmt, 1, conversation);
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                seq = sqlite3_column_int64(stmt, 0);
+                sentAt = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            }
+        }
+        sqlite3_finalize(stmt);
+        ok = ok && seq > 0 && insertHistory(conversation, seq, senderName, content, sentAt);
+        // Logged before COMMIT, as beginChange() does for the other writes
+        bool logged = ok && logChange(ChangeKind::HistoryAppended, {Protocol::Field::integer(conversation), Protocol::Field::integer(seq),
+                                                                    Protocol::Field::text(senderName), Protocol::Field::text(content),
+                                                                    Protocol::Field::text(sentAt)});
+        ok = logged && executeQuery("COMMIT;");
+        if (!ok) {
+            Logger::error("history_append_failed", {{"conversation", std::to_string(conversation)}, {"sender", senderName},
+                                                    {"error", sqlite3_errmsg(db)}});
+            if (!sqlite3_get_autocommit(db)) executeQuery("ROLLBACK;");
+            if (logged && changeLog) changeLog->markBroken("commit_failed");
+        }
+    }
+
+    std::vector<std::string> getHistory(int64_t conversation, int64_t beforeSeq, int limit, int64_t& nextCursor) override {
+        std::vector<std::string> lines;
+        nextCursor = -1;
+        // One row past the page tells whether there is more
+        sqlite3_stmt* stmt;
+        std::string sql = "SELECT seq, sender_name, content, sent_at FROM message_history "
+                          "WHERE conversation = ? AND seq < ? ORDER BY seq DESC LIMIT ?;";
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
+            sqlite3_bind_int64(stmt, 1, conversation);
+            sqlite3_bind_int64(stmt, 2, beforeSeq);
+            sqlite3_bind_int(stmt, 3, limit + 1);
+            int64_t oldest = -1;
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                if ((int)lines.size() == limit) {
+                    nextCursor = oldest;
+                    break;
+                }
+                int64_t seq = oldest = sqlite3_column_int64(stmt, 0);
+                lines.push_back("#" + std::to_string(seq) + " [" + reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)) +
+                                " @ " + reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3)) + "]: " +
+                                reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2)));
+            }
+        }
+        sqlite3_finalize(stmt);
+        std::reverse(lines.begin(), lines.end());
+        return lines;
+    }
+
+    // --- REPLICATION (standby side) ---
+
+    // Applies a RowsDeleted record: keys holds keyCount values per row.
+    // Only the tables and key columns Maintenance sweeps are accepted.
+    bool deleteRows(const std::string& table, int keyCount, const std::vector<int64_t>& keys) {
+        const char* sql = nullptr;
+        if (keyCount == 1 && table == "offline_messages") sql = "DELETE FROM offline_messages WHERE id = ?;";
+        else if (keyCount == 1 && table == "posts") sql = "DELETE FROM posts WHERE id = ?;";
+        else if (keyCount == 2 && table == "friendships") sql = "DELETE FROM friendships WHERE user_id1 = ? AND user_id2 = ?;";
+        else if (keyCount == 2 && table == "group_members") sql = "DELETE FROM group_members WHERE group_id = ? AND user_id = ?;";
+        if (!sql || keys.size() % static_cast<size_t>(keyCount) != 0) return false;
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK) return false;
+        bool ok = true;
+        for (size_t i = 0; ok && i < keys.size(); i += keyCount) {
+            for (int k = 0; k < keyCount; k++) sqlite3_bind_int64(stmt, k + 1, keys[i + k]);
+            ok = sqlite3_step(stmt) == SQLITE_DONE;
+            sqlite3_reset(stmt);
+        }
+        sqlite3_finalize(stmt);
+        return ok;
+    }
+
+    bool beginTransaction() { return executeQuery("BEGIN;"); }
+    bool commitTransaction() { return executeQuery("COMMIT;"); }
+
+    // Last change log seq applied to this database, 0 for none
+    uint64_t replicatedSeq() {
+        executeQuery("CREATE TABLE IF NOT EXISTS replication_state (id INTEGER PRIMARY KEY CHECK (id = 1), seq INTEGER);");
+        sqlite3_stmt* stmt;
+        uint64_t seq = 0;
+        if (sqlite3_prepare_v2(db, "SELECT seq FROM replication_state WHERE id = 1;", -1, &stmt, 0) == SQLITE_OK &&
+            sqlite3_step(stmt) == SQLITE_ROW) {
+            seq = static_cast<uint64_t>(sqlite3_column_int64(stmt, 0));
+        }
+        sqlite3_finalize(stmt);
+        return seq;
+    }
+
+    // In the same transaction as the changes, so none is applied twice
+    bool setReplicatedSeq(uint64_t seq) {
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, "INSERT OR REPLACE INTO replication_state (id, seq) VALUES (1, ?);", -1, &stmt, 0) != SQLITE_OK) return false;
+        sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(seq));
+        bool success = (sqlite3_step(stmt) == SQLITE_DONE);
+        sqlite3_finalize(stmt);
+        return success;
+    }
 };
 
 #endif
\ No newline at end of file
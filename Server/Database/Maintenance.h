@@ -0,0 +1,357 @@
+#ifndef MAINTENANCE_H
+#define MAINTENANCE_H
+
+#include <sqlite3.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ChangeLog.h"
+#include "Logger.h"
+#include "PostArchive.h"
+
+// Background clean-up of the SQLite database (--maintenance-interval).
+//
+// Every pass, on its own connection:
+//  - offline_messages older than the retention period are dropped
+//    (--offline-retention-days, 0 keeps them);
+//  - rows left behind by deleted users (their posts, friendships, group
+//    memberships and offline messages) are removed;
+//  - posts older than --archive-after-days move to the archive
+//    (--archive-dir), archiveBatch at a time, see PostArchive.h;
+//  - freed pages are given back with incremental vacuum.
+//
+// Rows to drop are looked up outside any write transaction and deleted
+// batchSize at a time, each batch its own short transaction with pauseMs
+// in between, so the event loop's writes never wait for more than one
+// batch. Vacuum goes vacuumPages pages per step the same way.
+//
+// Each deleted batch is logged as one RowsDeleted record (by the rows'
+// key columns), so change log consumers and a standby drop the same rows.
+// A standby therefore skips these sweeps and only applies the records,
+// until it is promoted.
+class Maintenance {
+public:
+    struct Settings {
+        int intervalSec = 300;
+        int offlineRetentionDays = 0;
+        int batchSize = 500;
+        int pauseMs = 20;
+        int vacuumPages = 64;
+        int archiveAfterDays = 30;
+        int archiveBatch = 10000;
+    };
+
+private:
+    // One clean-up rule: rows of table matching condition. keys are the
+    // integer columns that identify a row in the change log record (the
+    // standby applies them by these, see DatabaseManager::deleteRows),
+    // nullptr for a sweep that is not logged.
+    struct Sweep {
+        const char* table;
+        const char* condition;
+        std::atomic<uint64_t>* reclaimed;
+        const char* keys = nullptr;
+        int keyCount = 0;
+    };
+
+    std::string dbPath;
+    Settings settings;
+    PostArchive* archive;
+    std::atomic<ChangeLog*> changeLog{nullptr};
+    std::atomic<bool> standby{false};
+    sqlite3* db = nullptr;
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool stopping = false;
+    bool vacuumWarned = false;
+
+    std::atomic<uint64_t> passCount{0};
+    std::atomic<uint64_t> offlineExpired{0};
+    std::atomic<uint64_t> orphanOffline{0};
+    std::atomic<uint64_t> orphanPosts{0};
+    std::atomic<uint64_t> orphanFriendships{0};
+    std::atomic<uint64_t> orphanMemberships{0};
+    std::atomic<uint64_t> archivedPosts{0};
+    std::atomic<uint64_t> vacuumed{0};
+    std::atomic<uint64_t> pauseCount{0};
+    std::atomic<uint64_t> pauseTotalMs{0};
+    std::atomic<uint64_t> pauseMaxMs{0};
+    std::atomic<uint64_t> lastPassMs{0};
+
+    // Waits between batches; false once the server is shutting down
+    bool rest(int ms) {
+        std::unique_lock<std::mutex> guard(lock);
+        return !wake.wait_for(guard, std::chrono::milliseconds(ms), [this]() { return stopping; });
+    }
+
+    void notePause(std::chrono::steady_clock::time_point start) {
+        auto ms = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count());
+        pauseCount++;
+        pauseTotalMs += ms;
+        if (ms > pauseMaxMs) pauseMaxMs = ms;
+    }
+
+    // Up to batchSize rows after cursor, read without holding the write
+    // lock: rowid, then the key columns of each
+    std::vector<int64_t> pick(const Sweep& sweep, int64_t cursor) {
+        std::vector<int64_t> rows;
+        std::string sql = std::string("SELECT rowid") + (sweep.keys ? std::string(", ") + sweep.keys : "") + " FROM " +
+                          sweep.table + " WHERE rowid > ? AND (" + sweep.condition + ") ORDER BY rowid LIMIT ?;";
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
+            sqlite3_bind_int64(stmt, 1, cursor);
+            sqlite3_bind_int(stmt, 2, settings.batchSize);
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                for (int i = 0; i <= sweep.keyCount; i++) rows.push_back(sqlite3_column_int64(stmt, i));
+            }
+        }
+        sqlite3_finalize(stmt);
+        return rows;
+    }
+
+    // The condition is checked again on delete: the row may have changed
+    // between the lookup and the write. The keys of the rows actually
+    // deleted are appended to record (a kind record) before COMMIT, as
+    // DatabaseManager does for its writes.
+    bool remove(const Sweep& sweep, const std::vector<int64_t>& rows, ChangeKind kind, std::vector<Protocol::Field> record) {
+        std::string sql = std::string("DELETE FROM ") + sweep.table + " WHERE rowid = ? AND (" + sweep.condition + ");";
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) return false;
+        size_t stride = static_cast<size_t>(sweep.keyCount) + 1;
+        ChangeLog* log = sweep.keys ? changeLog.load() : nullptr;
+        auto start = std::chrono::steady_clock::now();
+        bool ok = sqlite3_exec(db, "BEGIN IMMEDIATE;", 0, 0, 0) == SQLITE_OK;
+        uint64_t removed = 0;
+        for (size_t i = 0; ok && i < rows.size(); i += stride) {
+            sqlite3_bind_int64(stmt, 1, rows[i]);
+            ok = sqlite3_step(stmt) == SQLITE_DONE;
+            if (ok && sqlite3_changes(db) > 0) {
+                removed++;
+                for (size_t k = 1; k < stride; k++) record.push_back(Protocol::Field::integer(rows[i + k]));
+            }
+            sqlite3_reset(stmt);
+        }
+        sqlite3_finalize(stmt);
+        bool logged = false;
+        if (ok && log && removed > 0) {
+            logged = log->append(kind, record) != 0;
+            if (!logged) Logger::error("changelog_append_failed", {{"kind", std::to_string(static_cast<int>(kind))}});
+            ok = logged;
+        }
+        if (ok) ok = sqlite3_exec(db, "COMMIT;", 0, 0, 0) == SQLITE_OK;
+        if (!ok) {
+            Logger::error("maintenance_failed", {{"table", sweep.table}, {"error", sqlite3_errmsg(db)}});
+            sqlite3_exec(db, "ROLLBACK;", 0, 0, 0);
+            if (logged) log->markBroken("commit_failed");
+            return false;
+        }
+        notePause(start);
+        *sweep.reclaimed += removed;
+        return true;
+    }
+
+    bool sweep(const Sweep& rule) {
+        int64_t cursor = 0;
+        size_t stride = static_cast<size_t>(rule.keyCount) + 1;
+        while (true) {
+            std::vector<int64_t> rows = pick(rule, cursor);
+            if (rows.empty()) return true;
+            if (!remove(rule, rows, ChangeKind::RowsDeleted, {Protocol::Field::text(rule.table), Protocol::Field::integer(rule.keyCount)})) {
+                return true;
+            }
+            cursor = rows[rows.size() - stride];
+            if (!rest(settings.pauseMs)) return false;
+        }
+    }
+
+    // The posts right after the archive's last id, in id order, up to the
+    // first one that is not old enough: readers take every id up to
+    // maxPostId() from the archive, so the archive must not skip any.
+    // Only full batches are archived, so segments stay few and large.
+    std::vector<ArchivedPost> oldPosts() {
+        std::vector<ArchivedPost> batch;
+        sqlite3_stmt* stmt;
+        std::string sql = "SELECT id, user_id, visibility, content, created_at < CAST(strftime('%s', 'now') AS INTEGER) - ? "
+                          "FROM posts WHERE id > ? ORDER BY id LIMIT ?;";
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
+            sqlite3_bind_int64(stmt, 1, static_cast<int64_t>(settings.archiveAfterDays) * 86400);
+            sqlite3_bind_int(stmt, 2, archive->maxPostId());
+            sqlite3_bind_int(stmt, 3, settings.archiveBatch);
+            while (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 4)) {
+                const unsigned char* content = sqlite3_column_text(stmt, 3);
+                batch.push_back(ArchivedPost{sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1), sqlite3_column_int(stmt, 2),
+                                             content ? reinterpret_cast<const char*>(content) : ""});
+            }
+        }
+        sqlite3_finalize(stmt);
+        if (static_cast<int>(batch.size()) < settings.archiveBatch) batch.clear();
+        return batch;
+    }
+
+    // Rows still in posts that a segment holds: left over from a segment
+    // written just before a restart
+    std::vector<int64_t> leftovers() {
+        std::vector<int64_t> ids;
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, "SELECT id, user_id FROM posts WHERE id <= ? ORDER BY id;", -1, &stmt, 0) == SQLITE_OK) {
+            sqlite3_bind_int(stmt, 1, archive->maxPostId());
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                int id = sqlite3_column_int(stmt, 0);
+                if (archive->contains(sqlite3_column_int(stmt, 1), id)) ids.push_back(id);
+            }
+        }
+        sqlite3_finalize(stmt);
+        return ids;
+    }
+
+    // Deletes exactly the rows a segment holds (ids ascending), batchSize
+    // at a time, logged as PostsArchived
+    bool dropArchived(const std::vector<int64_t>& ids) {
+        Sweep rule{"posts", "1", &archivedPosts, "id", 1};
+        std::vector<int64_t> rows;
+        for (size_t i = 0; i < ids.size(); i += static_cast<size_t>(settings.batchSize)) {
+            rows.clear();
+            for (size_t j = i; j < ids.size() && j < i + static_cast<size_t>(settings.batchSize); j++) {
+                rows.push_back(ids[j]);   // rowid
+                rows.push_back(ids[j]);   // key
+            }
+            if (!remove(rule, rows, ChangeKind::PostsArchived, {})) return true;
+            if (!rest(settings.pauseMs)) return false;
+        }
+        return true;
+    }
+
+    bool tier() {
+        if (!archive) return true;
+        if (!dropArchived(leftovers())) return false;
+        while (true) {
+            std::vector<ArchivedPost> batch = oldPosts();
+            if (batch.empty() || !archive->archive(batch)) return true;
+            std::vector<int64_t> ids;
+            for (const ArchivedPost& post : batch) ids.push_back(post.id);
+            if (!dropArchived(ids)) return false;
+        }
+    }
+
+    int64_t pragma(const char* sql) {
+        sqlite3_stmt* stmt;
+        int64_t value = -1;
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+            value = sqlite3_column_int64(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+        return value;
+    }
+
+    // Only for databases created with auto_vacuum=INCREMENTAL
+    void vacuum() {
+        if (pragma("PRAGMA auto_vacuum;") != 2) {
+            if (!vacuumWarned) {
+                Logger::warn("maintenance_no_vacuum", {{"hint", "database predates auto_vacuum=INCREMENTAL; VACUUM it offline once"}});
+                vacuumWarned = true;
+            }
+            return;
+        }
+        std::string step = "PRAGMA incremental_vacuum(" + std::to_string(settings.vacuumPages) + ");";
+        while (true) {
+            int64_t free = pragma("PRAGMA freelist_count;");
+            if (free <= 0) return;
+            auto start = std::chrono::steady_clock::now();
+            if (sqlite3_exec(db, step.c_str(), 0, 0, 0) != SQLITE_OK) {
+                Logger::error("maintenance_failed", {{"table", "(vacuum)"}, {"error", sqlite3_errmsg(db)}});
+                return;
+            }
+            notePause(start);
+            int64_t left = pragma("PRAGMA freelist_count;");
+            if (left >= free) return;
+            vacuumed += static_cast<uint64_t>(free - (left < 0 ? 0 : left));
+            if (!rest(settings.pauseMs)) return;
+        }
+    }
+
+    void pass() {
+        auto start = std::chrono::steady_clock::now();
+        std::string expiry = "timestamp < datetime('now', '-" + std::to_string(settings.offlineRetentionDays) + " days')";
+        std::vector<Sweep> rules = {
+            {"offline_messages", "target_user_id NOT IN (SELECT id FROM users)", &orphanOffline, "id", 1},
+            {"posts", "user_id NOT IN (SELECT id FROM users)", &orphanPosts, "id", 1},
+            {"friendships", "user_id1 NOT IN (SELECT id FROM users) OR user_id2 NOT IN (SELECT id FROM users)",
+             &orphanFriendships, "user_id1, user_id2", 2},
+            {"group_members", "user_id NOT IN (SELECT id FROM users)", &orphanMemberships, "group_id, user_id", 2},
+        };
+        if (settings.offlineRetentionDays > 0) rules.push_back({"offline_messages", expiry.c_str(), &offlineExpired, "id", 1});
+        // A standby gets these deletions from the primary's log
+        for (const Sweep& rule : rules) {
+            if (standby) break;
+            if (!sweep(rule)) return;
+        }
+        if (!tier()) return;
+        vacuum();
+        lastPassMs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count());
+        passCount++;
+        Logger::debug("maintenance_pass", {{"ms", std::to_string(lastPassMs.load())}});
+    }
+
+    void run() {
+        while (rest(settings.intervalSec * 1000)) pass();
+    }
+
+public:
+    // archive may be null (no --archive-dir)
+    Maintenance(const std::string& path, const Settings& settings, PostArchive* archive)
+        : dbPath(path), settings(settings), archive(archive) {
+        if (this->settings.batchSize <= 0) this->settings.batchSize = 1;
+        if (this->settings.pauseMs < 0) this->settings.pauseMs = 0;
+        if (this->settings.vacuumPages <= 0) this->settings.vacuumPages = 1;
+        if (this->settings.archiveBatch <= 0) this->settings.archiveBatch = 1;
+    }
+
+    ~Maintenance() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (thread.joinable()) thread.join();
+        if (db) sqlite3_close(db);
+    }
+
+    // Deleted rows are logged to log from now on
+    void setChangeLog(ChangeLog* log) { changeLog = log; }
+    // While set, rows are only deleted by applying the primary's records
+    void setStandby(bool isStandby) { standby = isStandby; }
+
+    bool start() {
+        if (settings.intervalSec <= 0) return false;
+        if (sqlite3_open_v2(dbPath.c_str(), &db, SQLITE_OPEN_READWRITE, nullptr) != SQLITE_OK) {
+            Logger::error("maintenance_open_failed", {{"path", dbPath}, {"error", sqlite3_errmsg(db)}});
+            return false;
+        }
+        sqlite3_busy_timeout(db, 5000);
+        thread = std::thread(&Maintenance::run, this);
+        return true;
+    }
+
+    uint64_t passes() const { return passCount; }
+    uint64_t expiredOffline() const { return offlineExpired; }
+    uint64_t orphanedOffline() const { return orphanOffline; }
+    uint64_t orphanedPosts() const { return orphanPosts; }
+    uint64_t orphanedFriendships() const { return orphanFriendships; }
+    uint64_t orphanedMemberships() const { return orphanMemberships; }
+    uint64_t postsArchived() const { return archivedPosts; }
+    uint64_t pagesVacuumed() const { return vacuumed; }
+    uint64_t pauses() const { return pauseCount; }
+    uint64_t pauseMs() const { return pauseTotalMs; }
+    uint64_t maxPauseMs() const { return pauseMaxMs; }
+    uint64_t passMs() const { return lastPassMs; }
+};
+
+#endif
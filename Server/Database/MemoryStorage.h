@@ -0,0 +1,688 @@
+#ifndef MEMORY_STORAGE_H
+#define MEMORY_STORAGE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <iterator>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+#include "Logger.h"
+#include "Storage.h"
+
+// Storage kept entirely in process memory (--storage=memory). It answers
+// with exactly the lines the SQLite engine produces, so the two can be
+// swapped to see how much of a command's latency is SQLite.
+//
+// Nothing survives a restart unless a snapshot path is given: the whole
+// state is then loaded from it at startup and rewritten by saveSnapshot()
+// (the server calls it every --snapshot-interval seconds). The file is
+// written next to the old one and renamed over it, so a crash mid-write
+// leaves the previous snapshot intact.
+//
+// Not thread-safe: the server does not start the query worker with it.
+class MemoryStorage : public Storage {
+private:
+    struct User {
+        std::string name;
+        std::string password;
+        int role = 0;
+    };
+    struct Friendship {
+        int status = 0;   // 0=Pending, 1=Accepted
+        int type = 0;     // 0=Normal, 1=Close
+    };
+    struct Group {
+        std::string name;
+        int createdBy = 0;
+    };
+    struct Post {
+        int userId = 0;
+        std::string content;
+        int visibility = 0;
+        int length = 0;   // terms, for ranking
+    };
+    struct OfflineMessage {
+        std::string sender;
+        std::string content;
+        std::string timestamp;
+        bool isGroup = false;
+        int groupId = -1;
+    };
+    struct HistoryMessage {
+        std::string sender;
+        std::string content;
+        std::string timestamp;
+    };
+
+    // Ordered containers keep list answers in the order SQLite scans them
+    std::map<int, User> users;
+    std::unordered_map<std::string, int> userIds;
+    std::map<std::pair<int, int>, Friendship> friendships;   // (requester, target)
+    std::unordered_map<int, std::set<int>> related;           // both ends of every friendship row
+    std::map<int, Group> groups;
+    std::set<std::pair<int, int>> groupMembers;               // (group, user)
+    std::set<std::pair<int, int>> memberships;                // (user, group)
+    std::map<int, Post> posts;
+    std::map<int, std::set<int>> postsByUser;
+    std::unordered_map<std::string, std::vector<int>> postings;   // term -> ascending post ids
+    uint64_t totalTerms = 0;
+    std::map<int, std::vector<OfflineMessage>> offline;
+    std::unordered_map<int64_t, std::vector<HistoryMessage>> history;   // conversation -> messages, seq = index + 1
+
+    int nextUserId = 1;
+    int nextGroupId = 1;
+    int nextPostId = 1;
+    int lastId = 0;
+    std::string snapshotPath;
+
+    // Search terms are case-insensitive, like the FTS5 default tokenizer
+    static std::vector<std::string> terms(const std::string& text) {
+        std::vector<std::string> result = searchTerms(text);
+        for (auto& term : result) {
+            for (auto& c : term) {
+                if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+            }
+        }
+        return result;
+    }
+
+    void indexPost(int id, Post& post) {
+        std::vector<std::string> words = terms(post.content);
+        post.length = static_cast<int>(words.size());
+        totalTerms += words.size();
+        std::sort(words.begin(), words.end());
+        words.erase(std::unique(words.begin(), words.end()), words.end());
+        for (const auto& word : words) postings[word].push_back(id);   // ids only grow
+    }
+
+    void unindexPost(int id, const Post& post) {
+        std::vector<std::string> words = terms(post.content);
+        totalTerms -= words.size();
+        std::sort(words.begin(), words.end());
+        words.erase(std::unique(words.begin(), words.end()), words.end());
+        for (const auto& word : words) {
+            auto it = postings.find(word);
+            if (it == postings.end()) continue;
+            std::vector<int>& list = it->second;
+            auto pos = std::lower_bound(list.begin(), list.end(), id);
+            if (pos != list.end() && *pos == id) list.erase(pos);
+            if (list.empty()) postings.erase(it);
+        }
+    }
+
+    const Friendship* accepted(int a, int b) const {
+        auto it = friendships.find({a, b});
+        if (it != friendships.end() && it->second.status == 1) return &it->second;
+        it = friendships.find({b, a});
+        if (it != friendships.end() && it->second.status == 1) return &it->second;
+        return nullptr;
+    }
+
+    // Feed visibility: public, own, friends-only for friends, close for close friends
+    bool canSee(int viewer, const Post& post) const {
+        if (post.visibility == 0 || post.userId == viewer) return true;
+        const Friendship* f = accepted(viewer, post.userId);
+        if (!f) return false;
+        return post.visibility == 1 || f->type == 1;
+    }
+
+    // Accepted friends that still exist, optionally with the "(Close)" mark
+    std::vector<std::string> friendNames(int userId, bool markClose) const {
+        std::vector<std::string> names;
+        auto mine = related.find(userId);
+        if (mine == related.end()) return names;
+        for (int other : mine->second) {
+            const Friendship* f = accepted(userId, other);
+            auto u = users.find(other);
+            if (!f || u == users.end()) continue;
+            names.push_back(u->second.name + (markClose && f->type == 1 ? " (Close)" : ""));
+        }
+        return names;
+    }
+
+    std::string feedLine(const Post& post) const {
+        return users.at(post.userId).name + " " + visibilityLabel(post.visibility) + ": " + post.content;
+    }
+
+    static std::string utcNow() {
+        std::time_t now = std::time(nullptr);
+        std::tm tm{};
+        gmtime_r(&now, &tm);
+        char buf[32];
+        std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+        return buf;
+    }
+
+    // --- snapshot encoding: little-endian integers, length-prefixed strings ---
+
+    static void putInt(std::string& out, int64_t v) {
+        for (int i = 0; i < 8; i++) out += static_cast<char>((static_cast<uint64_t>(v) >> (8 * i)) & 0xff);
+    }
+    static void putString(std::string& out, const std::string& s) {
+        putInt(out, static_cast<int64_t>(s.size()));
+        out += s;
+    }
+
+    struct Reader {
+        const std::string& data;
+        size_t pos = 0;
+        bool ok = true;
+
+        int64_t integer() {
+            if (data.size() - pos < 8) { ok = false; return 0; }
+            uint64_t v = 0;
+            for (int i = 0; i < 8; i++) v |= static_cast<uint64_t>(static_cast<unsigned char>(data[pos + i])) << (8 * i);
+            pos += 8;
+            return static_cast<int64_t>(v);
+        }
+        std::string string() {
+            int64_t n = integer();
+            if (!ok || n < 0 || static_cast<uint64_t>(n) > data.size() - pos) { ok = false; return ""; }
+            std::string s = data.substr(pos, static_cast<size_t>(n));
+            pos += static_cast<size_t>(n);
+            return s;
+        }
+    };
+
+    static constexpr const char* SNAPSHOT_MAGIC = "VSOCMEM1";
+
+    std::string encode() const {
+        std::string out = SNAPSHOT_MAGIC;
+        putInt(out, nextUserId);
+        putInt(out, nextGroupId);
+        putInt(out, nextPostId);
+
+        putInt(out, static_cast<int64_t>(users.size()));
+        for (const auto& u : users) {
+            putInt(out, u.first);
+            putString(out, u.second.name);
+            putString(out, u.second.password);
+            putInt(out, u.second.role);
+        }
+        putInt(out, static_cast<int64_t>(friendships.size()));
+        for (const auto& f : friendships) {
+            putInt(out, f.first.first);
+            putInt(out, f.first.second);
+            putInt(out, f.second.status);
+            putInt(out, f.second.type);
+        }
+        putInt(out, static_cast<int64_t>(groups.size()));
+        for (const auto& g : groups) {
+            putInt(out, g.first);
+            putString(out, g.second.name);
+            putInt(out, g.second.createdBy);
+        }
+        putInt(out, static_cast<int64_t>(groupMembers.size()));
+        for (const auto& m : groupMembers) {
+            putInt(out, m.first);
+            putInt(out, m.second);
+        }
+        putInt(out, static_cast<int64_t>(posts.size()));
+        for (const auto& p : posts) {
+            putInt(out, p.first);
+            putInt(out, p.second.userId);
+            putString(out, p.second.content);
+            putInt(out, p.second.visibility);
+        }
+        putInt(out, static_cast<int64_t>(offline.size()));
+        for (const auto& box : offline) {
+            putInt(out, box.first);
+            putInt(out, static_cast<int64_t>(box.second.size()));
+            for (const auto& m : box.second) {
+                putString(out, m.sender);
+                putString(out, m.content);
+                putString(out, m.timestamp);
+                putInt(out, m.isGroup ? 1 : 0);
+                putInt(out, m.groupId);
+            }
+        }
+        putInt(out, static_cast<int64_t>(history.size()));
+        for (const auto& conversation : history) {
+            putInt(out, conversation.first);
+            putInt(out, static_cast<int64_t>(conversation.second.size()));
+            for (const auto& m : conversation.second) {
+                putString(out, m.sender);
+                putString(out, m.content);
+                putString(out, m.timestamp);
+            }
+        }
+        return out;
+    }
+
+    bool decode(const std::string& data) {
+        size_t magicLen = std::char_traits<char>::length(SNAPSHOT_MAGIC);
+        if (data.compare(0, magicLen, SNAPSHOT_MAGIC) != 0) return false;
+        Reader in{data, magicLen};
+        nextUserId = static_cast<int>(in.integer());
+        nextGroupId = static_cast<int>(in.integer());
+        nextPostId = static_cast<int>(in.integer());
+
+        for (int64_t n = in.integer(); in.ok && n > 0; n--) {
+            int id = static_cast<int>(in.integer());
+            User u;
+            u.name = in.string();
+            u.password = in.string();
+            u.role = static_cast<int>(in.integer());
+            userIds[u.name] = id;
+            users[id] = std::move(u);
+        }
+        for (int64_t n = in.integer(); in.ok && n > 0; n--) {
+            int a = static_cast<int>(in.integer());
+            int b = static_cast<int>(in.integer());
+            Friendship f;
+            f.status = static_cast<int>(in.integer());
+            f.type = static_cast<int>(in.integer());
+            friendships[{a, b}] = f;
+            related[a].insert(b);
+            related[b].insert(a);
+        }
+        for (int64_t n = in.integer(); in.ok && n > 0; n--) {
+            int id = static_cast<int>(in.integer());
+            Group g;
+            g.name = in.string();
+            g.createdBy = static_cast<int>(in.integer());
+            groups[id] = std::move(g);
+        }
+        for (int64_t n = in.integer(); in.ok && n > 0; n--) {
+            int group = static_cast<int>(in.integer());
+            int user = static_cast<int>(in.integer());
+            groupMembers.insert({group, user});
+            memberships.insert({user, group});
+        }
+        for (int64_t n = in.integer(); in.ok && n > 0; n--) {
+            int id = static_cast<int>(in.integer());
+            Post p;
+            p.userId = static_cast<int>(in.integer());
+            p.content = in.string();
+            p.visibility = static_cast<int>(in.integer());
+            Post& stored = posts[id] = std::move(p);
+            postsByUser[stored.userId].insert(id);
+            indexPost(id, stored);
+        }
+        for (int64_t n = in.integer(); in.ok && n > 0; n--) {
+            int target = static_cast<int>(in.integer());
+            std::vector<OfflineMessage>& box = offline[target];
+            for (int64_t m = in.integer(); in.ok && m > 0; m--) {
+                OfflineMessage msg;
+                msg.sender = in.string();
+                msg.content = in.string();
+                msg.timestamp = in.string();
+                msg.isGroup = in.integer() != 0;
+                msg.groupId = static_cast<int>(in.integer());
+                box.push_back(std::move(msg));
+            }
+        }
+        // Snapshots written before message history end here
+        if (in.ok && in.pos == data.size()) return true;
+        for (int64_t n = in.integer(); in.ok && n > 0; n--) {
+            std::vector<HistoryMessage>& messages = history[in.integer()];
+            for (int64_t m = in.integer(); in.ok && m > 0; m--) {
+                HistoryMessage msg;
+                msg.sender = in.string();
+                msg.content = in.string();
+                msg.timestamp = in.string();
+                messages.push_back(std::move(msg));
+            }
+        }
+        return in.ok;
+    }
+
+    void clear() {
+        users.clear(); userIds.clear(); friendships.clear(); related.clear(); groups.clear();
+        groupMembers.clear(); memberships.clear(); posts.clear(); postsByUser.clear();
+        postings.clear(); totalTerms = 0; offline.clear(); history.clear();
+        nextUserId = nextGroupId = nextPostId = 1;
+    }
+
+public:
+    // snapshot: file to load at startup and to save to, "" for none
+    explicit MemoryStorage(const std::string& snapshot = "") : snapshotPath(snapshot) {
+        if (snapshotPath.empty()) return;
+        FILE* f = std::fopen(snapshotPath.c_str(), "rb");
+        if (!f) return;   // first run
+        std::string data;
+        char buf[65536];
+        size_t n;
+        while ((n = std::fread(buf, 1, sizeof(buf), f)) > 0) data.append(buf, n);
+        std::fclose(f);
+        if (!decode(data)) {
+            Logger::error("snapshot_unreadable", {{"path", snapshotPath}});
+            clear();
+            return;
+        }
+        Logger::info("snapshot_loaded", {{"path", snapshotPath}, {"users", std::to_string(users.size())},
+                                         {"posts", std::to_string(posts.size())}});
+    }
+
+    bool hasSnapshot() const { return !snapshotPath.empty(); }
+
+    bool saveSnapshot() {
+        if (snapshotPath.empty()) return false;
+        std::string data = encode();
+        std::string tmp = snapshotPath + ".tmp";
+        FILE* f = std::fopen(tmp.c_str(), "wb");
+        if (!f) {
+            Logger::error("snapshot_failed", {{"path", tmp}, {"error", "open"}});
+            return false;
+        }
+        bool ok = std::fwrite(data.data(), 1, data.size(), f) == data.size();
+        ok = std::fflush(f) == 0 && ok;
+        ok = fsync(fileno(f)) == 0 && ok;
+        std::fclose(f);
+        if (!ok || std::rename(tmp.c_str(), snapshotPath.c_str()) != 0) {
+            Logger::error("snapshot_failed", {{"path", snapshotPath}, {"error", "write"}});
+            std::remove(tmp.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // --- USER MANAGEMENT ---
+
+    bool registerUser(const std::string& username, const std::string& password, int role) override {
+        if (userIds.count(username)) return false;
+        int id = nextUserId++;
+        users[id] = User{username, password, role};
+        userIds[username] = id;
+        lastId = id;
+        return true;
+    }
+
+    int lastInsertId() override { return lastId; }
+
+    bool checkLogin(const std::string& username, const std::string& password) override {
+        auto it = userIds.find(username);
+        return it != userIds.end() && users.at(it->second).password == password;
+    }
+
+    int getUserId(const std::string& username) override {
+        auto it = userIds.find(username);
+        return it == userIds.end() ? -1 : it->second;
+    }
+
+    bool isAdmin(int userId) override {
+        auto it = users.find(userId);
+        return it != users.end() && it->second.role == 1;
+    }
+
+    // Like the SQLite engine, only the user row goes; whatever refers to it
+    // is skipped from then on because the author / member no longer exists
+    bool deleteUser(const std::string& username) override {
+        auto it = userIds.find(username);
+        if (it != userIds.end()) {
+            users.erase(it->second);
+            userIds.erase(it);
+        }
+        return true;
+    }
+
+    std::vector<std::pair<int, std::string>> getAllUsers() override {
+        std::vector<std::pair<int, std::string>> result;
+        result.reserve(users.size());
+        for (const auto& u : users) result.emplace_back(u.first, u.second.name);
+        return result;
+    }
+
+    // --- FRIENDSHIPS ---
+
+    std::vector<std::pair<int, int>> getAcceptedFriendships() override {
+        std::vector<std::pair<int, int>> result;
+        for (const auto& f : friendships) {
+            if (f.second.status == 1 && users.count(f.first.first) && users.count(f.first.second)) {
+                result.push_back(f.first);
+            }
+        }
+        return result;
+    }
+
+    bool sendFriendRequest(int fromId, int toId, int type) override {
+        if (!friendships.emplace(std::make_pair(fromId, toId), Friendship{0, type}).second) return false;
+        related[fromId].insert(toId);
+        related[toId].insert(fromId);
+        return true;
+    }
+
+    std::vector<std::string> getPendingRequests(int userId) override {
+        std::vector<std::string> result;
+        auto mine = related.find(userId);
+        if (mine == related.end()) return result;
+        for (int other : mine->second) {
+            auto f = friendships.find({other, userId});
+            auto u = users.find(other);
+            if (f == friendships.end() || f->second.status != 0 || u == users.end()) continue;
+            result.push_back(u->second.name + (f->second.type == 1 ? " (Close Friend Request)" : ""));
+        }
+        return result;
+    }
+
+    bool acceptFriendRequest(int myId, int requesterId) override {
+        auto it = friendships.find({requesterId, myId});
+        if (it == friendships.end() || it->second.status != 0) return false;
+        it->second.status = 1;
+        return true;
+    }
+
+    std::vector<std::string> getFriendsList(int userId) override {
+        return friendNames(userId, true);
+    }
+
+    // Accepted friends only, for presence fan-out
+    std::vector<std::string> getFriendUsernames(int userId) override {
+        return friendNames(userId, false);
+    }
+
+    // --- GROUPS ---
+
+    int createGroup(const std::string& name, int creatorId) override {
+        int id = nextGroupId++;
+        groups[id] = Group{name, creatorId};
+        lastId = id;
+        return id;
+    }
+
+    bool addToGroup(int groupId, int userId) override {
+        groupMembers.insert({groupId, userId});
+        memberships.insert({userId, groupId});
+        return true;
+    }
+
+    bool isUserInGroup(int userId, int groupId) override {
+        return groupMembers.count({groupId, userId}) > 0;
+    }
+
+    std::vector<std::string> getGroupMembers(int groupId) override {
+        std::vector<std::string> members;
+        for (auto it = groupMembers.lower_bound({groupId, INT32_MIN}); it != groupMembers.end() && it->first == groupId; ++it) {
+            auto u = users.find(it->second);
+            if (u != users.end()) members.push_back(u->second.name);
+        }
+        return members;
+    }
+
+    std::vector<std::string> getUserGroups(int userId) override {
+        std::vector<std::string> result;
+        for (auto it = memberships.lower_bound({userId, INT32_MIN}); it != memberships.end() && it->first == userId; ++it) {
+            auto g = groups.find(it->second);
+            if (g != groups.end()) result.push_back(std::to_string(g->first) + ": " + g->second.name);
+        }
+        return result;
+    }
+
+    // --- POSTS & FEED ---
+
+    bool createPost(int userId, const std::string& content, int visibility) override {
+        int id = nextPostId++;
+        Post& post = posts[id] = Post{userId, content, visibility, 0};
+        postsByUser[userId].insert(id);
+        indexPost(id, post);
+        lastId = id;
+        return true;
+    }
+
+    bool deletePost(int postId, int userId) override {
+        auto it = posts.find(postId);
+        if (it == posts.end() || it->second.userId != userId) return false;
+        unindexPost(postId, it->second);
+        postsByUser[userId].erase(postId);
+        posts.erase(it);
+        return true;
+    }
+
+    int getProfileTier(int myId, int targetId) override {
+        if (myId == targetId) return 2;
+        const Friendship* f = accepted(myId, targetId);
+        return f ? f->type + 1 : 0;
+    }
+
+    std::vector<std::string> getPostsForTier(int targetId, int tier) override {
+        std::vector<std::string> result;
+        auto mine = postsByUser.find(targetId);
+        if (mine == postsByUser.end()) return result;
+        for (auto id = mine->second.rbegin(); id != mine->second.rend(); ++id) {
+            const Post& post = posts.at(*id);
+            if (post.visibility <= tier) result.push_back(std::string(visibilityLabel(post.visibility)) + ": " + post.content);
+        }
+        return result;
+    }
+
+    std::vector<std::string> getPostsBefore(int targetId, int tier, int beforeId, int limit, int& nextCursor) override {
+        std::vector<std::string> result;
+        nextCursor = -1;
+        auto mine = postsByUser.find(targetId);
+        if (mine == postsByUser.end()) return result;
+        int last = -1;
+        for (auto id = std::make_reverse_iterator(mine->second.lower_bound(beforeId)); id != mine->second.rend(); ++id) {
+            const Post& post = posts.at(*id);
+            if (post.visibility > tier) continue;
+            if (static_cast<int>(result.size()) == limit) {
+                nextCursor = last;
+                break;
+            }
+            result.push_back(std::string(visibilityLabel(post.visibility)) + ": " + post.content);
+            last = *id;
+        }
+        return result;
+    }
+
+    std::vector<std::string> getNewsFeed(int myUserId) override {
+        std::vector<std::string> feed;
+        for (auto it = posts.rbegin(); it != posts.rend() && feed.size() < 50; ++it) {
+            if (users.count(it->second.userId) && canSee(myUserId, it->second)) feed.push_back(feedLine(it->second));
+        }
+        return feed;
+    }
+
+    // Candidates come from intersecting the terms' posting lists and are
+    // ranked with BM25 (k1=1.2, b=0.75, as FTS5 does). The full candidate
+    // set is ranked on every call; in memory that is cheap next to a round
+    // trip, and cursor / scanLimit keep the pages identical to SQLite's.
+    std::vector<std::string> searchPosts(int myUserId, const std::string& text, const SearchCursor& cursor,
+                                         int pageSize, int scanLimit, SearchCursor& nextCursor) override {
+        std::vector<std::string> results;
+        nextCursor = SearchCursor{};
+        std::vector<std::string> words = terms(text);
+        if (words.empty() || posts.empty()) return results;
+
+        std::vector<const std::vector<int>*> lists;
+        for (const auto& word : words) {
+            auto it = postings.find(word);
+            if (it == postings.end()) return results;
+            lists.push_back(&it->second);
+        }
+        std::sort(lists.begin(), lists.end(), [](const std::vector<int>* a, const std::vector<int>* b) {
+            return a->size() < b->size();
+        });
+        std::vector<int> candidates = *lists[0];
+        for (size_t i = 1; i < lists.size() && !candidates.empty(); i++) {
+            std::vector<int> next;
+            std::set_intersection(candidates.begin(), candidates.end(), lists[i]->begin(), lists[i]->end(),
+                                  std::back_inserter(next));
+            candidates.swap(next);
+        }
+
+        const double k1 = 1.2, b = 0.75;
+        double docs = static_cast<double>(posts.size());
+        double avgLength = static_cast<double>(totalTerms) / docs;
+        std::vector<std::pair<double, int>> ranked;   // (rank = -score, post id)
+        for (int id : candidates) {
+            const Post& post = posts.at(id);
+            if (!users.count(post.userId)) continue;
+            std::vector<std::string> postWords = terms(post.content);
+            double score = 0;
+            for (size_t i = 0; i < words.size(); i++) {
+                double df = static_cast<double>(postings.at(words[i]).size());
+                double idf = std::max(1e-6, std::log((docs - df + 0.5) / (df + 0.5)));
+                double tf = static_cast<double>(std::count(postWords.begin(), postWords.end(), words[i]));
+                score += idf * tf * (k1 + 1) / (tf + k1 * (1 - b + b * post.length / avgLength));
+            }
+            ranked.emplace_back(-score, id);
+        }
+        std::sort(ranked.begin(), ranked.end());
+
+        int examined = 0;
+        SearchCursor last;
+        for (size_t i = 0; i < ranked.size() && examined < scanLimit && (int)results.size() < pageSize; i++) {
+            if (!cursor.before(ranked[i].first, ranked[i].second)) continue;
+            examined++;
+            last = SearchCursor{ranked[i].first, ranked[i].second};
+            const Post& post = posts.at(ranked[i].second);
+            if (canSee(myUserId, post)) results.push_back(feedLine(post));
+        }
+        if ((int)results.size() == pageSize || examined == scanLimit) nextCursor = last;
+        return results;
+    }
+
+    // --- OFFLINE MESSAGES ---
+
+    void storeOfflineMessage(int targetUserId, const std::string& senderName, const std::string& content,
+                             bool isGroup, int groupId) override {
+        offline[targetUserId].push_back(OfflineMessage{senderName, content, utcNow(), isGroup, groupId});
+    }
+
+    std::vector<std::string> retrieveOfflineMessages(int userId) override {
+        std::vector<std::string> messages;
+        auto it = offline.find(userId);
+        if (it == offline.end()) return messages;
+        for (const auto& m : it->second) {
+            if (m.isGroup) {
+                messages.push_back("[OFFLINE Group " + std::to_string(m.groupId) + " | " + m.sender + " @ " + m.timestamp + "]: " + m.content);
+            } else {
+                messages.push_back("[OFFLINE Private | " + m.sender + " @ " + m.timestamp + "]: " + m.content);
+            }
+        }
+        offline.erase(it);
+        return messages;
+    }
+
+    // --- MESSAGE HISTORY ---
+
+    void appendHistory(int64_t conversation, const std::string& senderName, const std::string& content) override {
+        history[conversation].push_back(HistoryMessage{senderName, content, utcNow()});
+    }
+
+    std::vector<std::string> getHistory(int64_t conversation, int64_t beforeSeq, int limit, int64_t& nextCursor) override {
+        std::vector<std::string> lines;
+        nextCursor = -1;
+        auto it = history.find(conversation);
+        if (it == history.end() || beforeSeq <= 1 || limit <= 0) return lines;
+        const std::vector<HistoryMessage>& messages = it->second;
+        int64_t end = std::min<int64_t>(beforeSeq - 1, static_cast<int64_t>(messages.size()));   // last seq in the page
+        int64_t start = std::max<int64_t>(1, end - limit + 1);
+        for (int64_t seq = start; seq <= end; seq++) {
+            const HistoryMessage& m = messages[static_cast<size_t>(seq - 1)];
+            lines.push_back("#" + std::to_string(seq) + " [" + m.sender + " @ " + m.timestamp + "]: " + m.content);
+        }
+        if (start > 1) nextCursor = start;
+        return lines;
+    }
+};
+
+#endif
@@ -0,0 +1,382 @@
+#ifndef POST_ARCHIVE_H
+#define POST_ARCHIVE_H
+
+#include <zlib.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Logger.h"
+#include "Storage.h"
+
+// A post as it moves from the posts table into the archive
+struct ArchivedPost {
+    int id;
+    int userId;
+    int visibility;
+    std::string content;
+};
+
+// Cold tier for old posts (--archive-dir). The maintenance job moves posts
+// older than --archive-after-days out of SQLite into immutable segment
+// files, posts-<last post id>.seg, which are mapped read-only:
+//
+//   header    "VSOCARC1", u32 users, u32 posts, u32 blocks, i32 first id, i32 last id, u32 reserved
+//   users     i32 user id, u32 first post, u32 posts      sorted by user id
+//   posts     i32 post id, u32 block, u32 offset, u32 length, u8 visibility, 3 pad
+//             grouped by user, newest first
+//   blocks    u64 offset, u32 bytes, u32 raw bytes
+//   data      zlib-compressed text, BLOCK_POSTS consecutive posts of a user per block
+//
+// in host byte order. Each segment covers the id range after the previous
+// one, so every post id up to maxPostId() is in the archive (or was
+// deleted), and the posts table only answers for ids above it. A segment
+// is written to a .tmp file and renamed when complete; that rename is what
+// moves its posts, the rows left in SQLite are only removed after it.
+class PostArchive {
+public:
+    static constexpr int BLOCK_POSTS = 64;
+    static constexpr const char* MAGIC = "VSOCARC1";
+
+    using Listener = std::function<void(const std::vector<int>& users)>;
+
+private:
+    struct Header {
+        char magic[8];
+        uint32_t users;
+        uint32_t posts;
+        uint32_t blocks;
+        int32_t firstId;
+        int32_t lastId;
+        uint32_t reserved;
+    };
+    struct UserEntry {
+        int32_t userId;
+        uint32_t first;
+        uint32_t count;
+    };
+    struct PostEntry {
+        int32_t postId;
+        uint32_t block;
+        uint32_t offset;
+        uint32_t length;
+        uint8_t visibility;
+        uint8_t pad[3];
+    };
+    struct BlockEntry {
+        uint64_t offset;
+        uint32_t bytes;
+        uint32_t rawBytes;
+    };
+
+    class Segment {
+    public:
+        const unsigned char* map = nullptr;
+        size_t size = 0;
+        const Header* header = nullptr;
+        const UserEntry* users = nullptr;
+        const PostEntry* posts = nullptr;
+        const BlockEntry* blocks = nullptr;
+
+        ~Segment() {
+            if (map) munmap(const_cast<unsigned char*>(map), size);
+        }
+
+        bool load(const std::string& path) {
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) return false;
+            struct stat st;
+            if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+                ::close(fd);
+                return false;
+            }
+            size = static_cast<size_t>(st.st_size);
+            void* p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (p == MAP_FAILED) return false;
+            map = static_cast<const unsigned char*>(p);
+            header = reinterpret_cast<const Header*>(map);
+            size_t tables = sizeof(Header) + header->users * sizeof(UserEntry) + header->posts * sizeof(PostEntry) +
+                            header->blocks * sizeof(BlockEntry);
+            if (std::memcmp(header->magic, MAGIC, 8) != 0 || tables > size) return false;
+            users = reinterpret_cast<const UserEntry*>(map + sizeof(Header));
+            posts = reinterpret_cast<const PostEntry*>(users + header->users);
+            blocks = reinterpret_cast<const BlockEntry*>(posts + header->posts);
+            return true;
+        }
+
+        const UserEntry* find(int userId) const {
+            const UserEntry* end = users + header->users;
+            const UserEntry* it = std::lower_bound(users, end, userId,
+                                                   [](const UserEntry& e, int id) { return e.userId < id; });
+            return it != end && it->userId == userId ? it : nullptr;
+        }
+
+        bool inflate(uint32_t block, std::string& out) const {
+            if (block >= header->blocks) return false;
+            const BlockEntry& b = blocks[block];
+            if (b.offset + b.bytes > size) return false;
+            out.resize(b.rawBytes);
+            uLongf rawBytes = b.rawBytes;
+            return uncompress(reinterpret_cast<Bytef*>(&out[0]), &rawBytes, map + b.offset, b.bytes) == Z_OK &&
+                   rawBytes == b.rawBytes;
+        }
+    };
+
+    std::string dir;
+    mutable std::mutex mutex;
+    std::vector<std::shared_ptr<const Segment>> segments;   // oldest first
+    std::atomic<int> lastArchived{0};
+    std::atomic<uint64_t> postCount{0};
+    std::atomic<uint64_t> byteCount{0};
+    Listener listener;
+
+    static std::string segmentPath(const std::string& dir, int lastId) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "posts-%010d.seg", lastId);
+        return dir + "/" + name;
+    }
+
+    std::vector<std::shared_ptr<const Segment>> snapshot() const {
+        std::lock_guard<std::mutex> guard(mutex);
+        return segments;
+    }
+
+    void publish(std::shared_ptr<const Segment> segment) {
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            segments.push_back(segment);
+        }
+        postCount += segment->header->posts;
+        byteCount += segment->size;
+        lastArchived = segment->header->lastId;
+    }
+
+    static bool writeAll(int fd, const void* data, size_t size) {
+        const char* p = static_cast<const char*>(data);
+        while (size > 0) {
+            ssize_t n = ::write(fd, p, size);
+            if (n <= 0) return false;
+            p += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+public:
+    explicit PostArchive(const std::string& dir) : dir(dir) {}
+
+    // Maps the segments already in dir; leftovers of an interrupted write
+    // are removed
+    bool open() {
+        mkdir(dir.c_str(), 0755);
+        DIR* d = opendir(dir.c_str());
+        if (!d) {
+            Logger::error("archive_open_failed", {{"dir", dir}});
+            return false;
+        }
+        std::vector<int> ids;
+        while (struct dirent* entry = readdir(d)) {
+            std::string name = entry->d_name;
+            int id;
+            char tail[8];
+            if (name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0) {
+                std::remove((dir + "/" + name).c_str());
+            } else if (std::sscanf(name.c_str(), "posts-%10d.%3s", &id, tail) == 2 && std::strcmp(tail, "seg") == 0) {
+                ids.push_back(id);
+            }
+        }
+        closedir(d);
+        std::sort(ids.begin(), ids.end());
+        for (int id : ids) {
+            auto segment = std::make_shared<Segment>();
+            if (!segment->load(segmentPath(dir, id))) {
+                Logger::error("archive_segment_bad", {{"path", segmentPath(dir, id)}});
+                return false;
+            }
+            publish(segment);
+        }
+        return true;
+    }
+
+    // Called from the maintenance thread with the authors of every segment
+    // written, once its posts are readable from the archive
+    void onArchived(Listener callback) { listener = std::move(callback); }
+
+    // Writes posts (ascending ids, all above maxPostId()) as a new segment
+    bool archive(const std::vector<ArchivedPost>& batch) {
+        if (batch.empty()) return true;
+        std::vector<const ArchivedPost*> order;
+        order.reserve(batch.size());
+        for (const ArchivedPost& post : batch) order.push_back(&post);
+        std::sort(order.begin(), order.end(), [](const ArchivedPost* a, const ArchivedPost* b) {
+            return a->userId != b->userId ? a->userId < b->userId : a->id > b->id;
+        });
+
+        std::vector<UserEntry> users;
+        std::vector<PostEntry> posts;
+        std::vector<BlockEntry> blocks;
+        std::vector<std::string> data;
+        std::string raw;
+        int inBlock = 0;
+        auto closeBlock = [&]() {
+            if (inBlock == 0) return;
+            uLongf bytes = compressBound(raw.size());
+            std::string packed(bytes, '\0');
+            compress2(reinterpret_cast<Bytef*>(&packed[0]), &bytes, reinterpret_cast<const Bytef*>(raw.data()),
+                      raw.size(), Z_BEST_COMPRESSION);
+            packed.resize(bytes);
+            blocks.push_back(BlockEntry{0, static_cast<uint32_t>(bytes), static_cast<uint32_t>(raw.size())});
+            data.push_back(std::move(packed));
+            raw.clear();
+            inBlock = 0;
+        };
+        for (const ArchivedPost* post : order) {
+            if (users.empty() || users.back().userId != post->userId) {
+                closeBlock();
+                users.push_back(UserEntry{post->userId, static_cast<uint32_t>(posts.size()), 0});
+            }
+            users.back().count++;
+            PostEntry entry{};
+            entry.postId = post->id;
+            entry.block = static_cast<uint32_t>(blocks.size());
+            entry.offset = static_cast<uint32_t>(raw.size());
+            entry.length = static_cast<uint32_t>(post->content.size());
+            entry.visibility = static_cast<uint8_t>(post->visibility);
+            posts.push_back(entry);
+            raw += post->content;
+            if (++inBlock == BLOCK_POSTS) closeBlock();
+        }
+        closeBlock();
+
+        Header header{};
+        std::memcpy(header.magic, MAGIC, 8);
+        header.users = static_cast<uint32_t>(users.size());
+        header.posts = static_cast<uint32_t>(posts.size());
+        header.blocks = static_cast<uint32_t>(blocks.size());
+        header.firstId = batch.front().id;
+        header.lastId = batch.back().id;
+        uint64_t offset = sizeof(Header) + users.size() * sizeof(UserEntry) + posts.size() * sizeof(PostEntry) +
+                          blocks.size() * sizeof(BlockEntry);
+        for (size_t i = 0; i < blocks.size(); i++) {
+            blocks[i].offset = offset;
+            offset += blocks[i].bytes;
+        }
+
+        std::string path = segmentPath(dir, header.lastId);
+        std::string tmp = path + ".tmp";
+        int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        bool ok = fd >= 0 && writeAll(fd, &header, sizeof(header)) &&
+                  writeAll(fd, users.data(), users.size() * sizeof(UserEntry)) &&
+                  writeAll(fd, posts.data(), posts.size() * sizeof(PostEntry)) &&
+                  writeAll(fd, blocks.data(), blocks.size() * sizeof(BlockEntry));
+        for (size_t i = 0; ok && i < data.size(); i++) ok = writeAll(fd, data[i].data(), data[i].size());
+        // Durable before the rows in SQLite go
+        if (ok) ok = fsync(fd) == 0;
+        if (fd >= 0) ::close(fd);
+        if (ok) ok = std::rename(tmp.c_str(), path.c_str()) == 0;
+        if (ok) {
+            int dfd = ::open(dir.c_str(), O_RDONLY);
+            if (dfd >= 0) {
+                fsync(dfd);
+                ::close(dfd);
+            }
+        }
+        auto segment = std::make_shared<Segment>();
+        if (!ok || !segment->load(path)) {
+            Logger::error("archive_write_failed", {{"path", path}});
+            std::remove(tmp.c_str());
+            return false;
+        }
+        publish(segment);
+        Logger::info("archive_segment", {{"path", path}, {"posts", std::to_string(posts.size())},
+                                         {"bytes", std::to_string(segment->size)}});
+
+        if (listener) {
+            std::vector<int> authors;
+            for (const UserEntry& user : users) authors.push_back(user.userId);
+            listener(authors);
+        }
+        return true;
+    }
+
+    // Every post id up to this one has left the posts table
+    int maxPostId() const { return lastArchived; }
+
+    // Newest archived post of userId, 0 if none
+    int newestOf(int userId) const {
+        auto all = snapshot();
+        for (auto it = all.rbegin(); it != all.rend(); ++it) {
+            if (const UserEntry* user = (*it)->find(userId)) return (*it)->posts[user->first].postId;
+        }
+        return 0;
+    }
+
+    bool contains(int userId, int postId) const {
+        for (const auto& segment : snapshot()) {
+            if (postId < segment->header->firstId || postId > segment->header->lastId) continue;
+            const UserEntry* user = segment->find(userId);
+            if (!user) return false;
+            const PostEntry* begin = segment->posts + user->first;
+            const PostEntry* end = begin + user->count;
+            const PostEntry* it = std::lower_bound(begin, end, postId,
+                                                   [](const PostEntry& e, int id) { return e.postId > id; });
+            return it != end && it->postId == postId;
+        }
+        return false;
+    }
+
+    // Up to limit of userId's posts with id < beforeId and visibility <= tier,
+    // newest first, as (post id, profile line)
+    std::vector<std::pair<int, std::string>> read(int userId, int tier, int beforeId, int limit) const {
+        std::vector<std::pair<int, std::string>> result;
+        auto all = snapshot();
+        for (auto it = all.rbegin(); it != all.rend() && static_cast<int>(result.size()) < limit; ++it) {
+            const Segment& segment = **it;
+            if (segment.header->firstId >= beforeId) continue;
+            const UserEntry* user = segment.find(userId);
+            if (!user) continue;
+            const PostEntry* begin = segment.posts + user->first;
+            const PostEntry* end = begin + user->count;
+            const PostEntry* post = std::lower_bound(begin, end, beforeId,
+                                                     [](const PostEntry& e, int id) { return e.postId >= id; });
+            uint32_t inflated = UINT32_MAX;
+            std::string raw;
+            for (; post != end && static_cast<int>(result.size()) < limit; ++post) {
+                if (post->visibility > tier) continue;
+                if (post->block != inflated) {
+                    if (!segment.inflate(post->block, raw)) {
+                        Logger::error("archive_block_bad", {{"user", std::to_string(userId)}, {"block", std::to_string(post->block)}});
+                        return result;
+                    }
+                    inflated = post->block;
+                }
+                if (static_cast<size_t>(post->offset) + post->length > raw.size()) continue;
+                result.emplace_back(post->postId, std::string(Storage::visibilityLabel(post->visibility)) + ": " +
+                                                      raw.substr(post->offset, post->length));
+            }
+        }
+        return result;
+    }
+
+    uint64_t segmentCount() const {
+        std::lock_guard<std::mutex> guard(mutex);
+        return segments.size();
+    }
+    uint64_t archivedPosts() const { return postCount; }
+    uint64_t bytes() const { return byteCount; }
+};
+
+#endif
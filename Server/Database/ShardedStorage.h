@@ -0,0 +1,327 @@
+#ifndef SHARDED_STORAGE_H
+#define SHARDED_STORAGE_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "Database.h"
+#include "Storage.h"
+
+// SQLite storage split over several files (--storage=sharded --shards=N).
+//
+// The main file (--db) keeps users, groups and group members. Each shard
+// file (<db>.shard<k>) keeps the posts, offline messages and friendship
+// rows of the users hashed to it; a friendship row is written to the
+// shards of both ends, so each side's friends, requests and feed
+// visibility can be answered by one shard. Message history goes by
+// conversation: a private one to the shard of its smaller user id, a
+// group's to the shard its id hashes to. Every shard also keeps a copy
+// of the users table, which lets it use the same queries as a lone
+// database.
+//
+// Each shard is owned by one writer thread that runs its jobs in order.
+// Writes whose result nobody waits for (offline and history messages, the
+// second copy of a friendship, user copies, new posts) are queued and the
+// event loop moves on, so writes to different shards proceed in parallel instead of
+// queueing for one file lock. Reads queue behind earlier writes to the
+// same shard and therefore see them. The feed and search ask all shards
+// at once and merge the answers.
+class ShardedStorage : public Storage {
+private:
+    class Shard {
+    private:
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::deque<std::function<void()>> jobs;
+        bool stopping = false;
+
+        void run() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                wake.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                if (jobs.empty()) return;   // stopping, queue drained
+                std::function<void()> job = std::move(jobs.front());
+                jobs.pop_front();
+                lock.unlock();
+                job();
+                lock.lock();
+            }
+        }
+
+    public:
+        DatabaseManager db;
+
+        explicit Shard(const std::string& path) : db(path) { thread = std::thread(&Shard::run, this); }
+
+        // Finishes the queued writes first
+        ~Shard() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_one();
+            thread.join();
+        }
+
+        void post(std::function<void()> job) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                jobs.push_back(std::move(job));
+            }
+            wake.notify_one();
+        }
+
+        template <typename F>
+        auto call(F f) -> std::future<decltype(f(db))> {
+            using Result = decltype(f(db));
+            auto task = std::make_shared<std::packaged_task<Result()>>([this, f]() { return f(db); });
+            std::future<Result> result = task->get_future();
+            post([task]() { (*task)(); });
+            return result;
+        }
+    };
+
+    DatabaseManager main;
+    std::vector<std::unique_ptr<Shard>> shards;
+    int nextPostId = 1;
+    int lastId = 0;
+
+    Shard& shardOf(int userId) {
+        uint32_t h = static_cast<uint32_t>(userId) * 2654435761u;   // spread consecutive ids
+        return *shards[(h >> 16) % shards.size()];
+    }
+
+    Shard& shardOfConversation(int64_t conversation) {
+        return shardOf(static_cast<int>(conversation >> 32 ? conversation >> 32 : conversation));
+    }
+
+    void onAllShards(std::function<void(DatabaseManager&)> write) {
+        for (auto& shard : shards) {
+            Shard* s = shard.get();
+            s->post([s, write]() { write(s->db); });
+        }
+    }
+
+public:
+    ShardedStorage(const std::string& mainPath, int shardCount) : main(mainPath) {
+        if (shardCount < 1) shardCount = 1;
+        for (int k = 0; k < shardCount; k++) {
+            shards.push_back(std::make_unique<Shard>(mainPath + ".shard" + std::to_string(k)));
+        }
+        // Post ids are global so the feed can be merged by id
+        for (auto& shard : shards) {
+            nextPostId = std::max(nextPostId, shard->call([](DatabaseManager& db) { return db.maxPostId(); }).get() + 1);
+        }
+    }
+
+    // --- USER MANAGEMENT ---
+
+    bool registerUser(const std::string& username, const std::string& password, int role) override {
+        if (!main.registerUser(username, password, role)) return false;
+        int id = main.lastInsertId();
+        lastId = id;
+        onAllShards([id, username, password, role](DatabaseManager& db) { db.insertUser(id, username, password, role); });
+        return true;
+    }
+
+    int lastInsertId() override { return lastId; }
+    bool checkLogin(const std::string& username, const std::string& password) override { return main.checkLogin(username, password); }
+    int getUserId(const std::string& username) override { return main.getUserId(username); }
+    bool isAdmin(int userId) override { return main.isAdmin(userId); }
+
+    bool deleteUser(const std::string& username) override {
+        if (!main.deleteUser(username)) return false;
+        onAllShards([username](DatabaseManager& db) { db.deleteUser(username); });
+        return true;
+    }
+
+    std::vector<std::pair<int, std::string>> getAllUsers() override { return main.getAllUsers(); }
+
+    // --- FRIENDSHIPS ---
+
+    std::vector<std::pair<int, int>> getAcceptedFriendships() override {
+        std::set<std::pair<int, int>> edges;   // each one is on two shards
+        for (auto& shard : shards) {
+            for (const auto& edge : shard->call([](DatabaseManager& db) { return db.getAcceptedFriendships(); }).get()) {
+                edges.insert(edge);
+            }
+        }
+        return std::vector<std::pair<int, int>>(edges.begin(), edges.end());
+    }
+
+    // The sender's shard decides (the row may already exist); the target's
+    // copy follows in the background
+    bool sendFriendRequest(int fromId, int toId, int type) override {
+        Shard& home = shardOf(fromId);
+        bool created = home.call([fromId, toId, type](DatabaseManager& db) { return db.sendFriendRequest(fromId, toId, type); }).get();
+        Shard& other = shardOf(toId);
+        if (created && &other != &home) {
+            other.post([&other, fromId, toId, type]() { other.db.sendFriendRequest(fromId, toId, type); });
+        }
+        return created;
+    }
+
+    std::vector<std::string> getPendingRequests(int userId) override {
+        return shardOf(userId).call([userId](DatabaseManager& db) { return db.getPendingRequests(userId); }).get();
+    }
+
+    bool acceptFriendRequest(int myId, int requesterId) override {
+        Shard& home = shardOf(myId);
+        bool accepted = home.call([myId, requesterId](DatabaseManager& db) { return db.acceptFriendRequest(myId, requesterId); }).get();
+        Shard& other = shardOf(requesterId);
+        if (accepted && &other != &home) {
+            other.post([&other, myId, requesterId]() { other.db.acceptFriendRequest(myId, requesterId); });
+        }
+        return accepted;
+    }
+
+    std::vector<std::string> getFriendsList(int userId) override {
+        return shardOf(userId).call([userId](DatabaseManager& db) { return db.getFriendsList(userId); }).get();
+    }
+
+    std::vector<std::string> getFriendUsernames(int userId) override {
+        return shardOf(userId).call([userId](DatabaseManager& db) { return db.getFriendUsernames(userId); }).get();
+    }
+
+    // --- GROUPS ---
+
+    int createGroup(const std::string& name, int creatorId) override {
+        int id = main.createGroup(name, creatorId);
+        if (id != -1) lastId = id;
+        return id;
+    }
+    bool addToGroup(int groupId, int userId) override { return main.addToGroup(groupId, userId); }
+    bool isUserInGroup(int userId, int groupId) override { return main.isUserInGroup(userId, groupId); }
+    std::vector<std::string> getGroupMembers(int groupId) override { return main.getGroupMembers(groupId); }
+    std::vector<std::string> getUserGroups(int userId) override { return main.getUserGroups(userId); }
+
+    // --- POSTS & FEED ---
+
+    // Queued: the id is known up front and later reads of this shard run
+    // after it. Returns before the insert runs (see Storage::createPost);
+    // a failure is only logged, with the id the caller was given.
+    bool createPost(int userId, const std::string& content, int visibility) override {
+        int id = nextPostId++;
+        lastId = id;
+        Shard& home = shardOf(userId);
+        home.post([&home, id, userId, content, visibility]() {
+            if (!home.db.insertPost(id, userId, content, visibility)) {
+                Logger::error("shard_write_failed", {{"what", "post"}, {"post", std::to_string(id)}, {"user", std::to_string(userId)}});
+            }
+        });
+        return true;
+    }
+
+    bool deletePost(int postId, int userId) override {
+        return shardOf(userId).call([postId, userId](DatabaseManager& db) { return db.deletePost(postId, userId); }).get();
+    }
+
+    int getProfileTier(int myId, int targetId) override {
+        return shardOf(myId).call([myId, targetId](DatabaseManager& db) { return db.getProfileTier(myId, targetId); }).get();
+    }
+
+    std::vector<std::string> getPostsForTier(int targetId, int tier) override {
+        return shardOf(targetId).call([targetId, tier](DatabaseManager& db) { return db.getPostsForTier(targetId, tier); }).get();
+    }
+
+    std::vector<std::string> getPostsBefore(int targetId, int tier, int beforeId, int limit, int& nextCursor) override {
+        return shardOf(targetId).call([targetId, tier, beforeId, limit, &nextCursor](DatabaseManager& db) {
+            return db.getPostsBefore(targetId, tier, beforeId, limit, nextCursor);
+        }).get();
+    }
+
+    // Every shard answers for its own authors (it has both ends' friendship
+    // rows); the newest 50 of all answers win
+    std::vector<std::string> getNewsFeed(int myUserId) override {
+        const int limit = 50;
+        std::vector<std::future<std::vector<std::pair<int, std::string>>>> parts;
+        for (auto& shard : shards) {
+            parts.push_back(shard->call([myUserId, limit](DatabaseManager& db) { return db.getNewsFeedRows(myUserId, limit); }));
+        }
+        std::vector<std::pair<int, std::string>> rows;
+        for (auto& part : parts) {
+            for (auto& row : part.get()) rows.push_back(std::move(row));
+        }
+        std::sort(rows.begin(), rows.end(), [](const std::pair<int, std::string>& a, const std::pair<int, std::string>& b) {
+            return a.first > b.first;
+        });
+        std::vector<std::string> feed;
+        for (size_t i = 0; i < rows.size() && (int)i < limit; i++) feed.push_back(std::move(rows[i].second));
+        return feed;
+    }
+
+    // Each shard ranks its own posts (BM25 statistics are per shard), the
+    // lists are merged by (rank, id) and up to scanLimit matches after the
+    // cursor are taken from the merged order; every shard returns at most
+    // scanLimit of its own matches after the cursor.
+    std::vector<std::string> searchPosts(int myUserId, const std::string& text, const SearchCursor& cursor,
+                                         int pageSize, int scanLimit, SearchCursor& nextCursor) override {
+        std::vector<std::string> results;
+        nextCursor = SearchCursor{};
+        std::vector<std::future<std::vector<DatabaseManager::RankedPost>>> parts;
+        for (auto& shard : shards) {
+            parts.push_back(shard->call([myUserId, text, cursor, scanLimit](DatabaseManager& db) {
+                return db.searchRanked(myUserId, text, cursor, scanLimit);
+            }));
+        }
+        std::vector<DatabaseManager::RankedPost> matches;
+        for (auto& part : parts) {
+            for (auto& match : part.get()) matches.push_back(std::move(match));
+        }
+        std::sort(matches.begin(), matches.end(), [](const DatabaseManager::RankedPost& a, const DatabaseManager::RankedPost& b) {
+            return a.rank != b.rank ? a.rank < b.rank : a.id < b.id;
+        });
+
+        int examined = 0;
+        SearchCursor last;
+        for (size_t i = 0; i < matches.size() && examined < scanLimit && (int)results.size() < pageSize; i++) {
+            examined++;
+            last = SearchCursor{matches[i].rank, matches[i].id};
+            if (matches[i].visible) results.push_back(std::move(matches[i].line));
+        }
+        if ((int)results.size() == pageSize || examined == scanLimit) nextCursor = last;
+        return results;
+    }
+
+    // --- OFFLINE MESSAGES ---
+
+    void storeOfflineMessage(int targetUserId, const std::string& senderName, const std::string& content,
+                             bool isGroup, int groupId) override {
+        Shard& home = shardOf(targetUserId);
+        home.post([&home, targetUserId, senderName, content, isGroup, groupId]() {
+            home.db.storeOfflineMessage(targetUserId, senderName, content, isGroup, groupId);
+        });
+    }
+
+    std::vector<std::string> retrieveOfflineMessages(int userId) override {
+        return shardOf(userId).call([userId](DatabaseManager& db) { return db.retrieveOfflineMessages(userId); }).get();
+    }
+
+    // --- MESSAGE HISTORY ---
+
+    // Queued: the shard numbers the message when it gets to it, in the
+    // order the event loop sent them
+    void appendHistory(int64_t conversation, const std::string& senderName, const std::string& content) override {
+        Shard& home = shardOfConversation(conversation);
+        home.post([&home, conversation, senderName, content]() { home.db.appendHistory(conversation, senderName, content); });
+    }
+
+    std::vector<std::string> getHistory(int64_t conversation, int64_t beforeSeq, int limit, int64_t& nextCursor) override {
+        return shardOfConversation(conversation).call([conversation, beforeSeq, limit, &nextCursor](DatabaseManager& db) {
+            return db.getHistory(conversation, beforeSeq, limit, nextCursor);
+        }).get();
+    }
+};
+
+#endif
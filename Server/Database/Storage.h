@@ -0,0 +1,155 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Everything the server keeps persistently, independent of how it is
+// stored. DatabaseManager is the SQLite engine; MemoryStorage keeps it all
+// in process (benchmarks, tests, throwaway servers); ShardedStorage splits
+// per-user data over several SQLite files. Pick one with
+// --storage=sqlite|sharded|memory.
+//
+// Lines returned by the list queries are already formatted for display and
+// must be identical between engines.
+
+// Where a SEARCH page ends: the last ranked match looked at, as (rank, post
+// id) with lower ranks better (FTS5's rank, or minus the BM25 score). The
+// next page starts right after it, so deep pages cost no more than the
+// first. id 0 is the start (and, returned, the end) of the matches.
+struct SearchCursor {
+    double rank = 0;
+    int id = 0;
+
+    bool before(double otherRank, int otherId) const {
+        return id == 0 || rank < otherRank || (rank == otherRank && id < otherId);
+    }
+
+    // "<rank>:<id>", the rank printed so it reads back exactly
+    std::string str() const {
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), "%.17g:%d", rank, id);
+        return buf;
+    }
+
+    static bool parse(const std::string& text, SearchCursor& out) {
+        char* end = nullptr;
+        double rank = std::strtod(text.c_str(), &end);
+        if (end == text.c_str() || *end != ':') return false;
+        const char* idText = end + 1;
+        long id = std::strtol(idText, &end, 10);
+        if (end == idText || *end != '\0' || id <= 0) return false;
+        out = SearchCursor{rank, static_cast<int>(id)};
+        return true;
+    }
+};
+
+class Storage {
+public:
+    virtual ~Storage() = default;
+
+    // --- USER MANAGEMENT ---
+    virtual bool registerUser(const std::string& username, const std::string& password, int role) = 0;
+    virtual int lastInsertId() = 0;   // id of the user / group / post just created
+    virtual bool checkLogin(const std::string& username, const std::string& password) = 0;
+    virtual int getUserId(const std::string& username) = 0;
+    virtual bool isAdmin(int userId) = 0;
+    virtual bool deleteUser(const std::string& username) = 0;
+    virtual std::vector<std::pair<int, std::string>> getAllUsers() = 0;
+
+    // --- FRIENDSHIPS ---
+    virtual std::vector<std::pair<int, int>> getAcceptedFriendships() = 0;
+    virtual bool sendFriendRequest(int fromId, int toId, int type) = 0;
+    virtual std::vector<std::string> getPendingRequests(int userId) = 0;
+    virtual bool acceptFriendRequest(int myId, int requesterId) = 0;
+    virtual std::vector<std::string> getFriendsList(int userId) = 0;
+    virtual std::vector<std::string> getFriendUsernames(int userId) = 0;
+
+    // --- GROUPS ---
+    virtual int createGroup(const std::string& name, int creatorId) = 0;
+    virtual bool addToGroup(int groupId, int userId) = 0;
+    virtual bool isUserInGroup(int userId, int groupId) = 0;
+    virtual std::vector<std::string> getGroupMembers(int groupId) = 0;
+    virtual std::vector<std::string> getUserGroups(int userId) = 0;
+
+    // --- POSTS & FEED ---
+    // True once the post is accepted and has its id (lastInsertId). A
+    // storage may queue the insert and run it after returning (sharded
+    // does); reads issued afterwards still see it, and an insert that then
+    // fails is logged by the storage as shard_write_failed, not reported here.
+    virtual bool createPost(int userId, const std::string& content, int visibility) = 0;
+    virtual bool deletePost(int postId, int userId) = 0;
+    // What myId may see of targetId's posts: 0=Public, 1=Friends, 2=Close (or own profile)
+    virtual int getProfileTier(int myId, int targetId) = 0;
+    // Profile lines as seen from a tier; the same for every viewer in it
+    virtual std::vector<std::string> getPostsForTier(int targetId, int tier) = 0;
+    // Up to limit of targetId's posts older than beforeId as seen from a
+    // tier, newest first (VIEW_POSTS paging). nextCursor is the id to
+    // continue before, -1 once there is nothing older.
+    virtual std::vector<std::string> getPostsBefore(int targetId, int tier, int beforeId, int limit,
+                                                    int& nextCursor) = 0;
+    // Feed lines only; the caller adds the banner / empty-feed note
+    virtual std::vector<std::string> getNewsFeed(int myUserId) = 0;
+    // One page of posts containing every word of text, best match first,
+    // limited to what myUserId may see (same rules as getNewsFeed). Matches
+    // after cursor are looked at, at most scanLimit per call. nextCursor is
+    // the last one looked at, id 0 once the matches are exhausted.
+    virtual std::vector<std::string> searchPosts(int myUserId, const std::string& text, const SearchCursor& cursor,
+                                                 int pageSize, int scanLimit, SearchCursor& nextCursor) = 0;
+
+    std::vector<std::string> getPostsForProfile(int myId, int targetId) {
+        return getPostsForTier(targetId, getProfileTier(myId, targetId));
+    }
+
+    // --- OFFLINE MESSAGES ---
+    virtual void storeOfflineMessage(int targetUserId, const std::string& senderName, const std::string& content,
+                                     bool isGroup, int groupId) = 0;
+    // Formatted and removed from storage
+    virtual std::vector<std::string> retrieveOfflineMessages(int userId) = 0;
+
+    // --- MESSAGE HISTORY ---
+    // Every private and group message, numbered 1, 2, ... within its
+    // conversation and kept in (conversation, seq) order
+    virtual void appendHistory(int64_t conversation, const std::string& senderName, const std::string& content) = 0;
+    // Up to limit messages with seq < beforeSeq, oldest first, as
+    // "#<seq> [<sender> @ <time>]: <content>". nextCursor is the seq to
+    // continue before, -1 once there is nothing older.
+    virtual std::vector<std::string> getHistory(int64_t conversation, int64_t beforeSeq, int limit,
+                                                int64_t& nextCursor) = 0;
+
+    // Conversation ids: a group's is its id; a private one packs both user
+    // ids (smaller first) and is always above any group id
+    static int64_t groupConversation(int groupId) { return groupId; }
+    static int64_t privateConversation(int userA, int userB) {
+        int64_t low = std::min(userA, userB), high = std::max(userA, userB);
+        return (low << 32) | high;
+    }
+
+    // Words a search matches on: runs of letters and digits; bytes of
+    // multi-byte UTF-8 characters count as letters
+    static std::vector<std::string> searchTerms(const std::string& text) {
+        std::vector<std::string> terms;
+        std::string word;
+        for (size_t i = 0; i <= text.size(); i++) {
+            unsigned char c = i < text.size() ? static_cast<unsigned char>(text[i]) : ' ';
+            if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c >= 0x80) {
+                word += static_cast<char>(c);
+            } else if (!word.empty()) {
+                terms.push_back(word);
+                word.clear();
+            }
+        }
+        return terms;
+    }
+
+    static const char* visibilityLabel(int visibility) {
+        return visibility == 1 ? "[Friends]" : visibility == 2 ? "[Close]" : "[Public]";
+    }
+};
+
+#endif
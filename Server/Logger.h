@@ -0,0 +1,270 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <thread>
+#include <utility>
+
+enum class LogLevel { Debug = 0, Info = 1, Warn = 2, Error = 3 };
+
+// Key/value pairs attached to a record, printed as key=value
+using LogFields = std::initializer_list<std::pair<const char*, std::string>>;
+
+// Asynchronous logger. Producers (the event loop and worker threads) only
+// format a record and push it into a bounded lock-free queue; a background
+// thread does the actual write to stdout. When the queue is full the record
+// is dropped and counted instead of blocking the caller.
+class Logger {
+private:
+    static constexpr size_t QUEUE_SIZE = 8192;     // power of 2
+    static constexpr size_t RATE_SLOTS = 256;
+
+    struct Record {
+        int64_t timeMs;
+        LogLevel level;
+        const char* event;
+        std::string fields;
+    };
+
+    struct Slot {
+        std::atomic<size_t> seq;
+        Record record;
+    };
+
+    // Fixed one-second window per event name. Slots are claimed by name
+    // (open addressing on a hash of the string), so two events never share
+    // a window; there are far fewer event names than slots.
+    struct RateSlot {
+        std::atomic<const char*> event{nullptr};
+        std::atomic<int64_t> window{0};
+        std::atomic<uint32_t> count{0};
+        std::atomic<uint32_t> suppressed{0};
+    };
+
+    Slot queue[QUEUE_SIZE];
+    std::atomic<size_t> enqueuePos{0};
+    size_t dequeuePos = 0;
+
+    RateSlot rates[RATE_SLOTS];
+    std::atomic<int> minLevel{static_cast<int>(LogLevel::Info)};
+    std::atomic<uint32_t> rateLimit{20};
+    std::atomic<uint64_t> dropped{0};
+
+    std::atomic<bool> running{true};
+    std::thread writer;
+
+    Logger() {
+        for (size_t i = 0; i < QUEUE_SIZE; i++) queue[i].seq.store(i, std::memory_order_relaxed);
+        writer = std::thread([this]() { drainLoop(); });
+    }
+
+    ~Logger() {
+        running.store(false);
+        if (writer.joinable()) writer.join();
+    }
+
+    static int64_t nowMs() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    static const char* levelName(LogLevel level) {
+        switch (level) {
+            case LogLevel::Debug: return "DEBUG";
+            case LogLevel::Info:  return "INFO";
+            case LogLevel::Warn:  return "WARN";
+            default:              return "ERROR";
+        }
+    }
+
+    static size_t nameHash(const char* name) {
+        size_t h = 14695981039346656037ull;   // FNV-1a
+        for (; *name; name++) h = (h ^ static_cast<unsigned char>(*name)) * 1099511628211ull;
+        return h;
+    }
+
+    // The slot of this event name, claimed on first use; null if all are taken
+    RateSlot* rateSlot(const char* event) {
+        size_t start = nameHash(event);
+        for (size_t i = 0; i < RATE_SLOTS; i++) {
+            RateSlot& slot = rates[(start + i) % RATE_SLOTS];
+            const char* owner = slot.event.load(std::memory_order_acquire);
+            if (!owner && slot.event.compare_exchange_strong(owner, event, std::memory_order_acq_rel)) return &slot;
+            if (owner == event || std::strcmp(owner, event) == 0) return &slot;
+        }
+        return nullptr;
+    }
+
+    // Returns the number of records suppressed since the last one let through,
+    // or -1 if this record must be suppressed.
+    int64_t admit(const char* event, int64_t now) {
+        uint32_t limit = rateLimit.load(std::memory_order_relaxed);
+        if (limit == 0) return 0;
+
+        RateSlot* found = rateSlot(event);
+        if (!found) return 0;   // table full: not limited
+        RateSlot& slot = *found;
+        int64_t window = now / 1000;
+        int64_t current = slot.window.load(std::memory_order_relaxed);
+        if (current != window && slot.window.compare_exchange_strong(current, window)) {
+            slot.count.store(0, std::memory_order_relaxed);
+        }
+        if (slot.count.fetch_add(1, std::memory_order_relaxed) >= limit) {
+            slot.suppressed.fetch_add(1, std::memory_order_relaxed);
+            return -1;
+        }
+        return slot.suppressed.exchange(0, std::memory_order_relaxed);
+    }
+
+    bool tryPush(Record&& record) {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = queue[pos & (QUEUE_SIZE - 1)];
+            size_t seq = slot.seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.record = std::move(record);
+                    slot.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(Record& out) {
+        Slot& slot = queue[dequeuePos & (QUEUE_SIZE - 1)];
+        size_t seq = slot.seq.load(std::memory_order_acquire);
+        if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(dequeuePos + 1) < 0) return false;
+        out = std::move(slot.record);
+        slot.seq.store(dequeuePos + QUEUE_SIZE, std::memory_order_release);
+        dequeuePos++;
+        return true;
+    }
+
+    void writeRecord(const Record& r) {
+        time_t secs = static_cast<time_t>(r.timeMs / 1000);
+        struct tm tmv;
+        gmtime_r(&secs, &tmv);
+        char stamp[32];
+        strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &tmv);
+        fprintf(stdout, "%s.%03dZ %-5s %s%s\n", stamp, static_cast<int>(r.timeMs % 1000),
+                levelName(r.level), r.event, r.fields.c_str());
+    }
+
+    void drainLoop() {
+        Record record;
+        uint64_t reportedDrops = 0;
+        while (true) {
+            bool wrote = false;
+            while (tryPop(record)) {
+                writeRecord(record);
+                wrote = true;
+            }
+            uint64_t drops = dropped.load(std::memory_order_relaxed);
+            if (drops != reportedDrops) {
+                Record note{nowMs(), LogLevel::Warn, "log_queue_overflow",
+                            " dropped=" + std::to_string(drops - reportedDrops)};
+                writeRecord(note);
+                reportedDrops = drops;
+                wrote = true;
+            }
+            if (wrote) fflush(stdout);
+            else if (!running.load()) break;
+            else std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+
+    void log(LogLevel level, const char* event, LogFields fields) {
+        if (static_cast<int>(level) < minLevel.load(std::memory_order_relaxed)) return;
+
+        int64_t now = nowMs();
+        int64_t suppressed = admit(event, now);
+        if (suppressed < 0) return;
+
+        Record record{now, level, event, std::string()};
+        for (const auto& f : fields) {
+            record.fields += ' ';
+            record.fields += f.first;
+            record.fields += '=';
+            appendValue(record.fields, f.second);
+        }
+        if (suppressed > 0) record.fields += " suppressed=" + std::to_string(suppressed);
+
+        if (!tryPush(std::move(record))) dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+public:
+    // Empty, or anything that would break the key=value line apart: spaces,
+    // quotes, '=' and control characters (a value must not start a fake record)
+    static bool needsQuotes(const std::string& value) {
+        if (value.empty()) return true;
+        for (char ch : value) {
+            unsigned char c = static_cast<unsigned char>(ch);
+            if (c <= ' ' || c == 0x7f || ch == '"' || ch == '=') return true;
+        }
+        return false;
+    }
+
+    // value as it appears after key=, quoted and escaped if needed
+    static void appendValue(std::string& out, const std::string& value) {
+        if (!needsQuotes(value)) {
+            out += value;
+            return;
+        }
+        out += '"';
+        for (char ch : value) {
+            unsigned char c = static_cast<unsigned char>(ch);
+            if (ch == '"' || ch == '\\') out += '\\';
+            if (ch == '\n') out += "\\n";
+            else if (ch == '\r') out += "\\r";
+            else if (ch == '\t') out += "\\t";
+            else if (c < 0x20 || c == 0x7f) {
+                char hex[5];
+                std::snprintf(hex, sizeof(hex), "\\x%02x", c);
+                out += hex;
+            }
+            else out += ch;
+        }
+        out += '"';
+    }
+
+    static Logger& instance() {
+        static Logger logger;
+        return logger;
+    }
+
+    // "debug", "info", "warn", "error"
+    static void configure(const std::string& level, int perEventRateLimit) {
+        LogLevel lvl = LogLevel::Info;
+        if (level == "debug") lvl = LogLevel::Debug;
+        else if (level == "warn") lvl = LogLevel::Warn;
+        else if (level == "error") lvl = LogLevel::Error;
+        instance().minLevel.store(static_cast<int>(lvl));
+        instance().rateLimit.store(perEventRateLimit < 0 ? 0 : perEventRateLimit);
+    }
+
+    static bool enabled(LogLevel level) {
+        return static_cast<int>(level) >= instance().minLevel.load(std::memory_order_relaxed);
+    }
+
+    // event must be a string literal: it is used as the rate-limit key
+    static void debug(const char* event, LogFields fields = {}) { instance().log(LogLevel::Debug, event, fields); }
+    static void info(const char* event, LogFields fields = {})  { instance().log(LogLevel::Info, event, fields); }
+    static void warn(const char* event, LogFields fields = {})  { instance().log(LogLevel::Warn, event, fields); }
+    static void error(const char* event, LogFields fields = {}) { instance().log(LogLevel::Error, event, fields); }
+};
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Named values reported by the admin STATS command. A metric is read
+// through its callback only when asked for, so the code that owns the
+// number just keeps a plain counter.
+class Metrics {
+public:
+    using Reader = std::function<uint64_t()>;
+
+private:
+    std::vector<std::pair<std::string, Reader>> entries;
+
+public:
+    void add(const std::string& name, Reader reader) {
+        entries.emplace_back(name, std::move(reader));
+    }
+
+    // "name value" lines in registration order
+    std::vector<std::string> snapshot() const {
+        std::vector<std::string> lines;
+        lines.reserve(entries.size());
+        for (const auto& entry : entries) lines.push_back(entry.first + " " + std::to_string(entry.second()));
+        return lines;
+    }
+};
+
+#endif
@@ -0,0 +1,168 @@
+#ifndef OUTBOUND_QUEUE_H
+#define OUTBOUND_QUEUE_H
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <climits>
+#include <algorithm>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "SharedBuffer.h"
+
+// How a queued message is treated when its recipient falls behind
+enum class Priority {
+    Critical,   // command responses and notices, never dropped
+    Chat,       // private/group messages, can be spilled to offline_messages
+    Presence    // status pushes, can be dropped
+};
+
+// Sender side of a chat message, shared by every recipient of a fan-out
+struct ChatOrigin {
+    std::string sender;
+    std::string content;
+    bool isGroup;
+    int groupId;
+};
+
+// What is needed to store a chat message in offline_messages instead
+struct OfflineCopy {
+    std::string targetUser;
+    std::shared_ptr<const ChatOrigin> origin;
+};
+
+// Part of a file sent after an item's payload (DOWNLOAD). It goes from the
+// page cache to the socket with sendfile and is not counted as queued
+// memory.
+struct FileSlice {
+    int fd;
+    off_t offset;
+    size_t length;
+
+    FileSlice(int fd, off_t offset, size_t length) : fd(fd), offset(offset), length(length) {}
+    ~FileSlice() { close(fd); }
+    FileSlice(const FileSlice&) = delete;
+    FileSlice& operator=(const FileSlice&) = delete;
+};
+
+struct OutboundItem {
+    std::string prefix;      // per-connection framing, may be empty
+    SharedBuffer payload;    // shared between all recipients
+    Priority priority;
+    OfflineCopy spill;       // origin is null for non-chat items
+    uint16_t pushOpcode = 0; // binary connections frame pushes with this, 0 = already framed
+    uint64_t seq = 0;        // number within the client's resumable session, 0 = none
+    bool replayable = false; // kept for RESUME: chat and notifications, not replies
+    std::shared_ptr<FileSlice> file = nullptr;   // null for anything but downloads
+
+    size_t memory() const { return prefix.size() + payload->size(); }
+    size_t size() const { return memory() + (file ? file->length : 0); }
+};
+
+// Per-connection send queue. Data that the socket does not accept right away
+// stays here until the fd becomes writable again. Flushing gathers the
+// framing and shared payload of several items into one writev(); a file
+// slice is then sent on its own with sendfile().
+class OutboundQueue {
+private:
+    static constexpr int MAX_IOV = 64;
+
+    std::deque<OutboundItem> items;
+    size_t frontOffset = 0;   // bytes of items.front() already written
+    size_t totalBytes = 0;    // in memory, file slices excluded
+    size_t framingBytes = 0;  // prefix bytes held, payloads are accounted globally
+
+public:
+    bool empty() const { return items.empty(); }
+    size_t bytes() const { return totalBytes; }
+    size_t prefixBytes() const { return framingBytes; }
+
+    void push(OutboundItem item) {
+        if (item.size() == 0) return;
+        totalBytes += item.memory();
+        framingBytes += item.prefix.size();
+        items.push_back(std::move(item));
+    }
+
+    // Writes until the queue is empty or the socket would block.
+    // Returns false on a fatal socket error.
+    bool flush(int fd) {
+        while (!items.empty()) {
+            const OutboundItem& front = items.front();
+            if (front.file && frontOffset >= front.memory()) {
+                off_t offset = front.file->offset + static_cast<off_t>(frontOffset - front.memory());
+                ssize_t n = sendfile(fd, front.file->fd, &offset, front.size() - frontOffset);
+                if (n < 0) {
+                    if (errno == EINTR) continue;
+                    return errno == EAGAIN || errno == EWOULDBLOCK;
+                }
+                if (n == 0) return false;   // the file is shorter than announced
+                consume(static_cast<size_t>(n));
+                continue;
+            }
+
+            struct iovec iov[MAX_IOV];
+            int count = 0;
+            size_t skip = frontOffset;
+            for (size_t i = 0; i < items.size() && count + 2 <= MAX_IOV; i++) {
+                const OutboundItem& item = items[i];
+                const std::string* parts[2] = {&item.prefix, item.payload.get()};
+                for (const std::string* part : parts) {
+                    if (skip >= part->size()) { skip -= part->size(); continue; }
+                    iov[count].iov_base = const_cast<char*>(part->data() + skip);
+                    iov[count].iov_len = part->size() - skip;
+                    count++;
+                    skip = 0;
+                }
+                if (item.file) break;   // its file bytes have to come next
+            }
+
+            struct msghdr msg = {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = count;
+            ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            consume(static_cast<size_t>(n));
+        }
+        return true;
+    }
+
+    // Items that never started going out, for spilling on disconnect
+    std::vector<OutboundItem> takeUndelivered() {
+        std::vector<OutboundItem> result;
+        for (size_t i = 0; i < items.size(); i++) {
+            if (i == 0 && frontOffset > 0) continue;
+            result.push_back(std::move(items[i]));
+        }
+        items.clear();
+        frontOffset = 0;
+        totalBytes = 0;
+        framingBytes = 0;
+        return result;
+    }
+
+private:
+    void consume(size_t n) {
+        while (n > 0) {
+            const OutboundItem& front = items.front();
+            size_t step = std::min(n, front.size() - frontOffset);
+            if (frontOffset < front.memory()) totalBytes -= std::min(step, front.memory() - frontOffset);
+            frontOffset += step;
+            n -= step;
+            if (frontOffset < front.size()) return;
+            framingBytes -= front.prefix.size();
+            items.pop_front();
+            frontOffset = 0;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef PRESENCE_H
+#define PRESENCE_H
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// Online-users index (username -> connections) plus the presence changes
+// waiting for the next digest. Changes are coalesced per user: only the
+// latest state is kept, and a state friends were already told about is
+// not sent again (e.g. a quick disconnect/reconnect produces nothing).
+class PresenceIndex {
+private:
+    std::unordered_map<std::string, std::vector<int>> sessions;
+    std::unordered_map<std::string, bool> pending;
+    std::unordered_set<std::string> publishedOnline;
+
+public:
+    // Returns true if this is the user's first session
+    bool add(const std::string& username, int fd) {
+        std::vector<int>& fds = sessions[username];
+        fds.push_back(fd);
+        if (fds.size() > 1) return false;
+        pending[username] = true;
+        return true;
+    }
+
+    // Returns true if this was the user's last session
+    bool remove(const std::string& username, int fd) {
+        auto it = sessions.find(username);
+        if (it == sessions.end()) return false;
+        std::vector<int>& fds = it->second;
+        for (size_t i = 0; i < fds.size(); i++) {
+            if (fds[i] == fd) { fds.erase(fds.begin() + i); break; }
+        }
+        if (!fds.empty()) return false;
+        sessions.erase(it);
+        pending[username] = false;
+        return true;
+    }
+
+    bool isOnline(const std::string& username) const {
+        return sessions.count(username) > 0;
+    }
+
+    const std::vector<int>* sessionsOf(const std::string& username) const {
+        auto it = sessions.find(username);
+        return it == sessions.end() ? nullptr : &it->second;
+    }
+
+    std::vector<std::string> onlineUsers() const {
+        std::vector<std::string> names;
+        names.reserve(sessions.size());
+        for (const auto& entry : sessions) names.push_back(entry.first);
+        return names;
+    }
+
+    // Cluster mode: the user's state on the other nodes, for users with no
+    // session here
+    void noteElsewhere(const std::string& username, bool online) {
+        pending[username] = online;
+    }
+
+    bool hasPending() const { return !pending.empty(); }
+
+    // Net changes since the last call (username, online)
+    std::vector<std::pair<std::string, bool>> takeChanges() {
+        std::vector<std::pair<std::string, bool>> changes;
+        for (const auto& entry : pending) {
+            bool wasOnline = publishedOnline.count(entry.first) > 0;
+            if (entry.second == wasOnline) continue;
+            if (entry.second) publishedOnline.insert(entry.first);
+            else publishedOnline.erase(entry.first);
+            changes.push_back(entry);
+        }
+        pending.clear();
+        return changes;
+    }
+};
+
+#endif
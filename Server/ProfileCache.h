@@ -0,0 +1,117 @@
+#ifndef PROFILE_CACHE_H
+#define PROFILE_CACHE_H
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Bounded LRU of rendered VIEW_POSTS results, keyed by (profile owner,
+// viewer tier). Every viewer in the same tier sees the same lines, so a
+// popular profile is rendered at most once per tier until its owner posts
+// or deletes something.
+//
+// Lookups and invalidations happen on the event loop; results may be
+// stored from the query worker. A per-owner generation taken before the
+// query keeps a result computed before an invalidation from being cached.
+class ProfileCache {
+public:
+    using Items = std::shared_ptr<const std::vector<std::string>>;
+    static constexpr int TIERS = 3;   // see Storage::getProfileTier
+
+private:
+    struct Entry {
+        uint64_t key;
+        Items items;
+        size_t bytes;
+    };
+
+    static constexpr size_t ENTRY_OVERHEAD = 96;
+    static constexpr size_t ITEM_OVERHEAD = 32;
+
+    mutable std::mutex mutex;
+    std::list<Entry> lru;   // most recent first
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+    std::unordered_map<int, uint64_t> generations;
+    size_t maxBytes;
+    size_t usedBytes = 0;
+    uint64_t hitCount = 0;
+    uint64_t missCount = 0;
+    uint64_t evictionCount = 0;
+
+    static uint64_t keyOf(int owner, int tier) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(owner)) << 2) | static_cast<uint64_t>(tier);
+    }
+
+    void eraseLocked(std::unordered_map<uint64_t, std::list<Entry>::iterator>::iterator it) {
+        usedBytes -= it->second->bytes;
+        lru.erase(it->second);
+        index.erase(it);
+    }
+
+public:
+    explicit ProfileCache(size_t maxBytes) : maxBytes(maxBytes) {}
+
+    Items get(int owner, int tier) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = index.find(keyOf(owner, tier));
+        if (it == index.end()) {
+            missCount++;
+            return nullptr;
+        }
+        hitCount++;
+        lru.splice(lru.begin(), lru, it->second);
+        return it->second->items;
+    }
+
+    uint64_t generation(int owner) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = generations.find(owner);
+        return it == generations.end() ? 0 : it->second;
+    }
+
+    void put(int owner, int tier, uint64_t generationSeen, const std::vector<std::string>& items) {
+        size_t bytes = ENTRY_OVERHEAD;
+        for (const auto& item : items) bytes += item.size() + ITEM_OVERHEAD;
+        if (bytes > maxBytes / 4) return;   // one huge profile must not flush everything else
+
+        Items shared = std::make_shared<const std::vector<std::string>>(items);
+        std::lock_guard<std::mutex> lock(mutex);
+        auto gen = generations.find(owner);
+        if ((gen == generations.end() ? 0 : gen->second) != generationSeen) return;
+
+        uint64_t key = keyOf(owner, tier);
+        auto it = index.find(key);
+        if (it != index.end()) eraseLocked(it);
+        lru.push_front(Entry{key, std::move(shared), bytes});
+        index[key] = lru.begin();
+        usedBytes += bytes;
+
+        while (usedBytes > maxBytes && !lru.empty()) {
+            eraseLocked(index.find(lru.back().key));
+            evictionCount++;
+        }
+    }
+
+    // The owner's posts changed: drop every tier and reject results
+    // that were computed before this point
+    void invalidate(int owner) {
+        std::lock_guard<std::mutex> lock(mutex);
+        generations[owner]++;
+        for (int tier = 0; tier < TIERS; tier++) {
+            auto it = index.find(keyOf(owner, tier));
+            if (it != index.end()) eraseLocked(it);
+        }
+    }
+
+    uint64_t hits() const { std::lock_guard<std::mutex> lock(mutex); return hitCount; }
+    uint64_t misses() const { std::lock_guard<std::mutex> lock(mutex); return missCount; }
+    uint64_t evictions() const { std::lock_guard<std::mutex> lock(mutex); return evictionCount; }
+    size_t bytes() const { std::lock_guard<std::mutex> lock(mutex); return usedBytes; }
+    size_t entries() const { std::lock_guard<std::mutex> lock(mutex); return lru.size(); }
+};
+
+#endif
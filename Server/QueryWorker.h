@@ -0,0 +1,123 @@
+#ifndef QUERY_WORKER_H
+#define QUERY_WORKER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "Database/Database.h"
+
+// Runs read-only queries on a background thread with its own SQLite
+// connection, so a slow FEED does not hold up the commands behind it.
+// SQLite storage only: other engines are not shared between threads.
+// Finished jobs are signalled through an eventfd that the event loop
+// polls; their completions then run on the loop thread.
+class QueryWorker {
+public:
+    using Work = std::function<void(Storage&)>;
+    using Done = std::function<void()>;
+
+private:
+    static constexpr size_t MAX_PENDING = 1024;
+
+    struct Job {
+        Work work;
+        Done done;
+    };
+
+    std::string dbPath;
+    PostArchive* archive = nullptr;
+    int eventFd = -1;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Job> jobs;
+    std::vector<Done> finished;
+    bool stopping = false;
+
+    void run() {
+        DatabaseManager db(dbPath);
+        db.setArchive(archive);
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [this]() { return stopping || !jobs.empty(); });
+            if (stopping) return;
+            Job job = std::move(jobs.front());
+            jobs.pop_front();
+
+            lock.unlock();
+            job.work(db);
+            lock.lock();
+
+            finished.push_back(std::move(job.done));
+            uint64_t one = 1;
+            ssize_t ignored = write(eventFd, &one, sizeof(one));
+            (void)ignored;
+        }
+    }
+
+public:
+    explicit QueryWorker(const std::string& path) : dbPath(path) {}
+
+    ~QueryWorker() {
+        if (thread.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_one();
+            thread.join();
+        }
+        if (eventFd >= 0) close(eventFd);
+    }
+
+    // Before start(): old posts are read from there as well
+    void setArchive(PostArchive* postArchive) { archive = postArchive; }
+
+    // An in-memory database cannot be opened twice, so queries stay inline
+    bool start() {
+        if (dbPath.empty() || dbPath == ":memory:") return false;
+        eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (eventFd < 0) return false;
+        thread = std::thread(&QueryWorker::run, this);
+        return true;
+    }
+
+    bool running() const { return thread.joinable(); }
+    int notifyFd() const { return eventFd; }
+
+    // Returns false when the worker is not running or is saturated;
+    // the caller then runs the query inline.
+    bool submit(Work work, Done done) {
+        if (!running()) return false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (jobs.size() >= MAX_PENDING) return false;
+            jobs.push_back(Job{std::move(work), std::move(done)});
+        }
+        wake.notify_one();
+        return true;
+    }
+
+    // Called by the event loop when notifyFd() is readable
+    void runCompletions() {
+        uint64_t count;
+        ssize_t ignored = read(eventFd, &count, sizeof(count));
+        (void)ignored;
+
+        std::vector<Done> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ready.swap(finished);
+        }
+        for (auto& done : ready) done();
+    }
+};
+
+#endif
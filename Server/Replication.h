@@ -0,0 +1,386 @@
+#ifndef REPLICATION_H
+#define REPLICATION_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "Logger.h"
+#include "Protocol.h"
+#include "TimerWheel.h"
+#include "Database/ChangeLog.h"
+#include "Database/Database.h"
+
+// Warm standby: a second ServerApp (--standby-of=<socket>) keeps its own
+// copy of the database by applying the primary's change log, shipped over
+// a Unix socket (--replication-socket on the primary).
+//
+// The standby connects, sends "FROM <seq>\n" with the first seq it lacks,
+// and the primary streams OP_REPL_CHANGE frames from its change log,
+// followed by an OP_REPL_HEARTBEAT with its newest seq whenever it has
+// nothing to send for a while. The standby applies each batch in one
+// transaction together with the seq reached, so a restart resumes exactly
+// where it stopped. It starts from seq 1, so the primary must still have
+// the log from the beginning (or the standby starts from a copy of a
+// database it replicated earlier).
+
+namespace Replication {
+
+inline int unixSocket(const std::string& path, struct sockaddr_un& addr) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) return -1;
+    std::memcpy(addr.sun_path, path.c_str(), path.size());
+    return socket(AF_UNIX, SOCK_STREAM, 0);
+}
+
+inline bool sendAll(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        sent += n;
+    }
+    return true;
+}
+
+} // namespace Replication
+
+// Primary side: one thread accepts standbys, one more per standby tails
+// the change log with its own reader and writes what it finds. The event
+// loop is not involved.
+class ReplicationSender {
+private:
+    static constexpr int POLL_MS = 5;
+    static constexpr int64_t HEARTBEAT_MS = 200;
+    static constexpr size_t BATCH_BYTES = 256 << 10;
+
+    std::string socketPath;
+    ChangeLog& log;
+    int listenFd = -1;
+    std::atomic<bool> stopping{false};
+    std::thread acceptor;
+    std::mutex mutex;
+    std::vector<std::thread> streams;
+    std::set<int> streamFds;
+
+    void acceptLoop() {
+        while (!stopping) {
+            int fd = accept(listenFd, nullptr, nullptr);
+            if (fd < 0) {
+                if (errno == EINTR) continue;
+                return;   // closed by stop()
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping) {
+                close(fd);
+                return;
+            }
+            streamFds.insert(fd);
+            streams.emplace_back(&ReplicationSender::stream, this, fd);
+        }
+    }
+
+    void stream(int fd) {
+        std::string request;
+        char c;
+        while (request.size() < 64 && recv(fd, &c, 1, 0) == 1 && c != '\n') request += c;
+        unsigned long long from = 0;
+        if (std::sscanf(request.c_str(), "FROM %llu", &from) != 1) from = 0;
+
+        if (from > 0) {
+            Logger::info("standby_connected", {{"from_seq", std::to_string(from)}});
+            ChangeLogReader reader(log.directory(), from);
+            ChangeRecord record;
+            int64_t lastSend = 0;
+            std::string out;
+            while (!stopping) {
+                if (log.isBroken()) {
+                    Logger::error("replication_stopped", {{"reason", "changelog_broken"}, {"next_seq", std::to_string(reader.nextSeq())}});
+                    break;
+                }
+                out.clear();
+                while (out.size() < BATCH_BYTES && reader.next(record)) {
+                    Protocol::appendHeader(out, static_cast<uint32_t>(18 + record.size), Protocol::FRAME_PUSH, 0,
+                                           Protocol::OP_REPL_CHANGE, 0, 0);
+                    Protocol::appendField(out, Protocol::Field::integer(static_cast<int64_t>(record.seq)));
+                    Protocol::appendField(out, Protocol::Field::integer(static_cast<int64_t>(record.kind)));
+                    out.append(reinterpret_cast<const char*>(record.data), record.size);
+                }
+                if (reader.missed() > 0) {
+                    Logger::error("replication_gap", {{"from_seq", std::to_string(from)}, {"missed", std::to_string(reader.missed())}});
+                    break;
+                }
+                int64_t now = TimerWheel::monotonicMs();
+                if (out.empty() && now - lastSend >= HEARTBEAT_MS) {
+                    Protocol::Frame beat;
+                    beat.type = Protocol::FRAME_PUSH;
+                    beat.opcode = Protocol::OP_REPL_HEARTBEAT;
+                    beat.fields.push_back(Protocol::Field::integer(static_cast<int64_t>(log.lastSeq())));
+                    out = Protocol::encode(beat);
+                }
+                if (out.empty()) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(POLL_MS));
+                    continue;
+                }
+                if (!Replication::sendAll(fd, out)) break;
+                lastSend = now;
+            }
+            Logger::info("standby_disconnected", {{"next_seq", std::to_string(reader.nextSeq())}});
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        streamFds.erase(fd);
+        close(fd);
+    }
+
+public:
+    ReplicationSender(const std::string& path, ChangeLog& changeLog) : socketPath(path), log(changeLog) {}
+
+    ~ReplicationSender() {
+        stopping = true;
+        if (listenFd >= 0) {
+            shutdown(listenFd, SHUT_RDWR);
+            close(listenFd);
+        }
+        if (acceptor.joinable()) acceptor.join();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (int fd : streamFds) shutdown(fd, SHUT_RDWR);
+        }
+        for (auto& t : streams) t.join();
+        if (listenFd >= 0) unlink(socketPath.c_str());
+    }
+
+    bool start() {
+        struct sockaddr_un addr;
+        listenFd = Replication::unixSocket(socketPath, addr);
+        if (listenFd < 0) return false;
+        unlink(socketPath.c_str());
+        if (bind(listenFd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 || listen(listenFd, 4) < 0) {
+            Logger::error("replication_listen_failed", {{"path", socketPath}, {"error", strerror(errno)}});
+            close(listenFd);
+            listenFd = -1;
+            return false;
+        }
+        acceptor = std::thread(&ReplicationSender::acceptLoop, this);
+        Logger::info("replication_listening", {{"path", socketPath}});
+        return true;
+    }
+
+    uint64_t standbys() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return streamFds.size();
+    }
+};
+
+// Standby side: a thread with its own connection to the standby's database
+// applies the stream. What it applied is handed to the event loop through
+// an eventfd (like QueryWorker), which keeps the in-memory indexes current.
+class ReplicationReceiver {
+public:
+    using Applied = std::function<void(ChangeKind, const std::vector<Protocol::Field>&)>;
+
+private:
+    static constexpr int RETRY_MS = 1000;
+
+    struct Change {
+        ChangeKind kind;
+        std::vector<Protocol::Field> fields;
+    };
+
+    std::string socketPath;
+    std::string dbPath;
+    int eventFd = -1;
+    std::thread thread;
+    std::atomic<bool> stopping{false};
+    std::atomic<int> connFd{-1};
+    std::mutex mutex;
+    std::vector<Change> applied;
+
+    std::atomic<uint64_t> appliedSeq{0};
+    std::atomic<uint64_t> primarySeq{0};
+    std::atomic<int64_t> caughtUpAt{0};   // monotonic ms when appliedSeq last reached primarySeq
+    std::atomic<bool> linked{false};
+
+    static bool apply(DatabaseManager& db, ChangeKind kind, const std::vector<Protocol::Field>& f) {
+        auto n = [&f](size_t i) { return i < f.size() ? static_cast<int>(f[i].num) : -1; };
+        auto s = [&f](size_t i) { return i < f.size() ? f[i].str : std::string(); };
+        switch (kind) {
+        case ChangeKind::UserRegistered: return db.insertUser(n(0), s(1), s(2), n(3));
+        case ChangeKind::UserDeleted: return db.deleteUser(s(0));
+        case ChangeKind::FriendRequested: return db.sendFriendRequest(n(0), n(1), n(2));
+        case ChangeKind::FriendAccepted: return db.acceptFriendRequest(n(0), n(1));
+        case ChangeKind::GroupCreated: return db.insertGroup(n(0), s(1), n(2));
+        case ChangeKind::GroupMemberAdded: return db.addToGroup(n(0), n(1));
+        case ChangeKind::PostCreated: return db.insertPost(n(0), n(1), s(3), n(2));
+        case ChangeKind::PostDeleted: return db.deletePost(n(0), n(1));
+        case ChangeKind::OfflineStored: db.storeOfflineMessage(n(0), s(1), s(2), n(3) != 0, n(4)); return true;
+        case ChangeKind::OfflineDelivered: db.clearOfflineMessages(n(0)); return true;
+        case ChangeKind::HistoryAppended:
+            return f.size() >= 5 && db.insertHistory(f[0].num, f[1].num, s(2), s(3), s(4));
+        case ChangeKind::RowsDeleted: {
+            std::vector<int64_t> keys;
+            for (size_t i = 2; i < f.size(); i++) keys.push_back(f[i].num);
+            return n(1) > 0 && db.deleteRows(s(0), n(1), keys);
+        }
+        // The standby has no copy of the primary's segments, so it keeps
+        // these rows (its own maintenance may archive them)
+        case ChangeKind::PostsArchived: return true;
+        }
+        return false;
+    }
+
+    void noteProgress() {
+        if (appliedSeq.load() >= primarySeq.load()) caughtUpAt = TimerWheel::monotonicMs();
+    }
+
+    // Applies every complete frame in buf; false on a broken stream
+    bool consume(DatabaseManager& db, std::string& buf) {
+        std::vector<Change> batch;
+        uint64_t last = appliedSeq;
+        size_t pos = 0;
+        while (true) {
+            Protocol::Frame frame;
+            long used = Protocol::decode(buf.data() + pos, buf.size() - pos, frame);
+            if (used < 0) return false;
+            if (used == 0) break;
+            pos += used;
+            if (frame.opcode == Protocol::OP_REPL_HEARTBEAT && !frame.fields.empty()) {
+                primarySeq = std::max<uint64_t>(primarySeq, static_cast<uint64_t>(frame.fields[0].num));
+            } else if (frame.opcode == Protocol::OP_REPL_CHANGE && frame.fields.size() >= 2) {
+                uint64_t seq = static_cast<uint64_t>(frame.fields[0].num);
+                if (seq <= last) continue;
+                Change change{static_cast<ChangeKind>(frame.fields[1].num),
+                              std::vector<Protocol::Field>(frame.fields.begin() + 2, frame.fields.end())};
+                batch.push_back(std::move(change));
+                last = seq;
+            }
+        }
+        buf.erase(0, pos);
+        if (batch.empty()) {
+            noteProgress();
+            return true;
+        }
+
+        db.beginTransaction();
+        for (const auto& change : batch) {
+            if (!apply(db, change.kind, change.fields)) {
+                Logger::warn("replication_apply_failed", {{"kind", std::to_string(static_cast<int>(change.kind))}});
+            }
+        }
+        db.setReplicatedSeq(last);
+        if (!db.commitTransaction()) return false;
+
+        appliedSeq = last;
+        primarySeq = std::max<uint64_t>(primarySeq, last);
+        noteProgress();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto& change : batch) applied.push_back(std::move(change));
+        }
+        uint64_t one = 1;
+        ssize_t ignored = write(eventFd, &one, sizeof(one));
+        (void)ignored;
+        return true;
+    }
+
+    void run() {
+        DatabaseManager db(dbPath);
+        appliedSeq = db.replicatedSeq();
+        caughtUpAt = TimerWheel::monotonicMs();
+        while (!stopping) {
+            struct sockaddr_un addr;
+            int fd = Replication::unixSocket(socketPath, addr);
+            if (fd >= 0 && connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0) {
+                connFd = fd;
+                linked = true;
+                Logger::info("replication_connected", {{"from_seq", std::to_string(appliedSeq + 1)}});
+                std::string buf;
+                char chunk[65536];
+                if (Replication::sendAll(fd, "FROM " + std::to_string(appliedSeq + 1) + "\n")) {
+                    ssize_t n;
+                    while (!stopping && (n = recv(fd, chunk, sizeof(chunk), 0)) > 0) {
+                        buf.append(chunk, n);
+                        if (!consume(db, buf)) {
+                            Logger::error("replication_stream_broken", {{"applied_seq", std::to_string(appliedSeq)}});
+                            break;
+                        }
+                    }
+                }
+                linked = false;
+                connFd = -1;
+                if (!stopping) Logger::warn("replication_disconnected", {{"applied_seq", std::to_string(appliedSeq)}});
+            }
+            if (fd >= 0) close(fd);
+            for (int waited = 0; waited < RETRY_MS && !stopping; waited += 50) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            }
+        }
+    }
+
+public:
+    ReplicationReceiver(const std::string& primarySocket, const std::string& standbyDb)
+        : socketPath(primarySocket), dbPath(standbyDb) {}
+
+    ~ReplicationReceiver() {
+        stop();
+        if (eventFd >= 0) close(eventFd);
+    }
+
+    bool start() {
+        eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (eventFd < 0) return false;
+        thread = std::thread(&ReplicationReceiver::run, this);
+        return true;
+    }
+
+    // Returns once the batch being applied is committed
+    void stop() {
+        stopping = true;
+        int fd = connFd;
+        if (fd >= 0) shutdown(fd, SHUT_RDWR);
+        if (thread.joinable()) thread.join();
+    }
+
+    int notifyFd() const { return eventFd; }
+
+    // Event loop side
+    void runCompletions(const Applied& handler) {
+        uint64_t count;
+        ssize_t ignored = read(eventFd, &count, sizeof(count));
+        (void)ignored;
+        std::vector<Change> batch;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            batch.swap(applied);
+        }
+        for (const auto& change : batch) handler(change.kind, change.fields);
+    }
+
+    uint64_t lastApplied() const { return appliedSeq; }
+    uint64_t lagRecords() const {
+        uint64_t primary = primarySeq, done = appliedSeq;
+        return primary > done ? primary - done : 0;
+    }
+    // How old the standby's view may be: 0 while it is caught up
+    int64_t stalenessMs() const {
+        if (linked && lagRecords() == 0) return 0;
+        return TimerWheel::monotonicMs() - caughtUpAt;
+    }
+    bool connected() const { return linked; }
+};
+
+#endif
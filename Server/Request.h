@@ -0,0 +1,98 @@
+#ifndef REQUEST_H
+#define REQUEST_H
+
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Protocol.h"
+
+// A parsed command, independent of the wire format. Text commands are read
+// word by word like before; binary requests hand over their typed fields
+// directly, so arguments can contain spaces and newlines.
+//
+// A text line may start with "#<tag> "; the response then comes back as
+// "@<tag> <status> <length>\n" followed by <length> bytes of body, and may
+// overtake responses to earlier commands.
+class Request {
+private:
+    bool binary = false;
+    std::stringstream ss;
+    std::vector<Protocol::Field> fields;
+    size_t nextField = 0;
+    bool failed = false;
+
+public:
+    std::string verb;
+    uint16_t opcode = Protocol::OP_UNKNOWN;
+    uint32_t id = 0;
+    std::string tag;
+
+    static Request fromLine(const std::string& line) {
+        Request req;
+        req.ss.str(line);
+        req.ss >> req.verb;
+        if (req.verb.size() > 1 && req.verb[0] == '#') {
+            req.tag = req.verb.substr(1);
+            req.ss >> req.verb;
+        }
+        req.opcode = Protocol::opcodeFor(req.verb);
+        return req;
+    }
+
+    static Request fromFrame(Protocol::Frame& frame) {
+        Request req;
+        req.binary = true;
+        req.opcode = frame.opcode;
+        req.verb = Protocol::verbFor(frame.opcode);
+        req.id = frame.id;
+        req.fields = std::move(frame.fields);
+        return req;
+    }
+
+    bool isBinary() const { return binary; }
+    // The client matches the response by id or tag rather than by order
+    bool isCorrelated() const { return binary || !tag.empty(); }
+
+    // Next argument, "" when there is none
+    std::string word() {
+        if (!binary) {
+            std::string w;
+            if (!(ss >> w)) failed = true;
+            return w;
+        }
+        if (nextField >= fields.size()) { failed = true; return ""; }
+        return fields[nextField++].asString();
+    }
+
+    bool integer(int& out) {
+        if (!binary) {
+            if (!(ss >> out)) { failed = true; return false; }
+            return true;
+        }
+        if (nextField >= fields.size()) { failed = true; return false; }
+        const Protocol::Field& f = fields[nextField++];
+        if (f.type == Protocol::Field::INT) { out = static_cast<int>(f.num); return true; }
+        char* end = nullptr;
+        long v = std::strtol(f.str.c_str(), &end, 10);
+        if (f.str.empty() || *end != '\0') { failed = true; return false; }
+        out = static_cast<int>(v);
+        return true;
+    }
+
+    // Free text up to the end of the line (text) or the next field (binary)
+    std::string rest() {
+        std::string r;
+        if (!binary) {
+            std::getline(ss, r);
+            if (!r.empty() && r[0] == ' ') r.erase(0, 1);
+            return r;
+        }
+        if (nextField < fields.size()) r = fields[nextField++].asString();
+        return r;
+    }
+
+    bool fail() const { return failed; }
+};
+
+#endif
@@ -1,13 +1,21 @@
 #include "Server.h"
 #include "CommandHandler.h"
+#include "Logger.h"
 #include <iostream>
 #include <unistd.h>
 #include <fcntl.h>
 #include <cstring>
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <ctime>
+#include <sys/stat.h>
 #include <arpa/inet.h>
-#include <algorithm>
 
-Server::Server(int port) : port(port), dbManager("virtualsoc.db") {
+Server::Server(const ServerConfig& config)
+    : port(config.port), config(config),
+      queryWorker(config.storage == "sqlite" ? config.dbPath : ""),
+      profileCache(config.profileCacheBytes), cluster(config) {
     server_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (server_fd == 0) { perror("socket failed"); exit(EXIT_FAILURE); }
 
@@ -26,8 +34,26 @@ Server::Server(int port) : port(port), dbManager("virtualsoc.db") {
         perror("listen"); exit(EXIT_FAILURE);
     }
 
+    // Node links get a listener of their own, so the client port never
+    // takes HELLO NODE
+    if (config.peerPort > 0) {
+        peer_fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (peer_fd < 0) { perror("peer socket failed"); exit(EXIT_FAILURE); }
+        setsockopt(peer_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+        struct sockaddr_in peer_addr = address;
+        peer_addr.sin_port = htons(config.peerPort);
+        if (bind(peer_fd, (struct sockaddr *)&peer_addr, sizeof(peer_addr)) < 0) {
+            perror("peer bind failed"); exit(EXIT_FAILURE);
+        }
+        if (listen(peer_fd, 16) < 0) {
+            perror("peer listen"); exit(EXIT_FAILURE);
+        }
+    }
+
     udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
     if (udp_fd < 0) { perror("udp socket failed"); exit(EXIT_FAILURE); }
+    // Cluster nodes on one host all answer discovery
+    setsockopt(udp_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
 
     struct sockaddr_in udp_addr;
     memset(&udp_addr, 0, sizeof(udp_addr));
@@ -45,15 +71,109 @@ Server::Server(int port) : port(port), dbManager("virtualsoc.db") {
     event.events = EPOLLIN;
     event.data.fd = server_fd;
     epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_fd, &event);
+    if (peer_fd >= 0) {
+        event.data.fd = peer_fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, peer_fd, &event);
+    }
 
     struct epoll_event ev_udp;
     ev_udp.events = EPOLLIN;
     ev_udp.data.fd = udp_fd;
     epoll_ctl(epoll_fd, EPOLL_CTL_ADD, udp_fd, &ev_udp);
+
+    if (config.storage == "memory") {
+        auto memory = std::make_unique<MemoryStorage>(config.snapshotPath);
+        memoryStorage = memory.get();
+        storage = std::move(memory);
+        if (memoryStorage->hasSnapshot() && config.snapshotInterval > 0) scheduleSnapshot();
+    } else if (config.storage == "sharded") {
+        storage = std::make_unique<ShardedStorage>(config.dbPath, config.shards);
+    } else {
+        auto sqlite = std::make_unique<DatabaseManager>(config.dbPath);
+        sqliteStorage = sqlite.get();
+        storage = std::move(sqlite);
+        if (config.standbyOf.empty()) startChangeLog();
+        openArchive();
+        backup = std::make_unique<BackupJob>(config.dbPath, config.backupPages, config.backupPauseMs);
+        metrics.add("backup.running", [this]() { return backup->isRunning() ? 1 : 0; });
+        metrics.add("backup.pages_done", [this]() { return backup->progressPages(); });
+        metrics.add("backup.pages_total", [this]() { return backup->totalPages(); });
+        metrics.add("backup.last_duration_ms", [this]() { return backup->durationMs(); });
+        metrics.add("backup.completed", [this]() { return backup->succeeded(); });
+        metrics.add("backup.failed", [this]() { return backup->failures(); });
+        if (config.backupInterval > 0) scheduleBackup();
+        startMaintenance();
+    }
+    usernames.load(storage->getAllUsers());
+    socialGraph.load(storage->getAcceptedFriendships());
+
+    sessions.setBudget(config.replayBudget);
+    metrics.add("connections", [this]() { return clients.size(); });
+    metrics.add("sessions.replay_bytes", [this]() { return sessions.bytes(); });
+    metrics.add("queued_bytes", [this]() { return queuedMemory(); });
+    metrics.add("dropped_pushes", [this]() { return droppedPushes; });
+    metrics.add("spilled_messages", [this]() { return spilledMessages; });
+    metrics.add("users.filter_rejects", [this]() { return usernames.rejectedByFilter(); });
+    metrics.add("users.filter_false_positives", [this]() { return usernames.falsePositives(); });
+    metrics.add("profile_cache.hits", [this]() { return profileCache.hits(); });
+    metrics.add("profile_cache.misses", [this]() { return profileCache.misses(); });
+    metrics.add("profile_cache.evictions", [this]() { return profileCache.evictions(); });
+    metrics.add("profile_cache.entries", [this]() { return profileCache.entries(); });
+    metrics.add("profile_cache.bytes", [this]() { return profileCache.bytes(); });
+
+    if (!config.blobDir.empty()) {
+        blobs = std::make_unique<BlobStore>(config.blobDir, config.maxAttachment);
+        if (blobs->open()) {
+            // sendfile has no MSG_NOSIGNAL; a client gone mid-download is
+            // seen as EPIPE instead
+            signal(SIGPIPE, SIG_IGN);
+            metrics.add("blobs.stored", [this]() { return blobs->stored(); });
+            metrics.add("blobs.deduplicated", [this]() { return blobs->duplicates(); });
+            metrics.add("blobs.bytes_stored", [this]() { return blobs->bytes(); });
+            metrics.add("blobs.uploads_in_progress", [this]() { return blobs->inProgress(); });
+            metrics.add("blobs.downloads", [this]() { return downloads; });
+            metrics.add("blobs.bytes_sent", [this]() { return downloadBytes; });
+        } else {
+            blobs.reset();
+        }
+    }
+
+    if (queryWorker.start()) {
+        struct epoll_event ev_query;
+        ev_query.events = EPOLLIN;
+        ev_query.data.fd = queryWorker.notifyFd();
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, queryWorker.notifyFd(), &ev_query);
+    }
+
+    if (!config.standbyOf.empty()) {
+        replica = std::make_unique<ReplicationReceiver>(config.standbyOf, config.dbPath);
+        if (replica->start()) {
+            struct epoll_event ev_replica;
+            ev_replica.events = EPOLLIN;
+            ev_replica.data.fd = replica->notifyFd();
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, replica->notifyFd(), &ev_replica);
+        }
+        metrics.add("replication.applied_seq", [this]() { return replica ? replica->lastApplied() : 0; });
+        metrics.add("replication.lag_records", [this]() { return replica ? replica->lagRecords() : 0; });
+        metrics.add("replication.staleness_ms", [this]() { return replica ? replica->stalenessMs() : 0; });
+        metrics.add("replication.connected", [this]() { return replica && replica->connected() ? 1 : 0; });
+    }
+
+    if (cluster.enabled()) {
+        metrics.add("cluster.links_up", [this]() { return cluster.linksUp(); });
+        metrics.add("cluster.link_resets", [this]() { return cluster.linkResets(); });
+        metrics.add("cluster.remote_users", [this]() { return cluster.remoteUsers(); });
+        metrics.add("cluster.forwarded", [this]() { return cluster.forwarded(); });
+        metrics.add("cluster.delivered", [this]() { return clusterDeliveries; });
+        cluster.start(epoll_fd, [this]() { return presence.onlineUsers(); },
+                      [this](const OfflineCopy& copy) { spillOffline(copy); });
+        scheduleClusterTick();
+    }
 }
 
 Server::~Server() {
     close(server_fd);
+    if (peer_fd >= 0) close(peer_fd);
     close(udp_fd);
     close(epoll_fd);
 }
@@ -64,20 +184,41 @@ void Server::setNonBlocking(int sock) {
 }
 
 void Server::start() {
-    std::cout << "Listening on TCP port: " << port << " and UDP port: " << DISCOVERY_PORT << std::endl;
+    Logger::info("server_listening", {{"tcp_port", std::to_string(port)}, {"udp_port", std::to_string(DISCOVERY_PORT)}});
     struct epoll_event events[MAX_EVENTS];
 
     while (true) {
-        int num_events = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        int timeout = timers.nextTimeoutMs(TimerWheel::monotonicMs());
+        int num_events = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout);
         for (int i = 0; i < num_events; i++) {
-            if (events[i].data.fd == server_fd) {
-                handleNewConnection();
+            if (events[i].data.fd == server_fd || events[i].data.fd == peer_fd) {
+                handleNewConnection(events[i].data.fd);
             } else if (events[i].data.fd == udp_fd) {
                 handleDiscovery();
+            } else if (events[i].data.fd == queryWorker.notifyFd()) {
+                queryWorker.runCompletions();
+            } else if (replica && events[i].data.fd == replica->notifyFd()) {
+                replica->runCompletions([this](ChangeKind kind, const std::vector<Protocol::Field>& fields) {
+                    applyReplicated(kind, fields);
+                });
+            } else if (cluster.owns(events[i].data.fd)) {
+                cluster.handleEvent(events[i].data.fd, events[i].events);
             } else {
-                handleClientActivity(events[i].data.fd);
+                int fd = events[i].data.fd;
+                if (events[i].events & EPOLLOUT) {
+                    Client* c = getClient(fd);
+                    if (c) flushClient(*c);
+                }
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    Client* c = getClient(fd);
+                    if (c && !c->closing) handleClientActivity(fd);
+                }
             }
+            processPendingCloses();
         }
+        timers.advance(TimerWheel::monotonicMs());
+        processPendingCloses();
+        cluster.flush();
     }
 }
 
@@ -92,19 +233,28 @@ void Server::handleDiscovery() {
         if (msg.find("WHO_IS_SERVER") != std::string::npos) {
             std::string reply = "SERVER_HERE";
             sendto(udp_fd, reply.c_str(), reply.length(), 0, (struct sockaddr *)&client_addr, len);
-            std::cout << "Discovery request from " << inet_ntoa(client_addr.sin_addr) << std::endl;
+            Logger::info("discovery_request", {{"ip", inet_ntoa(client_addr.sin_addr)}});
         }
     }
 }
 
-void Server::handleNewConnection() {
+void Server::handleNewConnection(int listener) {
     int new_socket;
     int addrlen = sizeof(address);
-    if ((new_socket = accept(server_fd, (struct sockaddr *)&address, (socklen_t *)&addrlen)) < 0) {
+    if ((new_socket = accept(listener, (struct sockaddr *)&address, (socklen_t *)&addrlen)) < 0) {
         perror("accept");
         return;
     }
 
+    if (queuedMemory() > config.memoryHighWater) {
+        // Shedding load: refuse new sessions until queued output drains
+        const char busy[] = "503 Server busy, try again later.\n";
+        send(new_socket, busy, sizeof(busy) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+        close(new_socket);
+        Logger::warn("connection_refused", {{"reason", "memory_high_water"}, {"queued_bytes", std::to_string(queuedMemory())}});
+        return;
+    }
+
     setNonBlocking(new_socket);
 
     struct epoll_event event;
@@ -112,73 +262,928 @@ void Server::handleNewConnection() {
     event.data.fd = new_socket;
     epoll_ctl(epoll_fd, EPOLL_CTL_ADD, new_socket, &event);
 
-    clients.push_back(Client(new_socket, address));
-    std::cout << "New connection" << std::endl;
+    Client client(new_socket, address);
+    client.serial = nextSerial++;
+    client.viaPeerPort = listener == peer_fd;
+    client.epollEvents = EPOLLIN;
+    client.lastActivity = TimerWheel::monotonicMs();
+    int firstCheck = config.heartbeatInterval > 0 ? config.heartbeatInterval : config.idleTimeout;
+    if (firstCheck > 0) {
+        client.idleTimer = timers.schedule(firstCheck * 1000LL, [this, new_socket]() { checkIdle(new_socket); });
+    }
+    if (config.loginTimeout > 0) {
+        client.loginTimer = timers.schedule(config.loginTimeout * 1000LL, [this, new_socket]() {
+            Client* c = getClient(new_socket);
+            if (c && !c->isAuthenticated) {
+                c->loginTimer = TimerWheel::INVALID_TIMER;
+                sendMessage(new_socket, "408 Login timeout.\n");
+                dropClient(new_socket, "login_timeout");
+            }
+        });
+    }
+    clients.emplace(new_socket, std::move(client));
+    Logger::info("client_connected", {{"fd", std::to_string(new_socket)}, {"ip", inet_ntoa(address.sin_addr)}});
 }
 
 void Server::handleClientActivity(int fd) {
-    char buffer[BUFFER_SIZE] = {0};
-    int valread = read(fd, buffer, BUFFER_SIZE - 1);
+    char buffer[BUFFER_SIZE];
+    int valread = read(fd, buffer, BUFFER_SIZE);
 
+    if (valread < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return;
     if (valread <= 0) {
         // Clientul s-a deconectat sau eroare
+        dropClient(fd, "closed");
+    } else {
         Client* c = getClient(fd);
-        if(c) {
-            std::cout << "Client disconnected: " << c->username << std::endl;
-            broadcastMessage(c->username + " has disconnected.\n", fd);
+        if (c) {
+            c->lastActivity = TimerWheel::monotonicMs();
+            c->pingSent = false;
+            c->inBuffer.append(buffer, valread);
+            processInput(*c);
         }
-        removeClient(fd);
+    }
+}
+
+// Handles every complete command in the input buffer; a partial line or
+// frame stays buffered until the rest arrives. HELLO can switch the format
+// in the middle of a buffer.
+void Server::processInput(Client& client) {
+    size_t pos = 0;
+    while (!client.closing) {
+        if (client.binary) {
+            Protocol::Frame frame;
+            long used = Protocol::decode(client.inBuffer.data() + pos, client.inBuffer.size() - pos, frame);
+            if (used < 0) {
+                Logger::warn("protocol_error", {{"fd", std::to_string(client.fd)}, {"user", client.username}});
+                scheduleClose(client, "protocol_error");
+                break;
+            }
+            if (used == 0) break;
+            pos += used;
+            if (frame.flags & Protocol::FLAG_COMPRESSED) {
+                Logger::warn("protocol_error", {{"fd", std::to_string(client.fd)}, {"reason", "compressed_request"}});
+                scheduleClose(client, "protocol_error");
+                break;
+            }
+            if (client.peerNode != 0) {
+                handlePeerFrame(client, frame);
+                continue;
+            }
+            if (frame.type != Protocol::FRAME_REQUEST) continue;
+
+            Request req = Request::fromFrame(frame);
+            dispatch(client, req);
+        } else {
+            size_t nl = client.inBuffer.find('\n', pos);
+            if (nl == std::string::npos) {
+                if (client.inBuffer.size() - pos > MAX_LINE_LENGTH) scheduleClose(client, "line_too_long");
+                break;
+            }
+            std::string line = client.inBuffer.substr(pos, nl - pos);
+            pos = nl + 1;
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty()) continue;
+
+            Request req = Request::fromLine(line);
+            dispatch(client, req);
+        }
+    }
+    client.inBuffer.erase(0, pos);
+}
+
+// Binary and tagged requests collect everything the handler sends back into
+// one response carrying the request's id or tag. A handler that hands its
+// query to the worker marks the response deferred; it is sent on completion.
+void Server::dispatch(Client& client, Request& req) {
+    bool framed = req.isCorrelated();
+    if (framed) {
+        client.collecting = true;
+        client.responseDeferred = false;
+        client.responseTag = req.tag;
+        client.response = Protocol::Frame();
+        client.response.type = Protocol::FRAME_RESPONSE;
+        client.response.opcode = req.opcode;
+        client.response.id = req.id;
+    }
+
+    CommandHandler::handleCommand(req, client, *this);
+
+    if (framed) {
+        client.collecting = false;
+        if (!client.responseDeferred && (client.response.status != 0 || !client.response.fields.empty())) {
+            if (client.response.status == 0) client.response.status = 200;
+            sendResponse(client, client.response, client.responseTag);
+        }
+        client.response.fields.clear();
+    }
+}
+
+void Server::sendResponse(Client& client, const Protocol::Frame& frame, const std::string& tag) {
+    std::string data;
+    if (tag.empty()) {
+        std::string body = Protocol::encodeFields(frame.fields);
+        uint8_t flags = frame.flags;
+        if (client.compress && body.size() >= config.compressThreshold) {
+            // Small answers (MSG acks etc.) go out as they are
+            if (!client.deflater) client.deflater.reset(new Compression::Deflater());
+            std::string packed;
+            if (client.deflater->compress(body, packed)) {
+                body.swap(packed);
+                flags |= Protocol::FLAG_COMPRESSED;
+            } else {
+                // The stream is broken; the client can still read plain frames
+                client.compress = false;
+                Logger::warn("compression_failed", {{"fd", std::to_string(client.fd)}});
+            }
+        }
+        Protocol::appendHeader(data, static_cast<uint32_t>(body.size()), frame.type, flags, frame.opcode, frame.id, frame.status);
+        data += body;
     } else {
-        std::string raw_data(buffer);
-        std::stringstream ss(raw_data);
-        std::string command_line;
+        std::string body;
+        for (const auto& field : frame.fields) body += field.asString() + "\n";
+        data = "@" + tag + " " + std::to_string(frame.status) + " " + std::to_string(body.size()) + "\n" + body;
+    }
+    enqueue(client, OutboundItem{"", makeSharedBuffer(std::move(data)), Priority::Critical, OfflineCopy()});
+}
 
-        Client* c = getClient(fd);
-        if (c) {
-            while (std::getline(ss, command_line, '\n')) {
-                if (!command_line.empty() && command_line.back() == '\r') {
-                    command_line.pop_back();
-                }
+void Server::dropClient(int fd, const char* reason) {
+    Client* c = getClient(fd);
+    if (c) {
+        Logger::info("client_disconnected", {{"fd", std::to_string(fd)}, {"user", c->username}, {"reason", reason}});
+        c->closing = true;
+        // Whatever chat never reached the socket goes to offline_messages
+        prefixBytes -= c->out.prefixBytes();
+        Session* session = c->sessionToken.empty() ? nullptr : sessions.find(c->sessionToken);
+        uint64_t unreadFrom = session ? session->nextSeq : 0;
+        for (const auto& item : c->out.takeUndelivered()) {
+            if (item.seq != 0 && item.seq < unreadFrom) unreadFrom = item.seq;
+            // Anything still in the session window can be replayed instead
+            if (session && item.seq != 0 && item.seq >= session->oldestSeq()) continue;
+            if (item.spill.origin) spillOffline(item.spill);
+        }
 
-                if (!command_line.empty()) {
-                    CommandHandler::handleCommand(command_line, *c, *this);
-                }
+        if (session && session->fd == fd) {
+            sessions.detach(*session, unreadFrom);
+            std::string token = session->token;
+            session->expiry = timers.schedule(config.resumeGrace * 1000LL, [this, token]() { expireSession(token); });
+        }
+        if (c->isAuthenticated) logoutClient(*c);
+        if (blobs) blobs->abort(fd);
+        if (c->peerNode != 0) {
+            for (const auto& name : cluster.detachInbound(c->peerNode, fd)) noteRemotePresence(name);
+        }
+    }
+    removeClient(fd);
+}
+
+// Runs from the client's idle timer. Activity only refreshes lastActivity;
+// the timer is re-armed here for whatever time is left, so busy connections
+// never touch the wheel on the read path.
+void Server::checkIdle(int fd) {
+    Client* c = getClient(fd);
+    if (!c) return;
+    c->idleTimer = TimerWheel::INVALID_TIMER;
+
+    int64_t now = TimerWheel::monotonicMs();
+    int64_t silent = now - c->lastActivity;
+    int64_t idleLimit = config.idleTimeout * 1000LL;
+    int64_t pingAfter = config.heartbeatInterval * 1000LL;
+
+    if (idleLimit > 0 && silent >= idleLimit) {
+        dropClient(fd, "idle_timeout");
+        return;
+    }
+
+    int64_t next = -1;
+    if (pingAfter > 0) {
+        if (silent >= pingAfter) {
+            if (!c->pingSent) {
+                push(*c, Protocol::OP_PING, makeSharedBuffer("PING\n"), Priority::Critical);
+                c->pingSent = true;
             }
+        } else {
+            next = pingAfter - silent;
         }
     }
+    if (idleLimit > 0 && (next < 0 || idleLimit - silent < next)) next = idleLimit - silent;
+    if (next >= 0) {
+        c->idleTimer = timers.schedule(next, [this, fd]() { checkIdle(fd); });
+    }
+}
+
+TimerWheel::TimerId Server::runAfter(int64_t delayMs, TimerWheel::Callback task) {
+    return timers.schedule(delayMs, std::move(task));
+}
+
+void Server::cancelTimer(TimerWheel::TimerId id) {
+    timers.cancel(id);
+}
+
+// Memory storage: rewrite the snapshot periodically. It is written from the
+// event loop, which is fine for the benchmark / test sizes this engine is for.
+void Server::scheduleSnapshot() {
+    timers.schedule(static_cast<int64_t>(config.snapshotInterval) * 1000, [this]() {
+        memoryStorage->saveSnapshot();
+        scheduleSnapshot();
+    });
+}
+
+// Before the query worker and maintenance start, which read it too
+void Server::openArchive() {
+    if (config.archiveDir.empty()) return;
+    archive = std::make_unique<PostArchive>(config.archiveDir);
+    if (!archive->open()) {
+        archive.reset();
+        return;
+    }
+    sqliteStorage->setArchive(archive.get());
+    queryWorker.setArchive(archive.get());
+    // Cached profiles may still list posts that just moved; ProfileCache
+    // takes invalidations from any thread
+    archive->onArchived([this](const std::vector<int>& authors) {
+        for (int author : authors) profileCache.invalidate(author);
+    });
+    metrics.add("archive.segments", [this]() { return archive->segmentCount(); });
+    metrics.add("archive.posts", [this]() { return archive->archivedPosts(); });
+    metrics.add("archive.bytes", [this]() { return archive->bytes(); });
+}
+
+void Server::startMaintenance() {
+    Maintenance::Settings settings;
+    settings.intervalSec = config.maintenanceInterval;
+    settings.offlineRetentionDays = config.offlineRetentionDays;
+    settings.batchSize = config.maintenanceBatch;
+    settings.pauseMs = config.maintenancePauseMs;
+    settings.vacuumPages = config.vacuumPages;
+    settings.archiveAfterDays = config.archiveAfterDays;
+    settings.archiveBatch = config.archiveBatch;
+    maintenance = std::make_unique<Maintenance>(config.dbPath, settings, archive.get());
+    maintenance->setChangeLog(changeLog.get());
+    maintenance->setStandby(!config.standbyOf.empty());
+    if (!maintenance->start()) {
+        maintenance.reset();
+        return;
+    }
+    metrics.add("maintenance.passes", [this]() { return maintenance->passes(); });
+    metrics.add("maintenance.last_pass_ms", [this]() { return maintenance->passMs(); });
+    metrics.add("maintenance.reclaimed.offline_expired", [this]() { return maintenance->expiredOffline(); });
+    metrics.add("maintenance.reclaimed.offline_orphans", [this]() { return maintenance->orphanedOffline(); });
+    metrics.add("maintenance.reclaimed.posts", [this]() { return maintenance->orphanedPosts(); });
+    metrics.add("maintenance.reclaimed.friendships", [this]() { return maintenance->orphanedFriendships(); });
+    metrics.add("maintenance.reclaimed.group_members", [this]() { return maintenance->orphanedMemberships(); });
+    metrics.add("maintenance.archived_posts", [this]() { return maintenance->postsArchived(); });
+    metrics.add("maintenance.pages_vacuumed", [this]() { return maintenance->pagesVacuumed(); });
+    metrics.add("maintenance.pauses", [this]() { return maintenance->pauses(); });
+    metrics.add("maintenance.pause_ms_total", [this]() { return maintenance->pauseMs(); });
+    metrics.add("maintenance.pause_ms_max", [this]() { return maintenance->maxPauseMs(); });
+}
+
+bool Server::startBackup(const std::string& path) {
+    return backup && backup->start(path);
+}
+
+// --backup-interval: a timestamped copy in backupDir; skipped if the
+// previous one (or a BACKUP) is still running
+void Server::scheduleBackup() {
+    timers.schedule(static_cast<int64_t>(config.backupInterval) * 1000, [this]() {
+        char name[64];
+        time_t now = time(nullptr);
+        struct tm tm;
+        localtime_r(&now, &tm);
+        strftime(name, sizeof(name), "/virtualsoc-%Y%m%d-%H%M%S.db", &tm);
+        if (!startBackup(config.backupDir + name)) Logger::warn("backup_skipped", {{"reason", "already running"}});
+        scheduleBackup();
+    });
 }
 
 void Server::sendMessage(int client_fd, const std::string& message) {
-    send(client_fd, message.c_str(), message.length(), 0);
+    Client* c = getClient(client_fd);
+    if (!c) return;
+
+    if (c->collecting) {
+        // Part of the response to the request being handled
+        size_t start = 0;
+        while (start < message.size()) {
+            size_t end = message.find('\n', start);
+            if (end == std::string::npos) end = message.size();
+            std::string line = message.substr(start, end - start);
+            start = end + 1;
+            if (line.empty()) continue;
+            if (c->response.status == 0 && line.size() >= 3 && isdigit(line[0]) && isdigit(line[1]) && isdigit(line[2])) {
+                c->response.status = static_cast<uint16_t>(std::stoi(line.substr(0, 3)));
+            }
+            c->response.fields.push_back(Protocol::Field::text(line));
+        }
+        return;
+    }
+    push(*c, Protocol::OP_PUSH_NOTICE, makeSharedBuffer(message), Priority::Critical);
+}
+
+void Server::sendSection(Client& client, const std::string& header, const std::vector<std::string>& items,
+                         const std::string& footer, const std::string& emptyNote) {
+    if (client.collecting) {
+        if (client.response.status == 0) client.response.status = 200;
+        for (const auto& item : items) client.response.fields.push_back(Protocol::Field::text(item));
+        return;
+    }
+
+    std::string text = header;
+    for (const auto& item : items) text += item + "\n";
+    if (items.empty()) text += emptyNote;
+    text += footer;
+    sendMessage(client.fd, text);
+}
+
+void Server::querySection(Client& client, const std::string& header, SectionQuery query,
+                          const std::string& footer, const std::string& emptyNote) {
+    if (client.collecting) {
+        auto items = std::make_shared<std::vector<std::string>>();
+        Protocol::Frame frame = client.response;
+        frame.status = 200;
+        int fd = client.fd;
+        uint64_t serial = client.serial;
+        std::string tag = client.responseTag;
+
+        bool queued = queryWorker.submit(
+            [items, query](Storage& db) { *items = query(db); },
+            [this, items, frame, fd, serial, tag]() mutable {
+                Client* c = getClient(fd);
+                if (!c || c->serial != serial || c->closing) return;
+                for (auto& item : *items) frame.fields.push_back(Protocol::Field::text(std::move(item)));
+                sendResponse(*c, frame, tag);
+            });
+        if (queued) {
+            client.responseDeferred = true;
+            return;
+        }
+    }
+    sendSection(client, header, query(*storage), footer, emptyNote);
+}
+
+bool Server::sendFile(Client& client, const std::string& path, const std::string& statusLine) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    auto file = std::make_shared<FileSlice>(fd, 0, static_cast<size_t>(st.st_size));
+
+    std::string head = statusLine;
+    if (client.collecting) {
+        // This is the whole response
+        client.responseDeferred = true;
+        if (client.responseTag.empty()) {
+            head = Protocol::singleFieldPrefix(Protocol::FRAME_RESPONSE, client.response.opcode, client.response.id, 200,
+                                               file->length);
+        } else {
+            head = "@" + client.responseTag + " 200 " + std::to_string(file->length) + "\n";
+        }
+    }
+    OutboundItem item{head, makeSharedBuffer(""), Priority::Critical, OfflineCopy()};
+    item.file = file;
+    downloads++;
+    downloadBytes += file->length;
+    enqueue(client, std::move(item));
+    return true;
+}
+
+void Server::notify(Client& client, const std::string& message) {
+    OutboundItem item{"", makeSharedBuffer(message), Priority::Critical, OfflineCopy()};
+    item.pushOpcode = Protocol::OP_PUSH_NOTICE;
+    item.replayable = true;
+    enqueue(client, std::move(item));
+}
+
+void Server::push(Client& client, uint16_t opcode, const SharedBuffer& message, Priority priority) {
+    OutboundItem item{"", message, priority, OfflineCopy()};
+    item.pushOpcode = opcode;
+    enqueue(client, std::move(item));
 }
 
 void Server::broadcastMessage(const std::string& message, int exclude_fd) {
-    for (const auto& client : clients) {
+    SharedBuffer buffer = makeSharedBuffer(message);
+    for (auto& entry : clients) {
+        Client& client = entry.second;
         if (client.fd != exclude_fd) {
-            sendMessage(client.fd, message);
+            push(client, Protocol::OP_PUSH_NOTICE, buffer, Priority::Presence);
         }
     }
 }
 
-Client* Server::getClient(int fd) {
-    for (auto& client : clients) {
-        if (client.fd == fd) return &client;
+void Server::deliverChat(Client& dest, const SharedBuffer& message, const OfflineCopy& copy) {
+    OutboundItem item{"", message, Priority::Chat, copy};
+    item.pushOpcode = Protocol::OP_PUSH_CHAT;
+    item.replayable = true;
+    enqueue(dest, std::move(item));
+}
+
+// Shared payloads are counted once no matter how many queues hold them
+size_t Server::queuedMemory() const {
+    return SharedBufferStats::liveBytes().load(std::memory_order_relaxed) + prefixBytes;
+}
+
+// Applies the slow-consumer policies before queueing. Above the per-client
+// budget or the global high-water mark, presence is dropped and chat is
+// spilled to the database; past the hard limit the client is disconnected.
+void Server::enqueue(Client& client, OutboundItem item) {
+    if (client.closing) {
+        if (item.spill.origin) spillOffline(item.spill);
+        return;
+    }
+    if (client.binary && item.pushOpcode != 0 && item.prefix.empty()) {
+        item.prefix = Protocol::singleFieldPrefix(Protocol::FRAME_PUSH, item.pushOpcode, static_cast<uint32_t>(item.seq),
+                                                  0, item.payload->size());
     }
-    return nullptr;
+
+    size_t size = item.memory();
+    bool overBudget = client.out.bytes() + size > config.outBudget;
+    bool overGlobal = queuedMemory() > config.memoryHighWater;
+
+    if (overBudget || overGlobal) {
+        if (item.priority == Priority::Presence && (overGlobal || config.hasSlowPolicy("drop"))) {
+            droppedPushes++;
+            Logger::warn("push_dropped", {{"fd", std::to_string(client.fd)}, {"user", client.username},
+                                          {"queued_bytes", std::to_string(client.out.bytes())}});
+            return;
+        }
+        if (item.priority == Priority::Chat && item.spill.origin && (overGlobal || config.hasSlowPolicy("spill"))) {
+            spillOffline(item.spill);
+            return;
+        }
+        if (client.out.bytes() + size > config.outHardLimit && config.hasSlowPolicy("disconnect")) {
+            scheduleClose(client, "slow_consumer");
+            if (item.spill.origin) spillOffline(item.spill);
+            return;
+        }
+    }
+
+    if (item.seq == 0 && !client.sessionToken.empty()) recordPush(client, item);
+
+    bool wasEmpty = client.out.empty();
+    prefixBytes += item.prefix.size();
+    client.out.push(std::move(item));
+    if (wasEmpty) flushClient(client);
+
+    if (!client.readPaused && client.out.bytes() > config.outBudget && config.hasSlowPolicy("pause")) {
+        client.readPaused = true;
+        Logger::warn("client_read_paused", {{"fd", std::to_string(client.fd)}, {"user", client.username},
+                                            {"queued_bytes", std::to_string(client.out.bytes())}});
+        updateInterest(client);
+    }
+}
+
+void Server::flushClient(Client& client) {
+    size_t framingBefore = client.out.prefixBytes();
+    bool ok = client.out.flush(client.fd);
+    prefixBytes -= framingBefore - client.out.prefixBytes();
+    if (!ok) {
+        scheduleClose(client, "write_error");
+        return;
+    }
+    if (client.readPaused && client.out.bytes() <= config.outBudget / 2) {
+        client.readPaused = false;
+    }
+    updateInterest(client);
+}
+
+void Server::updateInterest(Client& client) {
+    uint32_t wanted = 0;
+    if (!client.readPaused) wanted |= EPOLLIN;
+    if (!client.out.empty()) wanted |= EPOLLOUT;
+    if (wanted == client.epollEvents) return;
+
+    struct epoll_event event;
+    event.events = wanted;
+    event.data.fd = client.fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client.fd, &event);
+    client.epollEvents = wanted;
+}
+
+void Server::spillOffline(const OfflineCopy& copy) {
+    int targetId = usernames.find(copy.targetUser);
+    if (targetId == -1) return;
+    const ChatOrigin& origin = *copy.origin;
+    storage->storeOfflineMessage(targetId, origin.sender, origin.content, origin.isGroup, origin.groupId);
+    spilledMessages++;
+    Logger::info("message_spilled", {{"target", copy.targetUser}, {"sender", origin.sender}});
+}
+
+// Handlers may still hold a Client& when a close is decided, so the
+// actual removal happens after the current event is processed.
+void Server::scheduleClose(Client& client, const char* reason) {
+    if (client.closing) return;
+    client.closing = true;
+    pendingClose.emplace_back(client.fd, reason);
+}
+
+void Server::processPendingCloses() {
+    while (!pendingClose.empty()) {
+        std::vector<std::pair<int, const char*>> batch;
+        batch.swap(pendingClose);
+        for (const auto& entry : batch) {
+            Client* c = getClient(entry.first);
+            if (c) c->closing = false;
+            dropClient(entry.first, entry.second);
+        }
+    }
+}
+
+Client* Server::getClient(int fd) {
+    auto it = clients.find(fd);
+    return it == clients.end() ? nullptr : &it->second;
 }
 
 Client* Server::getClientByUsername(const std::string& username) {
-    for (auto& client : clients) {
-        if (client.isAuthenticated && client.username == username) {
-            return &client;
+    const std::vector<int>* fds = presence.sessionsOf(username);
+    if (!fds || fds->empty()) return nullptr;
+    return getClient(fds->front());
+}
+
+// Chat and notifications get the next number of the client's session and a
+// copy is kept for replay; replies, heartbeats and presence are not worth
+// resending.
+void Server::recordPush(Client& client, OutboundItem& item) {
+    if (!item.replayable) return;
+    Session* session = sessions.find(client.sessionToken);
+    if (!session) return;
+
+    std::vector<OfflineCopy> lost;
+    item.seq = sessions.record(*session, item.pushOpcode, item.payload, item.spill, lost);
+    for (const auto& spill : lost) spillOffline(spill);
+    if (!item.prefix.empty()) Protocol::setFrameId(item.prefix, static_cast<uint32_t>(item.seq));
+}
+
+std::string Server::openSession(Client& client) {
+    if (config.resumeGrace <= 0) return "";
+    Session& session = sessions.create(client.username, client.fd);
+    client.sessionToken = session.token;
+    return session.token;
+}
+
+bool Server::resumeSession(Client& client, const std::string& token, uint64_t lastSeq) {
+    Session* session = sessions.find(token);
+    if (!session || lastSeq >= session->nextSeq) return false;
+
+    if (session->fd != -1) {
+        // The old connection has not noticed it is dead yet: take over.
+        // Its queue is replayed below, so nothing in it gets spilled.
+        Client* old = getClient(session->fd);
+        if (old) {
+            old->sessionToken.clear();
+            prefixBytes -= old->out.prefixBytes();
+            old->out.takeUndelivered();
+            scheduleClose(*old, "session_resumed");
+        }
+    }
+    timers.cancel(session->expiry);
+    session->expiry = TimerWheel::INVALID_TIMER;
+    sessions.attach(*session, client.fd);
+    client.sessionToken = token;
+    loginClient(client, session->username);
+    cancelTimer(client.loginTimer);
+    client.loginTimer = TimerWheel::INVALID_TIMER;
+
+    // Copy first: enqueue may trim the window while we walk it
+    std::vector<BufferedPush> missed;
+    for (const auto& push : session->recent) {
+        if (push.seq > lastSeq) missed.push_back(push);
+    }
+    Logger::info("session_resumed", {{"user", session->username}, {"replayed", std::to_string(missed.size())}});
+    for (const auto& push : missed) {
+        OutboundItem item{"", makeSharedBuffer(push.payload), push.spill.origin ? Priority::Chat : Priority::Critical, push.spill};
+        item.pushOpcode = push.opcode;
+        item.seq = push.seq;
+        enqueue(client, std::move(item));
+    }
+    return true;
+}
+
+void Server::closeSession(Client& client) {
+    if (client.sessionToken.empty()) return;
+    Session* session = sessions.find(client.sessionToken);
+    if (session) timers.cancel(session->expiry);
+    sessions.remove(client.sessionToken);
+    client.sessionToken.clear();
+}
+
+void Server::closeSessionsOf(const std::string& username) {
+    for (const auto& token : sessions.tokensOf(username)) {
+        Session* session = sessions.find(token);
+        if (session->fd != -1) {
+            Client* c = getClient(session->fd);
+            if (c) c->sessionToken.clear();
+        }
+        timers.cancel(session->expiry);
+        sessions.remove(token);
+    }
+}
+
+bool Server::holdForDetached(const std::string& username, const SharedBuffer& message, const OfflineCopy& copy) {
+    Session* session = sessions.detachedSessionOf(username);
+    if (!session) return false;
+    std::vector<OfflineCopy> lost;
+    sessions.record(*session, Protocol::OP_PUSH_CHAT, message, copy, lost);
+    for (const auto& spill : lost) spillOffline(spill);
+    return true;
+}
+
+// Grace period over: whatever the client never got goes to offline_messages
+void Server::expireSession(const std::string& token) {
+    Session* session = sessions.find(token);
+    if (!session || session->fd != -1) return;
+    session->expiry = TimerWheel::INVALID_TIMER;
+    std::vector<OfflineCopy> unread = sessions.unread(*session);
+    for (const auto& copy : unread) spillOffline(copy);
+    Logger::info("session_expired", {{"user", session->username}, {"spilled", std::to_string(unread.size())}});
+    sessions.remove(token);
+}
+
+void Server::loginClient(Client& client, const std::string& username) {
+    client.setUsername(username);
+    if (presence.add(username, client.fd)) {
+        cluster.announcePresence(username, true);
+        schedulePresenceDigest();
+    }
+}
+
+void Server::logoutClient(Client& client) {
+    if (!client.isAuthenticated) return;
+    if (presence.remove(client.username, client.fd)) {
+        cluster.announcePresence(client.username, false);
+        // Still online as far as friends are concerned
+        if (cluster.isOnlineElsewhere(client.username)) presence.noteElsewhere(client.username, true);
+        schedulePresenceDigest();
+    }
+    client.logout();
+}
+
+// Presence changes are batched: the first change arms a timer and every
+// change until it fires goes into the same digest.
+void Server::schedulePresenceDigest() {
+    if (presenceTimer != TimerWheel::INVALID_TIMER) return;
+    presenceTimer = timers.schedule(config.presenceInterval, [this]() {
+        presenceTimer = TimerWheel::INVALID_TIMER;
+        flushPresence();
+    });
+}
+
+// Sends each online friend of a changed user one line per digest:
+// PRESENCE <user>:online <user2>:offline ...
+void Server::flushPresence() {
+    std::unordered_map<int, std::string> digests;
+    for (const auto& change : presence.takeChanges()) {
+        int userId = usernames.find(change.first);
+        if (userId == -1) continue;
+        std::string entry = " " + change.first + (change.second ? ":online" : ":offline");
+        for (int friendId : socialGraph.friendsOf(userId)) {
+            const std::vector<int>* fds = presence.sessionsOf(usernames.nameOf(friendId));
+            if (!fds) continue;
+            for (int fd : *fds) digests[fd] += entry;
         }
     }
-    return nullptr;
+    for (auto& digest : digests) {
+        Client* c = getClient(digest.first);
+        if (!c) continue;
+        push(*c, Protocol::OP_PUSH_PRESENCE, makeSharedBuffer("PRESENCE" + digest.second + "\n"), Priority::Presence);
+    }
+}
+
+// The change log (and the replication socket on top of it) is opened at
+// startup, or on PROMOTE for a standby
+void Server::startChangeLog() {
+    if (config.changelogDir.empty() || !sqliteStorage) return;
+    changeLog = std::make_unique<ChangeLog>(config.changelogDir, config.changelogSegmentBytes, config.changelogSegments);
+    if (!changeLog->isOpen()) {
+        changeLog.reset();
+        return;
+    }
+    sqliteStorage->setChangeLog(changeLog.get());
+    metrics.add("changelog.last_seq", [this]() { return changeLog->lastSeq(); });
+    metrics.add("changelog.segments_created", [this]() { return changeLog->segmentsCreated(); });
+
+    if (config.replicationSocket.empty()) return;
+    replicationSender = std::make_unique<ReplicationSender>(config.replicationSocket, *changeLog);
+    if (replicationSender->start()) {
+        metrics.add("replication.standbys", [this]() { return replicationSender->standbys(); });
+    } else {
+        replicationSender.reset();
+    }
+}
+
+uint64_t Server::promote() {
+    replica->stop();
+    // Whatever the receiver committed last still has to reach the indexes
+    replica->runCompletions([this](ChangeKind kind, const std::vector<Protocol::Field>& fields) {
+        applyReplicated(kind, fields);
+    });
+    uint64_t seq = replica->lastApplied();
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, replica->notifyFd(), NULL);
+    replica.reset();
+    startChangeLog();
+    if (maintenance) {
+        maintenance->setChangeLog(changeLog.get());
+        maintenance->setStandby(false);
+    }
+    Logger::warn("standby_promoted", {{"applied_seq", std::to_string(seq)}});
+    return seq;
+}
+
+// Standby: keeps what the event loop holds in memory in step with the
+// rows the receiver just committed
+void Server::applyReplicated(ChangeKind kind, const std::vector<Protocol::Field>& fields) {
+    auto number = [&fields](size_t i) { return i < fields.size() ? static_cast<int>(fields[i].num) : -1; };
+    auto text = [&fields](size_t i) { return i < fields.size() ? fields[i].str : std::string(); };
+    switch (kind) {
+    case ChangeKind::UserRegistered:
+        usernames.add(text(1), number(0));
+        break;
+    case ChangeKind::UserDeleted: {
+        int id = usernames.find(text(0));
+        syncVersions.touchAll();
+        profileCache.invalidate(id);
+        usernames.remove(text(0));
+        socialGraph.removeUser(id);
+        closeSessionsOf(text(0));
+        break;
+    }
+    case ChangeKind::FriendRequested:
+        syncVersions.touch(number(1), SyncSection::Requests);
+        break;
+    case ChangeKind::FriendAccepted:
+        socialGraph.addFriendship(number(0), number(1));
+        syncVersions.touch(number(0), SyncSection::Requests);
+        syncVersions.touch(number(0), SyncSection::Friends);
+        syncVersions.touch(number(1), SyncSection::Friends);
+        break;
+    case ChangeKind::GroupMemberAdded:
+        syncVersions.touch(number(1), SyncSection::Groups);
+        break;
+    case ChangeKind::PostCreated:
+    case ChangeKind::PostDeleted:
+        syncVersions.touchPosts();
+        profileCache.invalidate(number(1));
+        break;
+    default:
+        break;
+    }
+}
+
+void Server::touchSync(int userId, SyncSection section) {
+    syncVersions.touch(userId, section);
+    cluster.announceTouch(userId, static_cast<int>(section));
+}
+
+void Server::touchPosts(int authorId) {
+    syncVersions.touchPosts();
+    profileCache.invalidate(authorId);
+    cluster.announceTouch(authorId, static_cast<int>(SyncSection::Feed));
+}
+
+void Server::scheduleClusterTick() {
+    timers.schedule(1000, [this]() {
+        cluster.tick();
+        scheduleClusterTick();
+    });
+}
+
+// The other node may have registered users or made friends while its link
+// was down, so the in-memory copies are reloaded from the shared database.
+void Server::acceptPeer(Client& client, int node) {
+    cancelTimer(client.loginTimer);
+    client.loginTimer = TimerWheel::INVALID_TIMER;
+    client.peerNode = node;
+    client.binary = true;
+    cluster.attachInbound(node, client.fd);
+    reloadDirectory();
+    Logger::info("cluster_peer_attached", {{"peer", std::to_string(node)}, {"fd", std::to_string(client.fd)}});
+}
+
+// The copies are read and built on the query worker and swapped in here.
+// One that changed meanwhile (an event from the link, a registration) would
+// be set back by the swap, so the reload starts over instead.
+void Server::reloadDirectory() {
+    uint64_t seenUsers = usernames.version(), seenGraph = socialGraph.version();
+    auto users = std::make_shared<UsernameIndex>();
+    auto graph = std::make_shared<SocialGraph>();
+    bool queued = queryWorker.submit(
+        [users, graph](Storage& db) {
+            users->load(db.getAllUsers());
+            graph->load(db.getAcceptedFriendships());
+        },
+        [this, users, graph, seenUsers, seenGraph]() {
+            if (usernames.version() != seenUsers || socialGraph.version() != seenGraph) {
+                reloadDirectory();
+                return;
+            }
+            usernames.replaceWith(std::move(*users));
+            socialGraph.replaceWith(std::move(*graph));
+        });
+    if (!queued) {
+        usernames.load(storage->getAllUsers());
+        socialGraph.load(storage->getAcceptedFriendships());
+    }
+}
+
+// Friends here hear about users on other nodes through the usual digests,
+// unless the user also has a session here
+void Server::noteRemotePresence(const std::string& username) {
+    if (presence.isOnline(username)) return;
+    presence.noteElsewhere(username, cluster.isOnlineElsewhere(username));
+    schedulePresenceDigest();
+}
+
+// A frame on another node's link to us (kinds in Protocol.h)
+void Server::handlePeerFrame(Client& peer, const Protocol::Frame& frame) {
+    const std::vector<Protocol::Field>& f = frame.fields;
+    auto text = [&f](size_t i) { return i < f.size() ? f[i].asString() : std::string(); };
+    auto number = [&f](size_t i) -> int { return i < f.size() && f[i].type == Protocol::Field::INT ? static_cast<int>(f[i].num) : -1; };
+    int node = peer.peerNode;
+
+    switch (frame.opcode) {
+    case Protocol::OP_NODE_SYNC: {
+        std::vector<std::string> changed = cluster.forgetNode(node);
+        for (const auto& field : f) {
+            cluster.setOnline(node, field.str);
+            changed.push_back(field.str);
+        }
+        for (const auto& name : changed) noteRemotePresence(name);
+        break;
+    }
+    case Protocol::OP_NODE_PRESENCE: {
+        std::string name = text(0);
+        if (number(1) == 1 ? cluster.setOnline(node, name) : cluster.setOffline(node, name)) noteRemotePresence(name);
+        break;
+    }
+    case Protocol::OP_NODE_CHAT: {
+        std::string sender = text(0), content = text(1);
+        int groupId = number(2);
+        bool isGroup = groupId != -1;
+        SharedBuffer message = makeSharedBuffer(isGroup ? "[Group " + std::to_string(groupId) + "] " + sender + ": " + content + "\n"
+                                                        : "[Private from " + sender + "]: " + content + "\n");
+        auto origin = std::make_shared<const ChatOrigin>(ChatOrigin{sender, content, isGroup, groupId});
+        for (size_t i = 3; i < f.size(); i++) {
+            const std::string& name = f[i].str;
+            Client* dest = getClientByUsername(name);
+            if (dest) {
+                deliverChat(*dest, message, OfflineCopy{name, origin});
+            } else if (!holdForDetached(name, message, OfflineCopy{name, origin})) {
+                // Logged out while the message was on its way
+                spillOffline(OfflineCopy{name, origin});
+            }
+            clusterDeliveries++;
+        }
+        // Queued or stored here: the sending node can let go of its copy
+        push(peer, Protocol::OP_NODE_CHAT_ACK, makeSharedBuffer(""), Priority::Critical);
+        break;
+    }
+    case Protocol::OP_NODE_USER: {
+        int id = number(0);
+        std::string name = text(1);
+        if (number(2) == 1) {
+            usernames.add(name, id);
+            break;
+        }
+        syncVersions.touchAll();
+        profileCache.invalidate(id);
+        usernames.remove(name);
+        socialGraph.removeUser(id);
+        closeSessionsOf(name);
+        Client* target = getClientByUsername(name);
+        if (target) {
+            sendMessage(target->fd, "You have been banned/deleted by admin.\n");
+            logoutClient(*target);
+        }
+        break;
+    }
+    case Protocol::OP_NODE_FRIENDSHIP:
+        socialGraph.addFriendship(number(0), number(1));
+        break;
+    case Protocol::OP_NODE_TOUCH: {
+        int userId = number(0);
+        if (number(1) < 0 || number(1) > static_cast<int>(SyncSection::Groups)) break;
+        SyncSection section = static_cast<SyncSection>(number(1));
+        if (section == SyncSection::Feed) {
+            syncVersions.touchPosts();
+            profileCache.invalidate(userId);
+        } else {
+            syncVersions.touch(userId, section);
+        }
+        break;
+    }
+    default:
+        break;   // heartbeats
+    }
 }
 
 void Server::removeClient(int fd) {
+    Client* c = getClient(fd);
+    if (c) {
+        timers.cancel(c->idleTimer);
+        timers.cancel(c->loginTimer);
+    }
     epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
     close(fd);
-    clients.erase(std::remove_if(clients.begin(), clients.end(),
-        [fd](const Client& c){ return c.fd == fd; }), clients.end());
+    clients.erase(fd);
 }
\ No newline at end of file
@@ -2,49 +2,207 @@
 #define SERVER_H
 
 #include <vector>
+#include <memory>
+#include <unordered_map>
+#include <utility>
 #include <sys/epoll.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <string>
 #include "Client.h"
-#include "Database/Database.h"
+#include "Config.h"
+#include "TimerWheel.h"
+#include "Presence.h"
+#include "QueryWorker.h"
+#include "SyncVersions.h"
+#include "SessionStore.h"
+#include "ProfileCache.h"
+#include "Metrics.h"
+#include "UsernameIndex.h"
+#include "SocialGraph.h"
+#include "Cluster.h"
+#include "Replication.h"
+#include "BlobStore.h"
+#include "Request.h"
+#include "Database/Storage.h"
+#include "Database/Backup.h"
+#include "Database/Maintenance.h"
+#include "Database/MemoryStorage.h"
+#include "Database/ShardedStorage.h"
 
 #define MAX_EVENTS 1024
 #define BUFFER_SIZE 32768
+#define MAX_LINE_LENGTH (1 << 20)
 #define DISCOVERY_PORT 9001
 
 class Server {
 private:
     int server_fd;
+    int peer_fd = -1;   // --peer-port, cluster mode only
     int udp_fd;
     int epoll_fd;
     int port;
-    std::vector<Client> clients;
+    std::unordered_map<int, Client> clients;
     struct sockaddr_in address;
 
     void setNonBlocking(int sock);
-    void handleNewConnection();
+    void handleNewConnection(int listener);
     void handleClientActivity(int client_fd);
     void handleDiscovery();
+    void processInput(Client& client);
+    void dispatch(Client& client, Request& req);
+    // Binary frame when tag is empty, "@tag status length" block otherwise
+    void sendResponse(Client& client, const Protocol::Frame& frame, const std::string& tag);
+    void dropClient(int fd, const char* reason);
+    void checkIdle(int fd);
 
-    DatabaseManager dbManager;
+    // Outbound path
+    void enqueue(Client& client, OutboundItem item);
+    void flushClient(Client& client);
+    void updateInterest(Client& client);
+    void spillOffline(const OfflineCopy& copy);
+    size_t queuedMemory() const;
+    void scheduleClose(Client& client, const char* reason);
+    void processPendingCloses();
+
+    // Resumable sessions
+    void recordPush(Client& client, OutboundItem& item);
+    void expireSession(const std::string& token);
+    SessionStore sessions;
+
+    // Presence digests
+    void schedulePresenceDigest();
+    void flushPresence();
+
+    // Cluster links from other nodes
+    void handlePeerFrame(Client& peer, const Protocol::Frame& frame);
+    void noteRemotePresence(const std::string& username);
+    void scheduleClusterTick();
+    uint64_t clusterDeliveries = 0;
+
+    PresenceIndex presence;
+    TimerWheel::TimerId presenceTimer = TimerWheel::INVALID_TIMER;
+
+    size_t prefixBytes = 0;   // framing queued on all connections
+    uint64_t droppedPushes = 0;
+    uint64_t spilledMessages = 0;
+    std::vector<std::pair<int, const char*>> pendingClose;
+    uint64_t nextSerial = 1;
+
+    ServerConfig config;
+    std::unique_ptr<ChangeLog> changeLog;   // outlives the storage writing to it
+    std::unique_ptr<PostArchive> archive;   // same, for the storage and maintenance reading it
+    void openArchive();
+    std::unique_ptr<Storage> storage;
+    DatabaseManager* sqliteStorage = nullptr;   // set with --storage=sqlite
+    void startChangeLog();
+    std::unique_ptr<ReplicationSender> replicationSender;
+    std::unique_ptr<ReplicationReceiver> replica;   // set while this server is a standby
+    void applyReplicated(ChangeKind kind, const std::vector<Protocol::Field>& fields);
+    MemoryStorage* memoryStorage = nullptr;   // set with --storage=memory, for snapshots
+    void scheduleSnapshot();
+    std::unique_ptr<BackupJob> backup;   // set with --storage=sqlite
+    void scheduleBackup();
+    std::unique_ptr<Maintenance> maintenance;
+    void startMaintenance();
+    QueryWorker queryWorker;
+    TimerWheel timers;
+    SyncVersions syncVersions;
+    ProfileCache profileCache;
+    Metrics metrics;
+    UsernameIndex usernames;
+    SocialGraph socialGraph;
+    Cluster cluster;
+    std::unique_ptr<BlobStore> blobs;   // set with --blob-dir
+    uint64_t downloads = 0;
+    uint64_t downloadBytes = 0;
 
 public:
-    Server(int port);
+    Server(const ServerConfig& config);
     ~Server();
     
     void start();
     
     // Mai mult pentru CommandHandler
     void sendMessage(int client_fd, const std::string& message);
+    // Unsolicited notice for a user (not a reply): replayed on RESUME
+    void notify(Client& client, const std::string& message);
     void broadcastMessage(const std::string& message, int exclude_fd = -1);
+    // List response: banner/footer lines in text mode, one field per item in binary mode
+    void sendSection(Client& client, const std::string& header, const std::vector<std::string>& items,
+                     const std::string& footer = "", const std::string& emptyNote = "");
+    // Like sendSection, but for a correlated request the query runs on the
+    // query worker and the response goes out whenever it is ready
+    using SectionQuery = std::function<std::vector<std::string>(Storage&)>;
+    void querySection(Client& client, const std::string& header, SectionQuery query,
+                      const std::string& footer = "", const std::string& emptyNote = "");
+    // Response made of a file, sent with sendfile: statusLine first for
+    // plain text clients, a one-field frame or tagged body otherwise.
+    // False if the file can't be opened.
+    bool sendFile(Client& client, const std::string& path, const std::string& statusLine);
+    // Unsolicited message; framed as a push of the given kind for binary clients
+    void push(Client& client, uint16_t opcode, const SharedBuffer& message, Priority priority);
+    // Chat push; spilled to offline_messages if the recipient can't keep up.
+    // Fan-outs render the message once and pass the same buffer and origin.
+    void deliverChat(Client& dest, const SharedBuffer& message, const OfflineCopy& copy);
 
     // Just in case
     Client* getClient(int fd);
     void removeClient(int fd);
     Client* getClientByUsername(const std::string& username);
 
-    DatabaseManager& getDB() { return dbManager; }
+    // Authentication state changes go through here to keep the online index
+    void loginClient(Client& client, const std::string& username);
+    void logoutClient(Client& client);
+    bool isOnline(const std::string& username) const {
+        return presence.isOnline(username) || cluster.isOnlineElsewhere(username);
+    }
+    // Standby mode: only reads are served, and only while the copy is fresh
+    bool isStandby() const { return replica != nullptr; }
+    bool standbyTooStale() const { return replica && replica->stalenessMs() > config.maxStaleness; }
+    // Stops replicating and starts taking writes; returns the last seq applied
+    uint64_t promote();
+
+    // BACKUP: copies the database to path in the background; false if a
+    // backup is already running or the storage can't be backed up. Clients
+    // only name a file in --backup-dir.
+    bool startBackup(const std::string& path);
+    bool canBackup() const { return backup != nullptr && !config.backupDir.empty(); }
+
+    // HELLO NODE: the connection is another node's cluster link
+    void acceptPeer(Client& client, int node);
+    void reloadDirectory();
+
+    // Session tokens: LOGIN opens one, RESUME re-attaches a dropped one and
+    // replays the pushes after lastSeq. Returns "" when tokens are disabled.
+    std::string openSession(Client& client);
+    bool resumeSession(Client& client, const std::string& token, uint64_t lastSeq);
+    void closeSession(Client& client);
+    void closeSessionsOf(const std::string& username);
+    // Keeps chat for a user whose session is detached; false if there is none
+    bool holdForDetached(const std::string& username, const SharedBuffer& message, const OfflineCopy& copy);
+
+    // Deferred work, run on the event loop thread
+    TimerWheel::TimerId runAfter(int64_t delayMs, TimerWheel::Callback task);
+    void cancelTimer(TimerWheel::TimerId id);
+
+    const ServerConfig& getConfig() const { return config; }
+    Storage& getDB() { return *storage; }
+    SyncVersions& getSync() { return syncVersions; }
+    // Changes clients SYNC on, here and on the other cluster nodes
+    void touchSync(int userId, SyncSection section);
+    void touchPosts(int authorId);
+    ProfileCache& getProfileCache() { return profileCache; }
+    const Metrics& getMetrics() const { return metrics; }
+    UsernameIndex& getUsernames() { return usernames; }
+    // Id for a username, -1 if there is no such user; answered from memory
+    int userId(const std::string& username) { return usernames.find(username); }
+    SocialGraph& getSocialGraph() { return socialGraph; }
+    Cluster& getCluster() { return cluster; }
+    // Null unless --blob-dir
+    BlobStore* getBlobs() { return blobs.get(); }
+    // Null unless --archive-dir
+    const PostArchive* getArchive() const { return archive.get(); }
 };
 
 #endif
\ No newline at end of file
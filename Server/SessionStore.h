@@ -0,0 +1,148 @@
+#ifndef SESSION_STORE_H
+#define SESSION_STORE_H
+
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "OutboundQueue.h"
+#include "TimerWheel.h"
+
+// A push kept for replay, numbered per session. The number is the id of
+// the push frame on binary connections. The payload is a copy of its own,
+// so replay windows do not count as queued output (load shedding).
+struct BufferedPush {
+    uint64_t seq;
+    uint16_t opcode;
+    std::string payload;
+    OfflineCopy spill;   // origin is null for notices
+};
+
+struct Session {
+    std::string token;
+    std::string username;
+    int fd = -1;                  // attached connection, -1 while detached
+    uint64_t nextSeq = 1;
+    uint64_t unreadFrom = 0;      // while detached: first seq the client surely never got
+    std::deque<BufferedPush> recent;
+    size_t recentBytes = 0;
+    TimerWheel::TimerId expiry = TimerWheel::INVALID_TIMER;
+
+    uint64_t oldestSeq() const { return recent.empty() ? nextSeq : recent.front().seq; }
+};
+
+// Resumable sessions handed out on LOGIN. Each one remembers its last
+// pushes, so a client that reconnects within the grace period can RESUME
+// and get exactly what it missed. While a session is detached, chat for
+// its user is kept here instead of going to offline_messages; only what
+// is still unread when the grace period ends (or what no longer fits)
+// has to be spilled. All windows together stay within a budget: past it,
+// a session makes room in its own window for what it records.
+class SessionStore {
+private:
+    static constexpr size_t MAX_ITEMS = 256;
+    static constexpr size_t MAX_BYTES = 256 << 10;
+    static constexpr int TOKEN_LENGTH = 27;   // ~127 bits of a-z
+
+    size_t budget = 64 << 20;
+    size_t totalBytes = 0;
+    std::unordered_map<std::string, Session> sessions;
+    std::unordered_map<std::string, std::string> detachedByUser;   // latest detached session per user
+    std::random_device entropy;
+
+    std::string newToken() {
+        std::uniform_int_distribution<int> letter(0, 25);
+        std::string token;
+        do {
+            token.clear();
+            for (int i = 0; i < TOKEN_LENGTH; i++) token += static_cast<char>('a' + letter(entropy));
+        } while (sessions.count(token));
+        return token;
+    }
+
+    void forgetDetached(const Session& s) {
+        auto it = detachedByUser.find(s.username);
+        if (it != detachedByUser.end() && it->second == s.token) detachedByUser.erase(it);
+    }
+
+public:
+    void setBudget(size_t bytes) { budget = bytes; }
+    size_t bytes() const { return totalBytes; }
+
+    Session& create(const std::string& username, int fd) {
+        std::string token = newToken();
+        Session& s = sessions[token];
+        s.token = token;
+        s.username = username;
+        s.fd = fd;
+        return s;
+    }
+
+    Session* find(const std::string& token) {
+        auto it = sessions.find(token);
+        return it == sessions.end() ? nullptr : &it->second;
+    }
+
+    Session* detachedSessionOf(const std::string& username) {
+        auto it = detachedByUser.find(username);
+        return it == detachedByUser.end() ? nullptr : find(it->second);
+    }
+
+    void detach(Session& s, uint64_t unreadFrom) {
+        s.fd = -1;
+        s.unreadFrom = unreadFrom;
+        detachedByUser[s.username] = s.token;
+    }
+
+    void attach(Session& s, int fd) {
+        s.fd = fd;
+        forgetDetached(s);
+    }
+
+    // Numbers and keeps a push. Chat that has to make room while the
+    // session is detached, and was never delivered, is returned in lost.
+    uint64_t record(Session& s, uint16_t opcode, const SharedBuffer& payload, const OfflineCopy& spill,
+                    std::vector<OfflineCopy>& lost) {
+        uint64_t seq = s.nextSeq++;
+        s.recent.push_back(BufferedPush{seq, opcode, *payload, spill});
+        s.recentBytes += payload->size();
+        totalBytes += payload->size();
+        while (s.recent.size() > MAX_ITEMS || s.recentBytes > MAX_BYTES || (totalBytes > budget && s.recent.size() > 1)) {
+            const BufferedPush& old = s.recent.front();
+            if (s.fd == -1 && old.seq >= s.unreadFrom && old.spill.origin) lost.push_back(old.spill);
+            s.recentBytes -= old.payload.size();
+            totalBytes -= old.payload.size();
+            s.recent.pop_front();
+        }
+        return seq;
+    }
+
+    // Chat a detached session never delivered
+    std::vector<OfflineCopy> unread(const Session& s) const {
+        std::vector<OfflineCopy> result;
+        for (const auto& push : s.recent) {
+            if (push.seq >= s.unreadFrom && push.spill.origin) result.push_back(push.spill);
+        }
+        return result;
+    }
+
+    void remove(const std::string& token) {
+        Session* s = find(token);
+        if (!s) return;
+        forgetDetached(*s);
+        totalBytes -= s->recentBytes;
+        sessions.erase(token);
+    }
+
+    std::vector<std::string> tokensOf(const std::string& username) const {
+        std::vector<std::string> tokens;
+        for (const auto& entry : sessions) {
+            if (entry.second.username == username) tokens.push_back(entry.first);
+        }
+        return tokens;
+    }
+};
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef SHARED_BUFFER_H
+#define SHARED_BUFFER_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+// Immutable, reference-counted payload. A broadcast or group message is
+// rendered once and the same buffer is queued on every recipient; it is
+// freed when the last queue has flushed it.
+using SharedBuffer = std::shared_ptr<const std::string>;
+
+class SharedBufferStats {
+public:
+    // Bytes held by live shared buffers (each buffer counted once)
+    static std::atomic<size_t>& liveBytes() {
+        static std::atomic<size_t> bytes{0};
+        return bytes;
+    }
+};
+
+inline SharedBuffer makeSharedBuffer(std::string data) {
+    size_t size = data.size();
+    SharedBufferStats::liveBytes().fetch_add(size, std::memory_order_relaxed);
+    return SharedBuffer(new std::string(std::move(data)), [size](const std::string* p) {
+        SharedBufferStats::liveBytes().fetch_sub(size, std::memory_order_relaxed);
+        delete p;
+    });
+}
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef SOCIAL_GRAPH_H
+#define SOCIAL_GRAPH_H
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Accepted friendships as sorted adjacency lists, kept in memory so that
+// suggestions can walk the graph without joining friendships twice.
+// Loaded from the database at startup and updated by the handlers that
+// change friendships; event loop thread only.
+class SocialGraph {
+public:
+    struct Suggestion {
+        int id;
+        int mutualFriends;
+    };
+
+private:
+    static const std::vector<int>& none() {
+        static const std::vector<int> empty;
+        return empty;
+    }
+
+    std::unordered_map<int, std::vector<int>> adjacency;
+    // Friends in common for every pair of users two hops apart, kept up to
+    // date as friendships change so a suggestion never walks the graph
+    std::unordered_map<int, std::unordered_map<int, int>> mutual;
+    // Best suggestions per user, dropped when a friendship within two hops changes
+    std::unordered_map<int, std::vector<Suggestion>> topSuggestions;
+    uint64_t changes = 0;   // see version()
+
+    static bool insertSorted(std::vector<int>& list, int id) {
+        auto it = std::lower_bound(list.begin(), list.end(), id);
+        if (it != list.end() && *it == id) return false;
+        list.insert(it, id);
+        return true;
+    }
+
+    static void eraseSorted(std::vector<int>& list, int id) {
+        auto it = std::lower_bound(list.begin(), list.end(), id);
+        if (it != list.end() && *it == id) list.erase(it);
+    }
+
+    // x and y gained (delta 1) or lost (-1) a friend in common
+    void countMutual(int x, int y, int delta) {
+        if (x == y) return;
+        int& a = mutual[x][y];
+        int& b = mutual[y][x];
+        a += delta;
+        b += delta;
+        if (a <= 0) mutual[x].erase(y);
+        if (b <= 0) mutual[y].erase(x);
+    }
+
+public:
+    void load(const std::vector<std::pair<int, int>>& edges) {
+        changes++;
+        adjacency.clear();
+        mutual.clear();
+        topSuggestions.clear();
+        for (const auto& edge : edges) {
+            adjacency[edge.first].push_back(edge.second);
+            adjacency[edge.second].push_back(edge.first);
+        }
+        for (auto& entry : adjacency) {
+            std::vector<int>& list = entry.second;
+            std::sort(list.begin(), list.end());
+            list.erase(std::unique(list.begin(), list.end()), list.end());
+        }
+        // Every two friends of a user have that user in common
+        for (const auto& entry : adjacency) {
+            const std::vector<int>& list = entry.second;
+            for (size_t i = 0; i < list.size(); i++) {
+                for (size_t j = i + 1; j < list.size(); j++) {
+                    mutual[list[i]][list[j]]++;
+                    mutual[list[j]][list[i]]++;
+                }
+            }
+        }
+    }
+
+    void addFriendship(int a, int b) {
+        if (a == b || !insertSorted(adjacency[a], b)) return;
+        changes++;
+        insertSorted(adjacency[b], a);
+        for (int other : friendsOf(a)) countMutual(other, b, 1);
+        for (int other : friendsOf(b)) countMutual(other, a, 1);
+
+        // a and b gain new candidates, and each of their friends gains a
+        // mutual friend with the other side
+        topSuggestions.erase(a);
+        topSuggestions.erase(b);
+        for (int other : friendsOf(a)) topSuggestions.erase(other);
+        for (int other : friendsOf(b)) topSuggestions.erase(other);
+    }
+
+    void removeUser(int id) {
+        auto it = adjacency.find(id);
+        if (it == adjacency.end()) return;
+        changes++;
+        topSuggestions.clear();   // admin action, rare: not worth finding who was two hops away
+        const std::vector<int>& list = it->second;
+        for (size_t i = 0; i < list.size(); i++) {
+            for (size_t j = i + 1; j < list.size(); j++) countMutual(list[i], list[j], -1);
+        }
+        for (int other : list) {
+            auto peer = adjacency.find(other);
+            if (peer != adjacency.end()) eraseSorted(peer->second, id);
+        }
+        adjacency.erase(it);
+        auto counts = mutual.find(id);
+        if (counts != mutual.end()) {
+            for (const auto& entry : counts->second) mutual[entry.first].erase(id);
+            mutual.erase(counts);
+        }
+    }
+
+    // Takes over a graph loaded elsewhere (off the event loop)
+    void replaceWith(SocialGraph&& fresh) {
+        adjacency = std::move(fresh.adjacency);
+        mutual = std::move(fresh.mutual);
+        topSuggestions = std::move(fresh.topSuggestions);
+        changes++;
+    }
+
+    // Goes up with every change, so a copy loaded meanwhile can tell it is stale
+    uint64_t version() const { return changes; }
+
+    // Ascending user ids
+    const std::vector<int>& friendsOf(int id) const {
+        auto it = adjacency.find(id);
+        return it == adjacency.end() ? none() : it->second;
+    }
+
+    bool areFriends(int a, int b) const {
+        const std::vector<int>& list = friendsOf(a);
+        return std::binary_search(list.begin(), list.end(), b);
+    }
+
+    // Non-friends ranked by mutual friends (ties: lower id first), at most
+    // SUGGESTIONS_KEPT of them. The counts are maintained on every change,
+    // so this only ranks id's candidates; the result is cached until a
+    // friendship near id changes.
+    static constexpr size_t SUGGESTIONS_KEPT = 20;
+
+    const std::vector<Suggestion>& suggestionsFor(int id) {
+        auto cached = topSuggestions.find(id);
+        if (cached != topSuggestions.end()) return cached->second;
+
+        const std::vector<int>& mine = friendsOf(id);
+        std::vector<Suggestion> ranked;
+        auto counts = mutual.find(id);
+        if (counts == mutual.end()) return topSuggestions[id] = std::move(ranked);
+
+        ranked.reserve(counts->second.size());
+        for (const auto& entry : counts->second) {
+            if (!std::binary_search(mine.begin(), mine.end(), entry.first)) {
+                ranked.push_back(Suggestion{entry.first, entry.second});
+            }
+        }
+        auto better = [](const Suggestion& x, const Suggestion& y) {
+            return x.mutualFriends != y.mutualFriends ? x.mutualFriends > y.mutualFriends : x.id < y.id;
+        };
+        size_t kept = std::min(ranked.size(), SUGGESTIONS_KEPT);
+        std::partial_sort(ranked.begin(), ranked.begin() + kept, ranked.end(), better);
+        ranked.resize(kept);
+        return topSuggestions[id] = std::move(ranked);
+    }
+
+    // Friends a and b have in common
+    int mutualFriends(int a, int b) const {
+        auto counts = mutual.find(a);
+        if (counts == mutual.end()) return 0;
+        auto it = counts->second.find(b);
+        return it == counts->second.end() ? 0 : it->second;
+    }
+
+    // Everyone with a friend in common with id (id's friends included),
+    // mapped to how many they share
+    const std::unordered_map<int, int>& sharingFriendsWith(int id) const {
+        static const std::unordered_map<int, int> nobody;
+        auto counts = mutual.find(id);
+        return counts == mutual.end() ? nobody : counts->second;
+    }
+};
+
+#endif
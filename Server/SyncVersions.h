@@ -0,0 +1,62 @@
+#ifndef SYNC_VERSIONS_H
+#define SYNC_VERSIONS_H
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <unordered_map>
+
+// Sections a client keeps in sync with SYNC
+enum class SyncSection { Feed = 0, Friends, Requests, Groups };
+
+// Version stamps behind SYNC. Every change takes the next value of one
+// counter, so a stamp only has to be compared for equality. The counter
+// starts from the boot time, which keeps stamps handed out by an earlier
+// server process from matching by accident.
+//
+// Nothing here is persisted: a section nobody touched since boot has the
+// boot stamp, so a fresh client (stamp 0) always gets everything once.
+class SyncVersions {
+private:
+    static constexpr int PER_USER = 3;   // Friends, Requests, Groups
+
+    uint64_t counter;
+    uint64_t bootStamp;
+    uint64_t postsStamp;                 // any post created or deleted
+    uint64_t resetStamp;                 // changes touching everyone (user deleted)
+    std::unordered_map<int, std::array<uint64_t, PER_USER>> perUser;
+
+public:
+    SyncVersions() {
+        auto now = std::chrono::system_clock::now().time_since_epoch();
+        counter = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(now).count()) << 10;
+        bootStamp = postsStamp = resetStamp = counter;
+    }
+
+    void touch(int userId, SyncSection section) {
+        if (userId < 0) return;
+        if (section == SyncSection::Feed) { touchPosts(); return; }
+        auto it = perUser.find(userId);
+        if (it == perUser.end()) {
+            it = perUser.emplace(userId, std::array<uint64_t, PER_USER>{bootStamp, bootStamp, bootStamp}).first;
+        }
+        it->second[static_cast<int>(section) - 1] = ++counter;
+    }
+
+    void touchPosts() { postsStamp = ++counter; }
+    void touchAll() { resetStamp = ++counter; }
+
+    uint64_t stamp(int userId, SyncSection section) const {
+        if (section == SyncSection::Feed) {
+            // Friendships decide which posts are visible
+            return std::max(postsStamp, stamp(userId, SyncSection::Friends));
+        }
+        uint64_t own = bootStamp;
+        auto it = perUser.find(userId);
+        if (it != perUser.end()) own = it->second[static_cast<int>(section) - 1];
+        return std::max(own, resetStamp);
+    }
+};
+
+#endif
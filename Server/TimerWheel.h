@@ -0,0 +1,195 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Hierarchical timing wheel (4 levels x 256 slots). Timers live in a pooled
+// array linked into per-slot intrusive lists, so schedule() and cancel() are
+// O(1); advance() walks one slot per tick and cascades the upper levels when
+// the lower one wraps. Callbacks run on the thread calling advance().
+class TimerWheel {
+public:
+    using TimerId = uint64_t;
+    using Callback = std::function<void()>;
+    static constexpr TimerId INVALID_TIMER = 0;
+
+    explicit TimerWheel(int tickMs = 10) : tickMs(tickMs), heads(LEVELS * SLOTS + 1, NIL) {
+        currentTick = monotonicMs() / tickMs;
+    }
+
+    static int64_t monotonicMs() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    TimerId schedule(int64_t delayMs, Callback cb) {
+        if (delayMs < 0) delayMs = 0;
+        uint32_t idx;
+        if (freeHead != NIL) {
+            idx = freeHead;
+            freeHead = nodes[idx].next;
+        } else {
+            idx = static_cast<uint32_t>(nodes.size());
+            nodes.emplace_back();
+        }
+        Node& n = nodes[idx];
+        n.expires = (monotonicMs() + delayMs + tickMs - 1) / tickMs;
+        if (n.expires - currentTick > MAX_TICKS) n.expires = currentTick + MAX_TICKS;
+        n.callback = std::move(cb);
+        n.active = true;
+        place(idx);
+        activeCount++;
+        return (static_cast<TimerId>(n.generation) << 32) | (idx + 1);
+    }
+
+    // Safe to call with ids that already fired or were cancelled
+    bool cancel(TimerId id) {
+        if (id == INVALID_TIMER) return false;
+        uint32_t idx = static_cast<uint32_t>(id & 0xFFFFFFFFu) - 1;
+        uint32_t gen = static_cast<uint32_t>(id >> 32);
+        if (idx >= nodes.size() || !nodes[idx].active || nodes[idx].generation != gen) return false;
+        unlink(idx);
+        release(idx);
+        return true;
+    }
+
+    // Runs every timer due at or before now
+    void advance(int64_t nowMs) {
+        int64_t target = nowMs / tickMs;
+        while (currentTick <= target) {
+            uint32_t slot = currentTick & SLOT_MASK;
+            if (slot == 0) cascade(1);
+
+            // Detach the slot into the pending list; callbacks may cancel or
+            // schedule other timers while we pop from it. The tick moves on
+            // first so timers added by a callback land in a later slot.
+            moveList(slot, PENDING);
+            currentTick++;
+            while (heads[PENDING] != NIL) {
+                uint32_t idx = heads[PENDING];
+                unlink(idx);
+                Callback cb = std::move(nodes[idx].callback);
+                release(idx);
+                cb();
+            }
+        }
+    }
+
+    // Milliseconds until advance() has work to do, -1 when no timers exist.
+    // Upper levels are only inspected at cascade points, so long timers may
+    // cause an early (harmless) wakeup.
+    int nextTimeoutMs(int64_t nowMs) const {
+        if (activeCount == 0) return -1;
+        int64_t nowTick = nowMs / tickMs;
+        for (int64_t t = currentTick; t < currentTick + SLOTS; t++) {
+            uint32_t slot = t & SLOT_MASK;
+            if (slot == 0 && t != currentTick) return delayUntil(t, nowTick);
+            if (heads[slot] != NIL) return delayUntil(t, nowTick);
+        }
+        return delayUntil(currentTick + SLOTS, nowTick);
+    }
+
+    size_t size() const { return activeCount; }
+
+private:
+    static constexpr int LEVELS = 4;
+    static constexpr int SLOT_BITS = 8;
+    static constexpr uint32_t SLOTS = 1u << SLOT_BITS;
+    static constexpr uint32_t SLOT_MASK = SLOTS - 1;
+    static constexpr uint32_t NIL = 0xFFFFFFFFu;
+    static constexpr uint32_t PENDING = LEVELS * SLOTS;
+    static constexpr int64_t MAX_TICKS = (int64_t(1) << (SLOT_BITS * LEVELS)) - 1;
+
+    struct Node {
+        int64_t expires = 0;     // absolute tick
+        Callback callback;
+        uint32_t prev = NIL;
+        uint32_t next = NIL;
+        uint32_t list = NIL;
+        uint32_t generation = 0;
+        bool active = false;
+    };
+
+    int tickMs;
+    int64_t currentTick;
+    std::vector<Node> nodes;
+    std::vector<uint32_t> heads;
+    uint32_t freeHead = NIL;
+    size_t activeCount = 0;
+
+    int delayUntil(int64_t tick, int64_t nowTick) const {
+        int64_t ticks = tick - nowTick;
+        return ticks <= 0 ? 0 : static_cast<int>(ticks * tickMs);
+    }
+
+    void place(uint32_t idx) {
+        Node& n = nodes[idx];
+        int64_t delta = n.expires - currentTick;
+        uint32_t list;
+        if (delta < 0) {
+            list = currentTick & SLOT_MASK;
+        } else {
+            int level = 0;
+            while (level < LEVELS - 1 && delta >= (int64_t(1) << (SLOT_BITS * (level + 1)))) level++;
+            list = level * SLOTS + ((n.expires >> (SLOT_BITS * level)) & SLOT_MASK);
+        }
+        pushFront(list, idx);
+    }
+
+    void cascade(int level) {
+        if (level >= LEVELS) return;
+        uint32_t slot = (currentTick >> (SLOT_BITS * level)) & SLOT_MASK;
+        if (slot == 0) cascade(level + 1);
+
+        uint32_t list = level * SLOTS + slot;
+        uint32_t idx = heads[list];
+        heads[list] = NIL;
+        while (idx != NIL) {
+            uint32_t next = nodes[idx].next;
+            place(idx);
+            idx = next;
+        }
+    }
+
+    void pushFront(uint32_t list, uint32_t idx) {
+        Node& n = nodes[idx];
+        n.list = list;
+        n.prev = NIL;
+        n.next = heads[list];
+        if (n.next != NIL) nodes[n.next].prev = idx;
+        heads[list] = idx;
+    }
+
+    void unlink(uint32_t idx) {
+        Node& n = nodes[idx];
+        if (n.prev != NIL) nodes[n.prev].next = n.next;
+        else heads[n.list] = n.next;
+        if (n.next != NIL) nodes[n.next].prev = n.prev;
+        n.prev = n.next = n.list = NIL;
+    }
+
+    void moveList(uint32_t from, uint32_t to) {
+        uint32_t idx = heads[from];
+        heads[from] = NIL;
+        while (idx != NIL) {
+            uint32_t next = nodes[idx].next;
+            pushFront(to, idx);
+            idx = next;
+        }
+    }
+
+    void release(uint32_t idx) {
+        Node& n = nodes[idx];
+        n.active = false;
+        n.callback = nullptr;
+        n.generation++;
+        n.next = freeHead;
+        freeHead = idx;
+        activeCount--;
+    }
+};
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef USERNAME_INDEX_H
+#define USERNAME_INDEX_H
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "BloomFilter.h"
+
+// Every username, sorted, for prefix lookups (SUGGEST_USERS). All names
+// sharing a prefix are one contiguous run, found with two binary searches,
+// so a keystroke costs O(log n) no matter how many users there are.
+// Registrations and deletions shift the tail of the array; both are rare
+// next to lookups and a memmove over a few MB is still cheap.
+//
+// It is also the answer to "which id has this name": find() never goes to
+// SQLite. A Bloom filter in front turns away most unknown names (typos,
+// bots sweeping random usernames) before the binary search; deleted names
+// stay in the filter until enough of them pile up to rebuild it.
+//
+// Loaded once from the users table; used on the event loop thread only.
+class UsernameIndex {
+public:
+    struct Entry {
+        std::string name;
+        int id;
+    };
+    using Iterator = std::vector<Entry>::const_iterator;
+
+private:
+    std::vector<Entry> entries;
+    std::unordered_map<int, std::string> namesById;
+    BloomFilter filter;
+    size_t staleInFilter = 0;   // deleted names still set in the filter
+    uint64_t filterRejects = 0;
+    uint64_t filterFalsePositives = 0;
+    uint64_t changes = 0;   // see version()
+
+    static bool nameLess(const Entry& e, const std::string& name) { return e.name < name; }
+
+    // Room for growth, so registrations don't trigger a rebuild each time
+    void rebuildFilter() {
+        filter.reset(entries.size() * 2);
+        for (const auto& e : entries) filter.add(e.name);
+        staleInFilter = 0;
+    }
+
+public:
+    void load(std::vector<std::pair<int, std::string>> users) {
+        changes++;
+        entries.clear();
+        namesById.clear();
+        entries.reserve(users.size());
+        for (auto& user : users) {
+            namesById[user.first] = user.second;
+            entries.push_back(Entry{std::move(user.second), user.first});
+        }
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.name < b.name; });
+        rebuildFilter();
+    }
+
+    void add(const std::string& name, int id) {
+        changes++;
+        namesById[id] = name;
+        auto it = std::lower_bound(entries.begin(), entries.end(), name, nameLess);
+        if (it != entries.end() && it->name == name) { it->id = id; return; }
+        entries.insert(it, Entry{name, id});
+        if (entries.size() + staleInFilter > filter.sizedFor()) rebuildFilter();
+        else filter.add(name);
+    }
+
+    void remove(const std::string& name) {
+        auto it = std::lower_bound(entries.begin(), entries.end(), name, nameLess);
+        if (it == entries.end() || it->name != name) return;
+        changes++;
+        namesById.erase(it->id);
+        entries.erase(it);
+        // Stale bits only cost lookups a binary search; rebuild once a
+        // quarter of the filter is stale
+        if (++staleInFilter > entries.size() / 4 + 64) rebuildFilter();
+    }
+
+    // Takes over an index loaded elsewhere (off the event loop); the
+    // filter statistics carry on
+    void replaceWith(UsernameIndex&& fresh) {
+        entries = std::move(fresh.entries);
+        namesById = std::move(fresh.namesById);
+        filter = std::move(fresh.filter);
+        staleInFilter = fresh.staleInFilter;
+        changes++;
+    }
+
+    // Goes up with every change, so a copy loaded meanwhile can tell it is stale
+    uint64_t version() const { return changes; }
+
+    // Id of the user with this name, -1 if there is none
+    int find(const std::string& name) {
+        if (!filter.mightContain(name)) {
+            filterRejects++;
+            return -1;
+        }
+        auto it = std::lower_bound(entries.cbegin(), entries.cend(), name, nameLess);
+        if (it != entries.cend() && it->name == name) return it->id;
+        filterFalsePositives++;
+        return -1;
+    }
+
+    // "" for an id that is not (or no longer) a user
+    const std::string& nameOf(int id) const {
+        static const std::string unknown;
+        auto it = namesById.find(id);
+        return it == namesById.end() ? unknown : it->second;
+    }
+
+    // Names starting with prefix, in order
+    std::pair<Iterator, Iterator> withPrefix(const std::string& prefix) const {
+        Iterator first = std::lower_bound(entries.cbegin(), entries.cend(), prefix, nameLess);
+        Iterator last = std::partition_point(first, entries.cend(), [&prefix](const Entry& e) {
+            return e.name.compare(0, prefix.size(), prefix) == 0;
+        });
+        return {first, last};
+    }
+
+    size_t size() const { return entries.size(); }
+    uint64_t rejectedByFilter() const { return filterRejects; }
+    uint64_t falsePositives() const { return filterFalsePositives; }
+};
+
+#endif
@@ -1,7 +1,12 @@
 #include "Server.h"
+#include "Logger.h"
 
-int main() {
-    Server server(9000);
+int main(int argc, char* argv[]) {
+    ServerConfig config;
+    if (!config.parseArgs(argc, argv)) return 1;
+    Logger::configure(config.logLevel, config.logRateLimit);
+
+    Server server(config);
     server.start();
     return 0;
 }
@@ -0,0 +1,40 @@
+#include <string>
+#include "BloomFilter.h"
+#include "Check.h"
+
+static void testNoFalseNegatives() {
+    BloomFilter filter(10000);
+    for (int i = 0; i < 10000; i++) filter.add("user" + std::to_string(i));
+    int missing = 0;
+    for (int i = 0; i < 10000; i++) {
+        if (!filter.mightContain("user" + std::to_string(i))) missing++;
+    }
+    CHECK(missing == 0);
+}
+
+static void testFalsePositiveRate() {
+    BloomFilter filter(10000);
+    for (int i = 0; i < 10000; i++) filter.add("user" + std::to_string(i));
+    int hits = 0;
+    for (int i = 0; i < 100000; i++) {
+        if (filter.mightContain("other" + std::to_string(i))) hits++;
+    }
+    CHECK(hits < 3000);   // about 1% expected; 3% is a broken filter
+}
+
+static void testReset() {
+    BloomFilter filter;
+    CHECK(!filter.mightContain("alice"));
+    filter.add("alice");
+    CHECK(filter.mightContain("alice"));
+    filter.reset(100);
+    CHECK(!filter.mightContain("alice"));
+    CHECK(filter.sizedFor() >= 100);
+}
+
+int main() {
+    testNoFalseNegatives();
+    testFalsePositiveRate();
+    testReset();
+    return checkFailures() == 0 ? 0 : 1;
+}
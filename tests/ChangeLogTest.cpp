@@ -0,0 +1,127 @@
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "Check.h"
+#include "Database/ChangeLog.h"
+
+static std::string tempDir() {
+    char path[] = "/tmp/changelog-test-XXXXXX";
+    return mkdtemp(path) ? path : "";
+}
+
+static void removeDir(const std::string& dir) {
+    for (uint64_t seq : ChangeLog::listSegments(dir)) unlink(ChangeLog::segmentPath(dir, seq).c_str());
+    rmdir(dir.c_str());
+}
+
+static std::vector<Protocol::Field> post(int id, const std::string& content) {
+    return {Protocol::Field::integer(id), Protocol::Field::integer(1), Protocol::Field::integer(0), Protocol::Field::text(content)};
+}
+
+static void testAppendAndReplay() {
+    std::string dir = tempDir();
+    {
+        ChangeLog log(dir, 1 << 20, 4);
+        CHECK(log.isOpen());
+        CHECK(log.append(ChangeKind::PostCreated, post(1, "first")) == 1);
+        CHECK(log.append(ChangeKind::PostCreated, post(2, "second")) == 2);
+        CHECK(log.append(ChangeKind::UserDeleted, {Protocol::Field::text("carol")}) == 3);
+        CHECK(log.lastSeq() == 3);
+    }
+
+    ChangeLogReader reader(dir, 1);
+    ChangeRecord record;
+    std::vector<Protocol::Field> fields;
+    CHECK(reader.next(record) && record.seq == 1 && record.kind == ChangeKind::PostCreated);
+    CHECK(record.fields(fields) && fields.size() == 4 && fields[0].num == 1 && fields[3].str == "first");
+    CHECK(reader.next(record) && record.seq == 2);
+    CHECK(reader.next(record) && record.seq == 3 && record.kind == ChangeKind::UserDeleted);
+    fields.clear();
+    CHECK(record.fields(fields) && fields.size() == 1 && fields[0].str == "carol");
+    CHECK(!reader.next(record));
+
+    // Reopened, the log carries on after the last record
+    {
+        ChangeLog log(dir, 1 << 20, 4);
+        CHECK(log.lastSeq() == 3);
+        CHECK(log.append(ChangeKind::PostDeleted, {Protocol::Field::integer(1), Protocol::Field::integer(1)}) == 4);
+    }
+    CHECK(reader.next(record) && record.seq == 4 && record.kind == ChangeKind::PostDeleted);
+
+    ChangeLogReader late(dir, 3);
+    CHECK(late.next(record) && record.seq == 3);
+    removeDir(dir);
+}
+
+static void testRotationAndRetention() {
+    std::string dir = tempDir();
+    std::string text(1000, 'x');
+    {
+        ChangeLog log(dir, 4096, 2);
+        for (int i = 1; i <= 20; i++) CHECK(log.append(ChangeKind::PostCreated, post(i, text)) == static_cast<uint64_t>(i));
+        CHECK(log.segmentsCreated() > 2);
+    }
+    CHECK(ChangeLog::listSegments(dir).size() == 2);
+
+    // The oldest records are gone: a reader starting at 1 skips ahead
+    ChangeLogReader reader(dir, 1);
+    ChangeRecord record;
+    uint64_t last = 0;
+    int count = 0;
+    while (reader.next(record)) {
+        CHECK(record.seq > last);
+        last = record.seq;
+        count++;
+    }
+    CHECK(last == 20);
+    CHECK(reader.missed() + count == 20);
+    CHECK(reader.missed() > 0);
+    removeDir(dir);
+}
+
+static void testCorruptSegmentIsSkipped() {
+    std::string dir = tempDir();
+    std::string text(1000, 'x');
+    {
+        ChangeLog log(dir, 4096, 8);
+        for (int i = 1; i <= 6; i++) log.append(ChangeKind::PostCreated, post(i, text));
+    }
+    std::vector<uint64_t> segments = ChangeLog::listSegments(dir);
+    CHECK(segments.size() >= 2);
+
+    // The first record of the first segment claims to run past the file
+    uint32_t huge = 1 << 20;
+    int fd = open(ChangeLog::segmentPath(dir, segments[0]).c_str(), O_WRONLY);
+    CHECK(fd >= 0 && pwrite(fd, &huge, sizeof(huge), ChangeLog::HEADER_BYTES) == sizeof(huge));
+    close(fd);
+
+    ChangeLogReader reader(dir, 1);
+    ChangeRecord record;
+    CHECK(reader.next(record) && record.seq == segments[1]);
+    CHECK(reader.missed() == segments[1] - 1);
+    removeDir(dir);
+}
+
+static void testUnwrittenRecordEndsTheLog() {
+    std::string dir = tempDir();
+    {
+        ChangeLog log(dir, 1 << 20, 4);
+        log.append(ChangeKind::PostCreated, post(1, "kept"));
+    }
+    ChangeLogReader reader(dir, 1);
+    ChangeRecord record;
+    CHECK(reader.next(record) && record.seq == 1);
+    CHECK(!reader.next(record));   // size 0: nothing written there yet
+    removeDir(dir);
+}
+
+int main() {
+    Logger::configure("error", 0);
+    testAppendAndReplay();
+    testRotationAndRetention();
+    testCorruptSegmentIsSkipped();
+    testUnwrittenRecordEndsTheLog();
+    return checkFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,21 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <cstdio>
+
+// Minimal assertions for the unit tests: a failed CHECK prints where and
+// what, and main() returns checkFailures() so ctest sees the result.
+inline int& checkFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(cond)                                                                \
+    do {                                                                           \
+        if (!(cond)) {                                                             \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            checkFailures()++;                                                     \
+        }                                                                          \
+    } while (0)
+
+#endif
@@ -0,0 +1,42 @@
+#include <string>
+#include "Check.h"
+#include "Logger.h"
+
+static std::string value(const std::string& v) {
+    std::string out;
+    Logger::appendValue(out, v);
+    return out;
+}
+
+static void testNeedsQuotes() {
+    CHECK(!Logger::needsQuotes("plain"));
+    CHECK(!Logger::needsQuotes("a-b_c.d/e:1"));
+    CHECK(Logger::needsQuotes(""));
+    CHECK(Logger::needsQuotes("two words"));
+    CHECK(Logger::needsQuotes("key=value"));
+    CHECK(Logger::needsQuotes("say \"hi\""));
+    CHECK(Logger::needsQuotes("tab\there"));
+    CHECK(Logger::needsQuotes(std::string("nul\0", 4)));
+    CHECK(Logger::needsQuotes("del\x7f"));
+}
+
+static void testEscaping() {
+    CHECK(value("plain") == "plain");
+    CHECK(value("") == "\"\"");
+    CHECK(value("two words") == "\"two words\"");
+    CHECK(value("say \"hi\"") == "\"say \\\"hi\\\"\"");
+    CHECK(value("back\\slash x") == "\"back\\\\slash x\"");
+    CHECK(value("a\nb") == "\"a\\nb\"");
+    CHECK(value("a\r\tb") == "\"a\\r\\tb\"");
+    CHECK(value("bell\x07") == "\"bell\\x07\"");
+    CHECK(value("del\x7f") == "\"del\\x7f\"");
+    // A value cannot start a record of its own
+    std::string forged = value("x\n2026-01-01T00:00:00.000Z ERROR fake");
+    CHECK(forged.find('\n') == std::string::npos);
+}
+
+int main() {
+    testNeedsQuotes();
+    testEscaping();
+    return checkFailures() == 0 ? 0 : 1;
+}
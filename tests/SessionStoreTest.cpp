@@ -0,0 +1,70 @@
+#include <memory>
+#include <string>
+#include <vector>
+#include "Check.h"
+#include "SessionStore.h"
+
+static OfflineCopy chatFor(const std::string& user) {
+    return OfflineCopy{user, std::make_shared<const ChatOrigin>(ChatOrigin{"bob", "hi", false, -1})};
+}
+
+static void testItemLimit() {
+    SessionStore store;
+    Session& s = store.create("alice", 5);
+    std::vector<OfflineCopy> lost;
+    for (int i = 0; i < 300; i++) store.record(s, 101, makeSharedBuffer("x"), chatFor("alice"), lost);
+    CHECK(s.recent.size() == 256);
+    CHECK(s.oldestSeq() == 45);
+    CHECK(lost.empty());   // attached: the client had them all
+}
+
+static void testByteLimitSpillsUnread() {
+    SessionStore store;
+    Session& s = store.create("alice", 5);
+    store.detach(s, s.nextSeq);
+    std::vector<OfflineCopy> lost;
+    std::string big(100 << 10, 'x');
+    for (int i = 0; i < 3; i++) store.record(s, 101, makeSharedBuffer(big), chatFor("alice"), lost);
+    CHECK(s.recentBytes <= (256u << 10));
+    CHECK(s.recent.size() == 2);
+    CHECK(lost.size() == 1);
+    CHECK(store.unread(s).size() == 2);
+}
+
+static void testBudget() {
+    SessionStore store;
+    store.setBudget(1000);
+    Session& a = store.create("alice", 5);
+    Session& b = store.create("bob", 6);
+    std::vector<OfflineCopy> lost;
+    for (int i = 0; i < 10; i++) store.record(a, 100, makeSharedBuffer(std::string(100, 'a')), OfflineCopy(), lost);
+    CHECK(store.bytes() == 1000);
+    store.record(b, 100, makeSharedBuffer(std::string(100, 'b')), OfflineCopy(), lost);
+    // Over budget, but a session always keeps its newest push
+    CHECK(b.recent.size() == 1);
+    store.record(a, 100, makeSharedBuffer(std::string(100, 'a')), OfflineCopy(), lost);
+    CHECK(store.bytes() <= 1100);
+    CHECK(a.recent.back().seq == 11);
+
+    store.remove(a.token);
+    CHECK(store.bytes() == 100);
+}
+
+static void testDetachedLookup() {
+    SessionStore store;
+    Session& s = store.create("alice", 5);
+    CHECK(store.detachedSessionOf("alice") == nullptr);
+    store.detach(s, 1);
+    CHECK(store.detachedSessionOf("alice") == &s);
+    store.attach(s, 7);
+    CHECK(store.detachedSessionOf("alice") == nullptr);
+    CHECK(store.find(s.token) == &s);
+}
+
+int main() {
+    testItemLimit();
+    testByteLimitSpillsUnread();
+    testBudget();
+    testDetachedLookup();
+    return checkFailures() == 0 ? 0 : 1;
+}